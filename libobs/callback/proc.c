@@ -15,14 +15,22 @@
  */
 
 #include "../util/darray.h"
+#include "../util/dstr.h"
 
 #include "decl.h"
 #include "proc.h"
 
+/* number of hash buckets for the procedures of a handler */
+#define PROC_BUCKETS 32
+
 struct proc_info {
 	struct decl_info func;
 	void *data;
 	proc_handler_proc_t callback;
+
+	uint32_t hash;
+	/* index + 1 of the next procedure in the same bucket, 0 if none */
+	size_t hash_next;
 };
 
 static inline void proc_info_free(struct proc_info *pi)
@@ -31,13 +39,15 @@ static inline void proc_info_free(struct proc_info *pi)
 }
 
 struct proc_handler {
-	/* TODO: replace with hash table lookup? */
 	DARRAY(struct proc_info) procs;
+
+	/* index + 1 of the first procedure of each bucket, 0 if empty */
+	size_t buckets[PROC_BUCKETS];
 };
 
 proc_handler_t *proc_handler_create(void)
 {
-	struct proc_handler *handler = bmalloc(sizeof(struct proc_handler));
+	struct proc_handler *handler = bzalloc(sizeof(struct proc_handler));
 	da_init(handler->procs);
 	return handler;
 }
@@ -69,7 +79,16 @@ void proc_handler_add(proc_handler_t *handler, const char *decl_string,
 
 	pi.callback = proc;
 	pi.data = data;
+	pi.hash = str_hash(pi.func.name);
 
+	/* append to the bucket so the first procedure added with a name is
+	 * still the one that gets called */
+	size_t *next = &handler->buckets[pi.hash % PROC_BUCKETS];
+	while (*next)
+		next = &handler->procs.array[*next - 1].hash_next;
+
+	size_t idx = handler->procs.num;
+	*next = idx + 1;
 	da_push_back(handler->procs, &pi);
 }
 
@@ -79,13 +98,18 @@ bool proc_handler_call(proc_handler_t *handler, const char *name,
 	if (!handler)
 		return false;
 
-	for (size_t i = 0; i < handler->procs.num; i++) {
-		struct proc_info *info = handler->procs.array + i;
+	uint32_t hash = str_hash(name);
+	size_t idx = handler->buckets[hash % PROC_BUCKETS];
+
+	while (idx) {
+		struct proc_info *info = handler->procs.array + (idx - 1);
 
-		if (strcmp(info->func.name, name) == 0) {
+		if (info->hash == hash && strcmp(info->func.name, name) == 0) {
 			info->callback(info->data, params);
 			return true;
 		}
+
+		idx = info->hash_next;
 	}
 
 	return false;
@@ -15,45 +15,416 @@
  */
 
 #include "../util/darray.h"
+#include "../util/dstr.h"
 #include "../util/threading.h"
+#include "../util/platform.h"
 
 #include "decl.h"
 #include "signal.h"
 
-struct signal_callback {
+/* number of hash buckets for the signals of a handler */
+#define SIGNAL_BUCKETS 32
+
+/* number of deferred signals that can be waiting for the dispatcher */
+#define DISPATCH_QUEUE_SIZE 1024
+
+/* calldata up to this size is copied into the queue without allocating */
+#define DISPATCH_EVENT_STACK 256
+
+struct deferred_callback {
+	volatile long refs;
 	signal_callback_t callback;
 	void *data;
+	bool coalesce;
 	bool remove;
+
+	/* held by the dispatcher while calling, so that a callback never runs
+	 * after it's been disconnected */
+	pthread_mutex_t call_mutex;
+	volatile bool connected;
+
+	/* coalesced callbacks only keep the newest parameters */
+	pthread_mutex_t latest_mutex;
+	calldata_t latest;
+	bool queued;
+};
+
+struct signal_callback {
+	signal_callback_t callback;
+	global_signal_callback_t global_callback;
+	void *data;
 	bool keep_ref;
+	struct deferred_callback *deferred;
+};
+
+/*
+ *   Callback lists are copy-on-write: a list is never modified once it's been
+ * published, connecting or disconnecting replaces it with a new one.  Signals
+ * take a reference to the current list and call the callbacks without
+ * holding any lock, so signals on different threads run at the same time.
+ *
+ *   Every list counts the calls in progress for each of its callbacks.
+ * Disconnecting waits until no other thread is calling the callback from any
+ * list that's still in use, so a callback never runs after it's been
+ * disconnected.  Calls made by the disconnecting thread itself, such as the
+ * callback disconnecting itself, are found through the thread's signal
+ * frames and aren't waited for.
+ */
+struct callback_list {
+	volatile long refs;
+	size_t num;
+	struct signal_callback *array;
+	volatile long *calls;
+
+	/* every list of a set that's still referenced, protected by the set
+	 * mutex */
+	struct callback_list *next;
+	struct callback_list **prev_next;
+};
+
+struct callback_set {
+	pthread_mutex_t mutex;
+	pthread_cond_t calls_cond;
+	struct callback_list *list;
+	struct callback_list *lists;
+	volatile long generation;
+	volatile long waiters;
+};
+
+/* a signal in progress on this thread, signals can be nested */
+struct signal_frame {
+	struct callback_list *list;
+	size_t calling;
+	struct signal_frame *prev;
 };
 
 struct signal_info {
 	struct decl_info func;
-	DARRAY(struct signal_callback) callbacks;
-	pthread_mutex_t mutex;
-	bool signalling;
+	uint32_t hash;
+	struct callback_set callbacks;
 
 	struct signal_info *next;
+	struct signal_info *hash_next;
 };
 
-static inline struct signal_info *signal_info_create(struct decl_info *info)
+struct signal_handler {
+	struct signal_info *first;
+	struct signal_info *buckets[SIGNAL_BUCKETS];
+	pthread_mutex_t mutex;
+	volatile long refs;
+
+	struct callback_set global_callbacks;
+};
+
+/* set by signal_handler_remove_current for the callback this thread is
+ * currently calling */
+static THREAD_LOCAL bool *current_remove = NULL;
+static THREAD_LOCAL struct deferred_callback *current_deferred_cb = NULL;
+static THREAD_LOCAL struct signal_frame *current_frame = NULL;
+
+static void deferred_callback_release(struct deferred_callback *cb)
 {
-	pthread_mutexattr_t attr;
-	struct signal_info *si;
+	if (cb && os_atomic_dec_long(&cb->refs) == 0) {
+		pthread_mutex_destroy(&cb->call_mutex);
+		pthread_mutex_destroy(&cb->latest_mutex);
+		calldata_free(&cb->latest);
+		bfree(cb);
+	}
+}
 
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
+static void deferred_callback_disconnect(struct deferred_callback *cb)
+{
+	pthread_mutex_lock(&cb->call_mutex);
+	os_atomic_set_bool(&cb->connected, false);
+	pthread_mutex_unlock(&cb->call_mutex);
+
+	deferred_callback_release(cb);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Copy-on-write callback lists */
+
+/* must be called with the set locked */
+static struct callback_list *callback_list_create(struct callback_set *set,
+						  size_t num)
+{
+	struct callback_list *list =
+		bzalloc(sizeof(struct callback_list) +
+			sizeof(struct signal_callback) * num +
+			sizeof(long) * num);
+
+	list->refs = 1;
+	list->num = num;
+	list->array = (struct signal_callback *)(list + 1);
+	list->calls = (volatile long *)(list->array + num);
+
+	list->prev_next = &set->lists;
+	list->next = set->lists;
+	if (list->next)
+		list->next->prev_next = &list->next;
+	set->lists = list;
+	return list;
+}
+
+static void callback_list_release(struct callback_set *set,
+				  struct callback_list *list)
+{
+	if (!list || os_atomic_dec_long(&list->refs) != 0)
+		return;
+
+	pthread_mutex_lock(&set->mutex);
+	*list->prev_next = list->next;
+	if (list->next)
+		list->next->prev_next = list->prev_next;
+	pthread_mutex_unlock(&set->mutex);
+
+	bfree(list);
+}
+
+static inline bool callback_matches(const struct signal_callback *a,
+				    const struct signal_callback *b)
+{
+	return a->callback == b->callback &&
+	       a->global_callback == b->global_callback && a->data == b->data;
+}
+
+static size_t callback_list_find(const struct callback_list *list,
+				 const struct signal_callback *cb)
+{
+	if (list) {
+		for (size_t i = 0; i < list->num; i++) {
+			if (callback_matches(list->array + i, cb))
+				return i;
+		}
+	}
+
+	return DARRAY_INVALID;
+}
+
+static bool callback_set_init(struct callback_set *set)
+{
+	set->list = NULL;
+	set->lists = NULL;
+	set->generation = 0;
+	set->waiters = 0;
+
+	if (pthread_mutex_init(&set->mutex, NULL) != 0)
+		return false;
+	if (pthread_cond_init(&set->calls_cond, NULL) != 0) {
+		pthread_mutex_destroy(&set->mutex);
+		return false;
+	}
+
+	return true;
+}
+
+static void callback_set_free(struct callback_set *set)
+{
+	struct callback_list *list = set->list;
+
+	if (list) {
+		for (size_t i = 0; i < list->num; i++) {
+			if (list->array[i].deferred)
+				deferred_callback_disconnect(
+					list->array[i].deferred);
+		}
+	}
+
+	callback_list_release(set, list);
+	pthread_cond_destroy(&set->calls_cond);
+	pthread_mutex_destroy(&set->mutex);
+}
+
+static struct callback_list *callback_set_acquire(struct callback_set *set,
+						  long *generation)
+{
+	struct callback_list *list;
+
+	pthread_mutex_lock(&set->mutex);
+	list = set->list;
+	if (list)
+		os_atomic_inc_long(&list->refs);
+	*generation = os_atomic_load_long(&set->generation);
+	pthread_mutex_unlock(&set->mutex);
+
+	return list;
+}
+
+/* must be called with the set locked */
+static void callback_set_replace(struct callback_set *set,
+				 struct callback_list *list)
+{
+	set->list = list;
+	os_atomic_inc_long(&set->generation);
+}
+
+static void callback_set_add(struct callback_set *set,
+			     const struct signal_callback *cb,
+			     bool allow_duplicate, bool *added)
+{
+	struct callback_list *old;
+	struct callback_list *list = NULL;
+
+	pthread_mutex_lock(&set->mutex);
 
-	si = bmalloc(sizeof(struct signal_info));
+	old = set->list;
+	*added = allow_duplicate || callback_list_find(old, cb) ==
+					    DARRAY_INVALID;
+
+	if (*added) {
+		size_t num = old ? old->num : 0;
+
+		list = callback_list_create(set, num + 1);
+		if (num)
+			memcpy(list->array, old->array,
+			       sizeof(struct signal_callback) * num);
+		list->array[num] = *cb;
+
+		callback_set_replace(set, list);
+	}
+
+	pthread_mutex_unlock(&set->mutex);
+
+	/* signals still using the old list hold their own reference */
+	if (list)
+		callback_list_release(set, old);
+}
+
+/* calls of the callback at idx that this thread has in progress */
+static long own_calls(const struct callback_list *list, size_t idx)
+{
+	long calls = 0;
+
+	for (struct signal_frame *frame = current_frame; frame;
+	     frame = frame->prev) {
+		if (frame->list == list && frame->calling == idx)
+			calls++;
+	}
+
+	return calls;
+}
+
+/* must be called with the set locked.  the published list is skipped, a
+ * duplicate of the callback that's still connected may be called from it. */
+static bool callback_being_called(struct callback_set *set,
+				  const struct signal_callback *cb)
+{
+	for (struct callback_list *list = set->lists; list;
+	     list = list->next) {
+		if (list == set->list)
+			continue;
+
+		for (size_t i = 0; i < list->num; i++) {
+			if (callback_matches(list->array + i, cb) &&
+			    os_atomic_load_long(&list->calls[i]) >
+				    own_calls(list, i))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static bool callback_set_remove(struct callback_set *set,
+				const struct signal_callback *cb,
+				struct signal_callback *removed)
+{
+	struct callback_list *old;
+	struct callback_list *list = NULL;
+	size_t idx;
+
+	pthread_mutex_lock(&set->mutex);
+
+	old = set->list;
+	idx = callback_list_find(old, cb);
+
+	if (idx != DARRAY_INVALID) {
+		*removed = old->array[idx];
+
+		if (old->num > 1) {
+			list = callback_list_create(set, old->num - 1);
+			memcpy(list->array, old->array,
+			       sizeof(struct signal_callback) * idx);
+			memcpy(list->array + idx, old->array + idx + 1,
+			       sizeof(struct signal_callback) *
+				       (old->num - idx - 1));
+		}
+
+		callback_set_replace(set, list);
+
+		/* the grace period: waits for other threads that are calling
+		 * the callback from a list they acquired before this */
+		os_atomic_inc_long(&set->waiters);
+		while (callback_being_called(set, cb))
+			pthread_cond_wait(&set->calls_cond, &set->mutex);
+		os_atomic_dec_long(&set->waiters);
+	}
+
+	pthread_mutex_unlock(&set->mutex);
+
+	if (idx == DARRAY_INVALID)
+		return false;
+
+	callback_list_release(set, old);
+	return true;
+}
+
+/* a callback that was disconnected after the list was acquired must not be
+ * called anymore */
+static bool callback_still_connected(struct callback_set *set,
+				     const struct signal_callback *cb)
+{
+	bool connected;
+
+	pthread_mutex_lock(&set->mutex);
+	connected = callback_list_find(set->list, cb) != DARRAY_INVALID;
+	pthread_mutex_unlock(&set->mutex);
+
+	return connected;
+}
+
+/* counts the call before checking whether the callback is still connected,
+ * so a disconnect either sees the call or the signal sees the new
+ * generation */
+static bool begin_call(struct callback_set *set, struct signal_frame *frame,
+		       size_t idx, long generation)
+{
+	struct callback_list *list = frame->list;
+
+	os_atomic_inc_long(&list->calls[idx]);
+	frame->calling = idx;
+
+	if (os_atomic_load_long(&set->generation) == generation ||
+	    callback_still_connected(set, list->array + idx))
+		return true;
+
+	os_atomic_dec_long(&list->calls[idx]);
+	frame->calling = DARRAY_INVALID;
+	return false;
+}
+
+static void end_call(struct callback_set *set, struct signal_frame *frame)
+{
+	os_atomic_dec_long(&frame->list->calls[frame->calling]);
+	frame->calling = DARRAY_INVALID;
+
+	if (os_atomic_load_long(&set->waiters)) {
+		pthread_mutex_lock(&set->mutex);
+		pthread_cond_broadcast(&set->calls_cond);
+		pthread_mutex_unlock(&set->mutex);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline struct signal_info *signal_info_create(struct decl_info *info)
+{
+	struct signal_info *si = bzalloc(sizeof(struct signal_info));
 
 	si->func = *info;
-	si->next = NULL;
-	si->signalling = false;
-	da_init(si->callbacks);
+	si->hash = str_hash(info->name);
 
-	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
+	if (!callback_set_init(&si->callbacks)) {
 		blog(LOG_ERROR, "Could not create signal");
 
 		decl_info_free(&si->func);
@@ -67,60 +438,25 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
-		pthread_mutex_destroy(&si->mutex);
+		callback_set_free(&si->callbacks);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
-					     signal_callback_t callback,
-					     void *data)
-{
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array + i;
-
-		if (sc->callback == callback && sc->data == data)
-			return i;
-	}
-
-	return DARRAY_INVALID;
-}
-
-struct global_callback_info {
-	global_signal_callback_t callback;
-	void *data;
-	long signaling;
-	bool remove;
-};
-
-struct signal_handler {
-	struct signal_info *first;
-	pthread_mutex_t mutex;
-	volatile long refs;
-
-	DARRAY(struct global_callback_info) global_callbacks;
-	pthread_mutex_t global_callbacks_mutex;
-};
-
 static struct signal_info *getsignal(signal_handler_t *handler,
-				     const char *name,
-				     struct signal_info **p_last)
+				     const char *name)
 {
-	struct signal_info *signal, *last = NULL;
+	uint32_t hash = str_hash(name);
+	struct signal_info *signal = handler->buckets[hash % SIGNAL_BUCKETS];
 
-	signal = handler->first;
 	while (signal != NULL) {
-		if (strcmp(signal->func.name, name) == 0)
+		if (signal->hash == hash && strcmp(signal->func.name, name) == 0)
 			break;
 
-		last = signal;
-		signal = signal->next;
+		signal = signal->hash_next;
 	}
 
-	if (p_last)
-		*p_last = last;
 	return signal;
 }
 
@@ -132,18 +468,12 @@ signal_handler_t *signal_handler_create(void)
 	handler->first = NULL;
 	handler->refs = 1;
 
-	pthread_mutexattr_t attr;
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
-
 	if (pthread_mutex_init(&handler->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Couldn't create signal handler mutex!");
 		bfree(handler);
 		return NULL;
 	}
-	if (pthread_mutex_init(&handler->global_callbacks_mutex, &attr) != 0) {
+	if (!callback_set_init(&handler->global_callbacks)) {
 		blog(LOG_ERROR, "Couldn't create signal handler global "
 				"callbacks mutex!");
 		pthread_mutex_destroy(&handler->mutex);
@@ -163,8 +493,7 @@ static void signal_handler_actually_destroy(signal_handler_t *handler)
 		sig = next;
 	}
 
-	da_free(handler->global_callbacks);
-	pthread_mutex_destroy(&handler->global_callbacks_mutex);
+	callback_set_free(&handler->global_callbacks);
 	pthread_mutex_destroy(&handler->mutex);
 	bfree(handler);
 }
@@ -179,7 +508,7 @@ void signal_handler_destroy(signal_handler_t *handler)
 bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -189,17 +518,27 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
+	sig = getsignal(handler, func.name);
 	if (sig) {
 		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
 		decl_info_free(&func);
 		success = false;
 	} else {
 		sig = signal_info_create(&func);
-		if (!last)
-			handler->first = sig;
-		else
-			last->next = sig;
+		success = sig != NULL;
+	}
+
+	if (success) {
+		struct signal_info **last = &handler->first;
+		struct signal_info **bucket =
+			&handler->buckets[sig->hash % SIGNAL_BUCKETS];
+
+		while (*last)
+			last = &(*last)->next;
+		*last = sig;
+
+		sig->hash_next = *bucket;
+		*bucket = sig;
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -207,22 +546,34 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 	return success;
 }
 
+static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
+						   const char *name)
+{
+	struct signal_info *sig;
+
+	if (!handler)
+		return NULL;
+
+	pthread_mutex_lock(&handler->mutex);
+	sig = getsignal(handler, name);
+	pthread_mutex_unlock(&handler->mutex);
+
+	return sig;
+}
+
 static void signal_handler_connect_internal(signal_handler_t *handler,
 					    const char *signal,
 					    signal_callback_t callback,
 					    void *data, bool keep_ref)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data, false, keep_ref};
-	size_t idx;
+	struct signal_callback cb_data = {callback, NULL, data, keep_ref, NULL};
+	struct signal_info *sig;
+	bool added;
 
 	if (!handler)
 		return;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
-	pthread_mutex_unlock(&handler->mutex);
-
+	sig = getsignal_locked(handler, signal);
 	if (!sig) {
 		blog(LOG_WARNING,
 		     "signal_handler_connect: "
@@ -233,16 +584,10 @@ static void signal_handler_connect_internal(signal_handler_t *handler,
 
 	/* -------------- */
 
-	pthread_mutex_lock(&sig->mutex);
-
 	if (keep_ref)
 		os_atomic_inc_long(&handler->refs);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (keep_ref || idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-
-	pthread_mutex_unlock(&sig->mutex);
+	callback_set_add(&sig->callbacks, &cb_data, keep_ref, &added);
 }
 
 void signal_handler_connect(signal_handler_t *handler, const char *signal,
@@ -257,170 +602,477 @@ void signal_handler_connect_ref(signal_handler_t *handler, const char *signal,
 	signal_handler_connect_internal(handler, signal, callback, data, true);
 }
 
-static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
-						   const char *name)
+static bool dispatcher_start(void);
+
+void signal_handler_connect_deferred(signal_handler_t *handler,
+				     const char *signal,
+				     signal_callback_t callback, void *data,
+				     bool coalesce)
 {
+	struct signal_callback cb_data = {callback, NULL, data, false, NULL};
+	struct deferred_callback *cb;
 	struct signal_info *sig;
+	pthread_mutexattr_t attr;
+	bool added;
 
 	if (!handler)
-		return NULL;
+		return;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
+	sig = getsignal_locked(handler, signal);
+	if (!sig) {
+		blog(LOG_WARNING,
+		     "signal_handler_connect_deferred: "
+		     "signal '%s' not found",
+		     signal);
+		return;
+	}
 
-	return sig;
+	if (!dispatcher_start())
+		return;
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		return;
+
+	cb = bzalloc(sizeof(struct deferred_callback));
+	cb->refs = 1;
+	cb->callback = callback;
+	cb->data = data;
+	cb->coalesce = coalesce;
+	cb->connected = true;
+	pthread_mutex_init(&cb->call_mutex, &attr);
+	pthread_mutex_init(&cb->latest_mutex, NULL);
+	pthread_mutexattr_destroy(&attr);
+
+	cb_data.deferred = cb;
+	callback_set_add(&sig->callbacks, &cb_data, false, &added);
+
+	/* already connected */
+	if (!added)
+		deferred_callback_release(cb);
 }
 
 void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 			       signal_callback_t callback, void *data)
 {
 	struct signal_info *sig = getsignal_locked(handler, signal);
-	bool keep_ref = false;
-	size_t idx;
+	struct signal_callback cb_data = {callback, NULL, data, false, NULL};
+	struct signal_callback removed;
 
 	if (!sig)
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
+	if (!callback_set_remove(&sig->callbacks, &cb_data, &removed))
+		return;
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx != DARRAY_INVALID) {
-		if (sig->signalling) {
-			sig->callbacks.array[idx].remove = true;
+	/* waits for the dispatcher if it's calling the callback right now */
+	if (removed.deferred)
+		deferred_callback_disconnect(removed.deferred);
+
+	if (removed.keep_ref && os_atomic_dec_long(&handler->refs) == 0) {
+		signal_handler_actually_destroy(handler);
+	}
+}
+
+void signal_handler_remove_current(void)
+{
+	if (current_remove)
+		*current_remove = true;
+	else if (current_deferred_cb)
+		current_deferred_cb->remove = true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Deferred dispatch
+ *
+ *   Signals for deferred callbacks are copied into a bounded lock-free queue
+ * (many producers, one consumer) and called from a dispatcher thread, so the
+ * signalling thread never waits on the callback.  If the queue is full, the
+ * signal is dropped for deferred callbacks rather than blocking. */
+
+struct dispatch_event {
+	signal_handler_t *handler;
+	struct signal_info *sig;
+	struct deferred_callback *cb;
+	calldata_t params;
+	uint8_t stack[DISPATCH_EVENT_STACK];
+};
+
+struct dispatch_cell {
+	volatile long seq;
+	struct dispatch_event event;
+};
+
+static struct signal_dispatcher {
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	os_sem_t *sem;
+	bool thread_created;
+	volatile bool active;
+	volatile long producers;
+
+	struct dispatch_cell *cells;
+	volatile long tail;
+	long head;
+
+	volatile long dropped;
+} dispatcher = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static inline long seq_diff(long a, long b)
+{
+	return (long)((unsigned long)a - (unsigned long)b);
+}
+
+static struct dispatch_cell *dispatch_claim(void)
+{
+	long pos = os_atomic_load_long(&dispatcher.tail);
+
+	for (;;) {
+		struct dispatch_cell *cell =
+			&dispatcher.cells[pos & (DISPATCH_QUEUE_SIZE - 1)];
+		long diff = seq_diff(os_atomic_load_long(&cell->seq), pos);
+
+		if (diff == 0) {
+			if (os_atomic_compare_exchange_long(&dispatcher.tail,
+							    &pos, pos + 1))
+				return cell;
+		} else if (diff < 0) {
+			return NULL;
 		} else {
-			keep_ref = sig->callbacks.array[idx].keep_ref;
-			da_erase(sig->callbacks, idx);
+			pos = os_atomic_load_long(&dispatcher.tail);
 		}
 	}
+}
 
-	pthread_mutex_unlock(&sig->mutex);
+static inline void dispatch_publish(struct dispatch_cell *cell)
+{
+	long pos = os_atomic_load_long(&cell->seq);
+	os_atomic_set_long(&cell->seq, pos + 1);
+	os_sem_post(dispatcher.sem);
+}
 
-	if (keep_ref && os_atomic_dec_long(&handler->refs) == 0) {
-		signal_handler_actually_destroy(handler);
+static void copy_calldata(calldata_t *dst, const calldata_t *src)
+{
+	if (dst->capacity < src->size) {
+		if (dst->fixed) {
+			dst->stack = bmalloc(src->size);
+			dst->fixed = false;
+		} else {
+			dst->stack = brealloc(dst->stack, src->size);
+		}
+		dst->capacity = src->size;
 	}
-}
 
-static THREAD_LOCAL struct signal_callback *current_signal_cb = NULL;
-static THREAD_LOCAL struct global_callback_info *current_global_cb = NULL;
+	if (src->size)
+		memcpy(dst->stack, src->stack, src->size);
+	dst->size = src->size;
+}
 
-void signal_handler_remove_current(void)
+static bool queue_coalesced(struct deferred_callback *cb, calldata_t *params)
 {
-	if (current_signal_cb)
-		current_signal_cb->remove = true;
-	else if (current_global_cb)
-		current_global_cb->remove = true;
+	bool queue;
+
+	pthread_mutex_lock(&cb->latest_mutex);
+	copy_calldata(&cb->latest, params);
+	queue = !cb->queued;
+	cb->queued = true;
+	pthread_mutex_unlock(&cb->latest_mutex);
+
+	return queue;
 }
 
-void signal_handler_signal(signal_handler_t *handler, const char *signal,
-			   calldata_t *params)
+static void queue_deferred(signal_handler_t *handler, struct signal_info *sig,
+			   struct deferred_callback *cb, calldata_t *params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
-	long remove_refs = 0;
+	struct dispatch_cell *cell;
+	struct dispatch_event *event;
 
-	if (!sig)
-		return;
+	os_atomic_inc_long(&dispatcher.producers);
 
-	pthread_mutex_lock(&sig->mutex);
-	sig->signalling = true;
+	if (!os_atomic_load_bool(&dispatcher.active))
+		goto finish;
 
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array + i;
-		if (!cb->remove) {
-			current_signal_cb = cb;
-			cb->callback(cb->data, params);
-			current_signal_cb = NULL;
+	/* the parameters are stored in the callback, only queue it once */
+	if (cb->coalesce && !queue_coalesced(cb, params))
+		goto finish;
+
+	cell = dispatch_claim();
+	if (!cell) {
+		if (cb->coalesce) {
+			pthread_mutex_lock(&cb->latest_mutex);
+			cb->queued = false;
+			pthread_mutex_unlock(&cb->latest_mutex);
 		}
+
+		os_atomic_inc_long(&dispatcher.dropped);
+		goto finish;
 	}
 
-	for (size_t i = sig->callbacks.num; i > 0; i--) {
-		struct signal_callback *cb = sig->callbacks.array + i - 1;
-		if (cb->remove) {
-			if (cb->keep_ref)
-				remove_refs++;
+	event = &cell->event;
+	event->handler = handler;
+	event->sig = sig;
+	event->cb = cb;
+	calldata_init_fixed(&event->params, event->stack,
+			    sizeof(event->stack));
 
-			da_erase(sig->callbacks, i - 1);
-		}
+	if (!cb->coalesce)
+		copy_calldata(&event->params, params);
+
+	os_atomic_inc_long(&handler->refs);
+	os_atomic_inc_long(&cb->refs);
+
+	dispatch_publish(cell);
+
+finish:
+	os_atomic_dec_long(&dispatcher.producers);
+}
+
+static void deliver_event(struct dispatch_event *event, calldata_t *scratch)
+{
+	struct deferred_callback *cb = event->cb;
+	calldata_t *params = &event->params;
+
+	if (cb->coalesce) {
+		pthread_mutex_lock(&cb->latest_mutex);
+		copy_calldata(scratch, &cb->latest);
+		cb->queued = false;
+		pthread_mutex_unlock(&cb->latest_mutex);
+
+		params = scratch;
 	}
 
-	sig->signalling = false;
-	pthread_mutex_unlock(&sig->mutex);
+	pthread_mutex_lock(&cb->call_mutex);
 
-	pthread_mutex_lock(&handler->global_callbacks_mutex);
+	if (os_atomic_load_bool(&cb->connected)) {
+		current_deferred_cb = cb;
+		cb->callback(cb->data, params);
+		current_deferred_cb = NULL;
+	}
 
-	if (handler->global_callbacks.num) {
-		for (size_t i = 0; i < handler->global_callbacks.num; i++) {
-			struct global_callback_info *cb =
-				handler->global_callbacks.array + i;
+	pthread_mutex_unlock(&cb->call_mutex);
 
-			if (!cb->remove) {
-				cb->signaling++;
-				current_global_cb = cb;
-				cb->callback(cb->data, signal, params);
-				current_global_cb = NULL;
-				cb->signaling--;
-			}
-		}
+	if (cb->remove) {
+		cb->remove = false;
+		signal_handler_disconnect(event->handler, event->sig->func.name,
+					  cb->callback, cb->data);
+	}
+}
 
-		for (size_t i = handler->global_callbacks.num; i > 0; i--) {
-			struct global_callback_info *cb =
-				handler->global_callbacks.array + (i - 1);
+static void release_event(struct dispatch_event *event)
+{
+	calldata_free(&event->params);
+	deferred_callback_release(event->cb);
+
+	if (os_atomic_dec_long(&event->handler->refs) == 0)
+		signal_handler_actually_destroy(event->handler);
+}
 
-			if (cb->remove && !cb->signaling)
-				da_erase(handler->global_callbacks, i - 1);
+/* returns false once the queue is empty */
+static bool dispatch_next(calldata_t *scratch, bool deliver)
+{
+	struct dispatch_cell *cell =
+		&dispatcher.cells[dispatcher.head & (DISPATCH_QUEUE_SIZE - 1)];
+	long seq = os_atomic_load_long(&cell->seq);
+
+	if (seq_diff(seq, dispatcher.head + 1) < 0)
+		return false;
+
+	if (deliver)
+		deliver_event(&cell->event, scratch);
+	release_event(&cell->event);
+
+	os_atomic_set_long(&cell->seq, dispatcher.head + DISPATCH_QUEUE_SIZE);
+	dispatcher.head++;
+	return true;
+}
+
+static void *dispatch_thread(void *unused)
+{
+	calldata_t scratch;
+
+	os_set_thread_name("signal: dispatcher");
+	calldata_init(&scratch);
+
+	while (os_sem_wait(dispatcher.sem) == 0) {
+		if (!os_atomic_load_bool(&dispatcher.active))
+			break;
+
+		while (dispatch_next(&scratch, true))
+			;
+	}
+
+	calldata_free(&scratch);
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static bool dispatcher_start(void)
+{
+	bool success = true;
+
+	pthread_mutex_lock(&dispatcher.mutex);
+
+	if (!dispatcher.thread_created) {
+		dispatcher.cells = bzalloc(sizeof(struct dispatch_cell) *
+					   DISPATCH_QUEUE_SIZE);
+		for (long i = 0; i < DISPATCH_QUEUE_SIZE; i++)
+			dispatcher.cells[i].seq = i;
+
+		dispatcher.head = 0;
+		dispatcher.tail = 0;
+		dispatcher.dropped = 0;
+		os_atomic_set_bool(&dispatcher.active, true);
+
+		success = os_sem_init(&dispatcher.sem, 0) == 0 &&
+			  pthread_create(&dispatcher.thread, NULL,
+					 dispatch_thread, NULL) == 0;
+		if (success) {
+			dispatcher.thread_created = true;
+		} else {
+			blog(LOG_ERROR, "Failed to start signal dispatcher");
+			os_atomic_set_bool(&dispatcher.active, false);
+			os_sem_destroy(dispatcher.sem);
+			bfree(dispatcher.cells);
+			dispatcher.sem = NULL;
+			dispatcher.cells = NULL;
 		}
 	}
 
-	pthread_mutex_unlock(&handler->global_callbacks_mutex);
+	pthread_mutex_unlock(&dispatcher.mutex);
+	return success;
+}
 
-	if (remove_refs) {
-		os_atomic_set_long(&handler->refs,
-				   os_atomic_load_long(&handler->refs) -
-					   remove_refs);
+void signal_handler_dispatch_shutdown(void)
+{
+	pthread_mutex_lock(&dispatcher.mutex);
+
+	if (dispatcher.thread_created) {
+		long dropped;
+
+		os_atomic_set_bool(&dispatcher.active, false);
+		os_sem_post(dispatcher.sem);
+		pthread_join(dispatcher.thread, NULL);
+
+		/* signals queued at this point are dropped */
+		while (os_atomic_load_long(&dispatcher.producers))
+			os_sleep_ms(1);
+		while (dispatch_next(NULL, false))
+			;
+
+		dropped = os_atomic_load_long(&dispatcher.dropped);
+		if (dropped)
+			blog(LOG_INFO,
+			     "signal dispatcher: %ld signal(s) were dropped "
+			     "because the queue was full",
+			     dropped);
+
+		os_sem_destroy(dispatcher.sem);
+		bfree(dispatcher.cells);
+		dispatcher.sem = NULL;
+		dispatcher.cells = NULL;
+		dispatcher.thread_created = false;
 	}
+
+	pthread_mutex_unlock(&dispatcher.mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void signal_callbacks(signal_handler_t *handler,
+			     struct signal_info *sig, struct callback_set *set,
+			     const char *signal, calldata_t *params)
+{
+	struct signal_frame frame = {NULL, DARRAY_INVALID, current_frame};
+	bool *prev_remove = current_remove;
+	long generation;
+	bool remove;
+
+	frame.list = callback_set_acquire(set, &generation);
+	if (!frame.list)
+		return;
+
+	current_frame = &frame;
+
+	for (size_t i = 0; i < frame.list->num; i++) {
+		struct signal_callback *cb = frame.list->array + i;
+
+		if (!begin_call(set, &frame, i, generation))
+			continue;
+
+		if (cb->deferred) {
+			queue_deferred(handler, sig, cb->deferred, params);
+			end_call(set, &frame);
+			continue;
+		}
+
+		remove = false;
+		current_remove = &remove;
+
+		if (cb->global_callback)
+			cb->global_callback(cb->data, signal, params);
+		else
+			cb->callback(cb->data, params);
+
+		current_remove = prev_remove;
+		end_call(set, &frame);
+
+		if (!remove)
+			continue;
+
+		if (cb->global_callback)
+			signal_handler_disconnect_global(
+				handler, cb->global_callback, cb->data);
+		else
+			signal_handler_disconnect(handler, signal,
+						  cb->callback, cb->data);
+	}
+
+	current_frame = frame.prev;
+	callback_list_release(set, frame.list);
+}
+
+void signal_handler_signal(signal_handler_t *handler, const char *signal,
+			   calldata_t *params)
+{
+	struct signal_info *sig = getsignal_locked(handler, signal);
+
+	if (!sig)
+		return;
+
+	/* keeps the handler alive if a callback disconnects a reference */
+	os_atomic_inc_long(&handler->refs);
+
+	signal_callbacks(handler, sig, &sig->callbacks, signal, params);
+	signal_callbacks(handler, sig, &handler->global_callbacks, signal,
+			 params);
+
+	signal_handler_destroy(handler);
 }
 
 void signal_handler_connect_global(signal_handler_t *handler,
 				   global_signal_callback_t callback,
 				   void *data)
 {
-	struct global_callback_info cb_data = {callback, data, 0, false};
-	size_t idx;
+	struct signal_callback cb_data = {NULL, callback, data, false, NULL};
+	bool added;
 
 	if (!handler || !callback)
 		return;
 
-	pthread_mutex_lock(&handler->global_callbacks_mutex);
-
-	idx = da_find(handler->global_callbacks, &cb_data, 0);
-	if (idx == DARRAY_INVALID)
-		da_push_back(handler->global_callbacks, &cb_data);
-
-	pthread_mutex_unlock(&handler->global_callbacks_mutex);
+	callback_set_add(&handler->global_callbacks, &cb_data, false, &added);
 }
 
 void signal_handler_disconnect_global(signal_handler_t *handler,
 				      global_signal_callback_t callback,
 				      void *data)
 {
-	struct global_callback_info cb_data = {callback, data, false};
-	size_t idx;
+	struct signal_callback cb_data = {NULL, callback, data, false, NULL};
+	struct signal_callback removed;
 
 	if (!handler || !callback)
 		return;
 
-	pthread_mutex_lock(&handler->global_callbacks_mutex);
-
-	idx = da_find(handler->global_callbacks, &cb_data, 0);
-	if (idx != DARRAY_INVALID) {
-		struct global_callback_info *cb =
-			handler->global_callbacks.array + idx;
-
-		if (cb->signaling)
-			cb->remove = true;
-		else
-			da_erase(handler->global_callbacks, idx);
-	}
-
-	pthread_mutex_unlock(&handler->global_callbacks_mutex);
+	callback_set_remove(&handler->global_callbacks, &cb_data, &removed);
 }
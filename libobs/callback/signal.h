@@ -66,6 +66,24 @@ EXPORT void signal_handler_disconnect(signal_handler_t *handler,
 				      const char *signal,
 				      signal_callback_t callback, void *data);
 
+/**
+ * Connects a callback that is called from a separate dispatcher thread
+ * instead of the thread that sends the signal.  The signal's parameters are
+ * copied, so pointer parameters must still be valid when the callback runs.
+ *
+ * If coalesce is true, signals that arrive while one is still waiting to be
+ * delivered replace its parameters, so only the newest one is delivered.
+ * This is meant for high-rate signals such as levels or audio data.
+ */
+EXPORT void signal_handler_connect_deferred(signal_handler_t *handler,
+					    const char *signal,
+					    signal_callback_t callback,
+					    void *data, bool coalesce);
+
+/** Stops the dispatcher thread of deferred callbacks, undelivered signals
+ * are dropped */
+EXPORT void signal_handler_dispatch_shutdown(void);
+
 EXPORT void signal_handler_connect_global(signal_handler_t *handler,
 					  global_signal_callback_t callback,
 					  void *data);
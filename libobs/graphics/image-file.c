@@ -18,6 +18,7 @@
 #include "image-file.h"
 #include "../util/base.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 #include "vec4.h"
 
 #define blog(level, format, ...) \
@@ -71,11 +72,182 @@ static inline void *alloc_mem(gs_image_file_t *image, uint64_t *mem_usage,
 	return bzalloc(size);
 }
 
+/* ------------------------------------------------------------------------- */
+/* streaming gif decoding */
+
+/* the displayed frame plus the frames decoded ahead of it */
+#define GIF_STREAM_FRAMES 4
+
+struct gif_stream {
+	gs_image_file_t *image;
+	enum gs_image_alpha_mode alpha_mode;
+
+	pthread_t thread;
+	bool thread_active;
+	pthread_mutex_t mutex;
+	os_sem_t *sem;
+	volatile bool stop;
+
+	/* frames are identified by their position in the whole playback,
+	 * loop * frame_count + frame, so looping never reorders them */
+	uint8_t *frames;
+	size_t frame_size;
+	int64_t seq[GIF_STREAM_FRAMES];
+	int head;
+	int ready;
+	int64_t next_seq;
+	int64_t end_seq;
+	long generation;
+
+	/* playback position, only used by the playback side */
+	int64_t play_seq;
+	int play_frame;
+};
+
+static inline uint8_t *gif_stream_frame(struct gif_stream *gs, int slot)
+{
+	return gs->frames + (size_t)slot * gs->frame_size;
+}
+
+static void copy_gif_frame(gs_image_file_t *image, uint8_t *dst,
+			   enum gs_image_alpha_mode alpha_mode)
+{
+	const size_t area = (size_t)image->gif.width * image->gif.height;
+	uint8_t *src = image->gif.frame_image;
+
+	if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB)
+		gs_premultiply_xyza_srgb_loop_restrict(dst, src, area);
+	else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY)
+		gs_premultiply_xyza_loop_restrict(dst, src, area);
+	else
+		memcpy(dst, src, area * 4);
+}
+
+/* decodes the next frame into the first free slot after the ready frames,
+ * which the playback side never reads until it's published */
+static bool gif_stream_decode_next(struct gif_stream *gs)
+{
+	gs_image_file_t *image = gs->image;
+	long generation;
+	int64_t seq;
+	int slot;
+	bool full;
+	bool done;
+
+	pthread_mutex_lock(&gs->mutex);
+	full = gs->ready >= GIF_STREAM_FRAMES - 1;
+	done = gs->end_seq && gs->next_seq >= gs->end_seq;
+	slot = (gs->head + gs->ready + 1) % GIF_STREAM_FRAMES;
+	seq = gs->next_seq;
+	generation = gs->generation;
+	pthread_mutex_unlock(&gs->mutex);
+
+	if (full || done || os_atomic_load_bool(&gs->stop))
+		return false;
+
+	/* on failure the previous canvas is used so playback keeps going */
+	gif_decode_frame(&image->gif,
+			 (unsigned int)(seq % image->gif.frame_count));
+	copy_gif_frame(image, gif_stream_frame(gs, slot), gs->alpha_mode);
+
+	pthread_mutex_lock(&gs->mutex);
+	if (generation == gs->generation) {
+		gs->seq[slot] = seq;
+		gs->ready++;
+		gs->next_seq = seq + 1;
+	}
+	pthread_mutex_unlock(&gs->mutex);
+	return true;
+}
+
+static void *gif_stream_thread(void *data)
+{
+	struct gif_stream *gs = data;
+
+	os_set_thread_name("gif stream decoder");
+
+	while (os_sem_wait(gs->sem) == 0) {
+		if (os_atomic_load_bool(&gs->stop))
+			break;
+
+		while (gif_stream_decode_next(gs))
+			;
+	}
+
+	return NULL;
+}
+
+static void gif_stream_destroy(struct gif_stream *gs)
+{
+	if (!gs)
+		return;
+
+	if (gs->thread_active) {
+		os_atomic_set_bool(&gs->stop, true);
+		os_sem_post(gs->sem);
+		pthread_join(gs->thread, NULL);
+	}
+
+	pthread_mutex_destroy(&gs->mutex);
+	os_sem_destroy(gs->sem);
+	bfree(gs->frames);
+	bfree(gs);
+}
+
+/* called with frame 0 already decoded, the decoder thread starts right away
+ * so the first frames are ready by the time playback starts */
+static struct gif_stream *gif_stream_create(gs_image_file_t *image,
+					    uint64_t *mem_usage,
+					    enum gs_image_alpha_mode alpha_mode)
+{
+	struct gif_stream *gs = bzalloc(sizeof(*gs));
+	int loops = image->gif.loop_count;
+
+	if (loops >= 0xFFFF)
+		loops = 0;
+
+	gs->image = image;
+	gs->alpha_mode = alpha_mode;
+	gs->frame_size = (size_t)image->gif.width * image->gif.height * 4;
+	gs->frames = bmalloc(gs->frame_size * GIF_STREAM_FRAMES);
+	gs->next_seq = 1;
+	gs->end_seq = (int64_t)loops * image->gif.frame_count;
+
+	if (mem_usage)
+		*mem_usage += gs->frame_size * GIF_STREAM_FRAMES;
+
+	copy_gif_frame(image, gif_stream_frame(gs, 0), alpha_mode);
+
+	if (pthread_mutex_init(&gs->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&gs->sem, 0) != 0) {
+		pthread_mutex_destroy(&gs->mutex);
+		goto fail;
+	}
+	if (pthread_create(&gs->thread, NULL, gif_stream_thread, gs) != 0) {
+		gif_stream_destroy(gs);
+		return NULL;
+	}
+
+	gs->thread_active = true;
+	os_sem_post(gs->sem);
+	return gs;
+
+fail:
+	bfree(gs->frames);
+	bfree(gs);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static bool init_animated_gif(gs_image_file_t *image, const char *path,
 			      uint64_t *mem_usage,
-			      enum gs_image_alpha_mode alpha_mode)
+			      enum gs_image_alpha_mode alpha_mode,
+			      uint64_t cache_budget, struct gif_stream **stream)
 {
 	bool is_animated_gif = true;
+	bool streamed;
 	gif_result result;
 	uint64_t max_size;
 	size_t size, size_read;
@@ -127,7 +299,11 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path,
 	max_size = (uint64_t)image->gif.width * (uint64_t)image->gif.height *
 		   (uint64_t)image->gif.frame_count * 4LLU;
 
-	if ((uint64_t)get_full_decoded_gif_size(image) != max_size) {
+	/* only a full cache has to fit, streamed gifs use a few frames */
+	streamed = stream && max_size > cache_budget;
+
+	if (!streamed &&
+	    (uint64_t)get_full_decoded_gif_size(image) != max_size) {
 		blog(LOG_WARNING, "Gif '%s' overflowed maximum pointer size",
 		     path);
 		goto fail;
@@ -137,38 +313,53 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path,
 	if (image->is_animated_gif) {
 		gif_decode_frame(&image->gif, 0);
 
-		image->animation_frame_cache =
-			alloc_mem(image, mem_usage,
-				  image->gif.frame_count * sizeof(uint8_t *));
-		image->animation_frame_data = alloc_mem(
-			image, mem_usage, get_full_decoded_gif_size(image));
-
-		for (unsigned int i = 0; i < image->gif.frame_count; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				blog(LOG_WARNING,
-				     "Couldn't decode frame %u "
-				     "of '%s'",
-				     i, path);
-		}
-
-		gif_decode_frame(&image->gif, 0);
-
 		image->cx = (uint32_t)image->gif.width;
 		image->cy = (uint32_t)image->gif.height;
 		image->format = GS_RGBA;
 
+		/* decoder canvas, texture and the file itself */
 		if (mem_usage) {
-			*mem_usage += (size_t)4 * image->cx * image->cy;
+			*mem_usage += (size_t)4 * image->cx * image->cy * 2;
 			*mem_usage += size;
 		}
 
-		if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB) {
-			gs_premultiply_xyza_srgb_loop(image->gif.frame_image,
-						      (size_t)image->cx *
-							      image->cy);
-		} else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY) {
-			gs_premultiply_xyza_loop(image->gif.frame_image,
-						 (size_t)image->cx * image->cy);
+		if (streamed) {
+			*stream = gif_stream_create(image, mem_usage,
+						    alpha_mode);
+			if (!*stream) {
+				blog(LOG_WARNING,
+				     "Failed to start decoding gif '%s'",
+				     path);
+				goto fail;
+			}
+		} else {
+			image->animation_frame_cache = alloc_mem(
+				image, mem_usage,
+				image->gif.frame_count * sizeof(uint8_t *));
+			image->animation_frame_data =
+				alloc_mem(image, mem_usage,
+					  get_full_decoded_gif_size(image));
+
+			for (unsigned int i = 0; i < image->gif.frame_count;
+			     i++) {
+				if (gif_decode_frame(&image->gif, i) != GIF_OK)
+					blog(LOG_WARNING,
+					     "Couldn't decode frame %u "
+					     "of '%s'",
+					     i, path);
+			}
+
+			gif_decode_frame(&image->gif, 0);
+
+			if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB) {
+				gs_premultiply_xyza_srgb_loop(
+					image->gif.frame_image,
+					(size_t)image->cx * image->cy);
+			} else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY) {
+				gs_premultiply_xyza_loop(
+					image->gif.frame_image,
+					(size_t)image->cx * image->cy);
+			}
 		}
 	} else {
 		gif_finalise(&image->gif);
@@ -192,7 +383,9 @@ not_animated:
 
 static void gs_image_file_init_internal(gs_image_file_t *image,
 					const char *file, uint64_t *mem_usage,
-					enum gs_image_alpha_mode alpha_mode)
+					enum gs_image_alpha_mode alpha_mode,
+					uint64_t cache_budget,
+					struct gif_stream **stream)
 {
 	size_t len;
 
@@ -207,7 +400,8 @@ static void gs_image_file_init_internal(gs_image_file_t *image,
 	len = strlen(file);
 
 	if (len > 4 && strcmp(file + len - 4, ".gif") == 0) {
-		if (init_animated_gif(image, file, mem_usage, alpha_mode)) {
+		if (init_animated_gif(image, file, mem_usage, alpha_mode,
+				      cache_budget, stream)) {
 			return;
 		}
 	}
@@ -229,7 +423,8 @@ static void gs_image_file_init_internal(gs_image_file_t *image,
 
 void gs_image_file_init(gs_image_file_t *image, const char *file)
 {
-	gs_image_file_init_internal(image, file, NULL, GS_IMAGE_ALPHA_STRAIGHT);
+	gs_image_file_init_internal(image, file, NULL, GS_IMAGE_ALPHA_STRAIGHT,
+				    UINT64_MAX, NULL);
 }
 
 void gs_image_file_free(gs_image_file_t *image)
@@ -255,17 +450,38 @@ void gs_image_file_free(gs_image_file_t *image)
 void gs_image_file2_init(gs_image_file2_t *if2, const char *file)
 {
 	gs_image_file_init_internal(&if2->image, file, &if2->mem_usage,
-				    GS_IMAGE_ALPHA_STRAIGHT);
+				    GS_IMAGE_ALPHA_STRAIGHT, UINT64_MAX, NULL);
 }
 
 void gs_image_file3_init(gs_image_file3_t *if3, const char *file,
 			 enum gs_image_alpha_mode alpha_mode)
 {
 	gs_image_file_init_internal(&if3->image2.image, file,
-				    &if3->image2.mem_usage, alpha_mode);
+				    &if3->image2.mem_usage, alpha_mode,
+				    UINT64_MAX, NULL);
 	if3->alpha_mode = alpha_mode;
 }
 
+void gs_image_file4_init(gs_image_file4_t *if4, const char *file,
+			 enum gs_image_alpha_mode alpha_mode,
+			 uint64_t gif_cache_budget)
+{
+	if4->gif_stream = NULL;
+	gs_image_file_init_internal(&if4->image3.image2.image, file,
+				    &if4->image3.image2.mem_usage, alpha_mode,
+				    gif_cache_budget, &if4->gif_stream);
+	if4->image3.alpha_mode = alpha_mode;
+	if4->gif_cache_budget = gif_cache_budget;
+}
+
+void gs_image_file4_free(gs_image_file4_t *if4)
+{
+	/* the decoder thread uses the gif, so it has to stop first */
+	gif_stream_destroy(if4->gif_stream);
+	if4->gif_stream = NULL;
+	gs_image_file3_free(&if4->image3);
+}
+
 void gs_image_file_init_texture(gs_image_file_t *image)
 {
 	if (!image->loaded)
@@ -433,3 +649,148 @@ void gs_image_file3_update_texture(gs_image_file3_t *if3)
 	gs_image_file_update_texture_internal(&if3->image2.image,
 					      if3->alpha_mode);
 }
+
+void gs_image_file4_init_texture(gs_image_file4_t *if4)
+{
+	struct gif_stream *gs = if4->gif_stream;
+	gs_image_file_t *image = &if4->image3.image2.image;
+	const uint8_t *data;
+
+	if (!gs) {
+		gs_image_file3_init_texture(&if4->image3);
+		return;
+	}
+
+	/* the displayed frame is never written by the decoder thread */
+	pthread_mutex_lock(&gs->mutex);
+	data = gif_stream_frame(gs, gs->head);
+	pthread_mutex_unlock(&gs->mutex);
+
+	image->texture = gs_texture_create(image->cx, image->cy, image->format,
+					   1, &data, GS_DYNAMIC);
+}
+
+/* playback was moved from outside (usually reset to the first frame), drop
+ * everything decoded so far and keep showing the current frame until the
+ * new one is ready */
+static void gif_stream_restart(gs_image_file_t *image, struct gif_stream *gs)
+{
+	gs->play_seq = (int64_t)image->cur_loop * image->gif.frame_count +
+		       image->cur_frame;
+	gs->play_frame = image->cur_frame;
+
+	pthread_mutex_lock(&gs->mutex);
+	gs->generation++;
+	gs->seq[gs->head] = -1;
+	gs->ready = 0;
+	gs->next_seq = gs->play_seq;
+	pthread_mutex_unlock(&gs->mutex);
+
+	os_sem_post(gs->sem);
+}
+
+/* moves to the newest decoded frame that isn't ahead of playback.  if the
+ * decoder falls behind the last frame stays up until it catches up. */
+static bool gif_stream_advance(struct gif_stream *gs)
+{
+	int64_t target = gs->play_seq;
+	bool advanced = false;
+
+	if (gs->end_seq && target >= gs->end_seq)
+		target = gs->end_seq - 1;
+
+	pthread_mutex_lock(&gs->mutex);
+
+	while (gs->ready) {
+		int next = (gs->head + 1) % GIF_STREAM_FRAMES;
+		if (gs->seq[next] > target)
+			break;
+
+		gs->head = next;
+		gs->ready--;
+		advanced = true;
+	}
+
+	pthread_mutex_unlock(&gs->mutex);
+
+	if (advanced)
+		os_sem_post(gs->sem);
+	return advanced;
+}
+
+bool gs_image_file4_tick(gs_image_file4_t *if4, uint64_t elapsed_time_ns)
+{
+	struct gif_stream *gs = if4->gif_stream;
+	gs_image_file_t *image = &if4->image3.image2.image;
+	int frame_count;
+	int loops;
+
+	if (!gs)
+		return gs_image_file3_tick(&if4->image3, elapsed_time_ns);
+	if (!image->loaded)
+		return false;
+
+	if (image->cur_frame != gs->play_frame) {
+		gif_stream_restart(image, gs);
+		return true;
+	}
+
+	loops = image->gif.loop_count;
+	if (loops >= 0xFFFF)
+		loops = 0;
+
+	/* cur_loop only counts finite loops, so whole loops skipped in one
+	 * tick are lost, which looks the same */
+	if (!loops || image->cur_loop < loops) {
+		frame_count = (int)image->gif.frame_count;
+		image->cur_frame =
+			calculate_new_frame(image, elapsed_time_ns, loops);
+		gs->play_seq += (image->cur_frame - gs->play_frame +
+				 frame_count) %
+				frame_count;
+		gs->play_frame = image->cur_frame;
+	}
+
+	return gif_stream_advance(gs);
+}
+
+/* moving playback back to the first frame of the first loop can't be told
+ * apart from reaching the first frame of a later loop by looking at the
+ * frame alone, so it has to be done here */
+void gs_image_file4_reset(gs_image_file4_t *if4)
+{
+	struct gif_stream *gs = if4->gif_stream;
+	gs_image_file_t *image = &if4->image3.image2.image;
+
+	image->cur_frame = 0;
+	image->cur_loop = 0;
+	image->cur_time = 0;
+
+	if (gs && image->loaded)
+		gif_stream_restart(image, gs);
+}
+
+void gs_image_file4_update_texture(gs_image_file4_t *if4)
+{
+	struct gif_stream *gs = if4->gif_stream;
+	gs_image_file_t *image = &if4->image3.image2.image;
+	const uint8_t *data;
+
+	if (!gs) {
+		gs_image_file3_update_texture(&if4->image3);
+		return;
+	}
+	if (!image->loaded)
+		return;
+
+	if (image->cur_frame != gs->play_frame)
+		gif_stream_restart(image, gs);
+	gif_stream_advance(gs);
+
+	pthread_mutex_lock(&gs->mutex);
+	data = gif_stream_frame(gs, gs->head);
+	pthread_mutex_unlock(&gs->mutex);
+
+	gs_texture_set_image(image->texture, data, image->gif.width * 4,
+			     false);
+}
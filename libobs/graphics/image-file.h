@@ -56,9 +56,21 @@ struct gs_image_file3 {
 	enum gs_image_alpha_mode alpha_mode;
 };
 
+struct gif_stream;
+
+struct gs_image_file4 {
+	struct gs_image_file3 image3;
+
+	/* animated gifs that would take more memory than this once fully
+	 * decoded are decoded ahead of playback into a few frames instead */
+	uint64_t gif_cache_budget;
+	struct gif_stream *gif_stream;
+};
+
 typedef struct gs_image_file gs_image_file_t;
 typedef struct gs_image_file2 gs_image_file2_t;
 typedef struct gs_image_file3 gs_image_file3_t;
+typedef struct gs_image_file4 gs_image_file4_t;
 
 EXPORT void gs_image_file_init(gs_image_file_t *image, const char *file);
 EXPORT void gs_image_file_free(gs_image_file_t *image);
@@ -81,6 +93,17 @@ EXPORT bool gs_image_file3_tick(gs_image_file3_t *if3,
 				uint64_t elapsed_time_ns);
 EXPORT void gs_image_file3_update_texture(gs_image_file3_t *if3);
 
+EXPORT void gs_image_file4_init(gs_image_file4_t *if4, const char *file,
+				enum gs_image_alpha_mode alpha_mode,
+				uint64_t gif_cache_budget);
+EXPORT void gs_image_file4_free(gs_image_file4_t *if4);
+
+EXPORT void gs_image_file4_init_texture(gs_image_file4_t *if4);
+EXPORT bool gs_image_file4_tick(gs_image_file4_t *if4,
+				uint64_t elapsed_time_ns);
+EXPORT void gs_image_file4_update_texture(gs_image_file4_t *if4);
+EXPORT void gs_image_file4_reset(gs_image_file4_t *if4);
+
 static void gs_image_file2_free(gs_image_file2_t *if2)
 {
 	gs_image_file_free(&if2->image);
@@ -71,6 +71,8 @@ struct audio_output {
 	void *input_param;
 	pthread_mutex_t input_mutex;
 	struct audio_mix mixes[NUM_RENDERING_MODES][MAX_AUDIO_MIXES];
+
+	volatile long shared_mixes;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -101,7 +103,8 @@ static bool resample_audio_output(struct audio_input *input,
 }
 
 static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
-				   uint64_t timestamp, uint32_t frames)
+				   uint64_t timestamp, uint32_t frames,
+				   bool shared)
 {
 	struct audio_mix *main_mix = &audio->mixes[OBS_MAIN_AUDIO_RENDERING][mix_idx];
 	struct audio_data main_data;
@@ -142,7 +145,14 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
 		recording_data.frames = frames;
 		recording_data.timestamp = timestamp;
 
-		if (get_cached_multiple_rendering()) {
+		if (get_cached_multiple_rendering() && shared) {
+			if (resample_audio_output(streaming_input,
+						  &streaming_data)) {
+				streaming_input->callback(
+					streaming_input->param, mix_idx,
+					&streaming_data, &streaming_data);
+			}
+		} else if (get_cached_multiple_rendering()) {
 			if (resample_audio_output(streaming_input,
 						  &streaming_data) &&
 			    resample_audio_output(recording_input,
@@ -165,7 +175,8 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes,
+				      uint32_t shared_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 	enum obs_audio_rendering_mode start =
@@ -184,6 +195,11 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 			if (!mix->inputs.num)
 				continue;
 
+			/* shared mixes are only in the streaming buffer */
+			if (mode == OBS_RECORDING_AUDIO_RENDERING &&
+			    (shared_mixes & (1 << mix_idx)) != 0)
+				continue;
+
 			for (size_t plane = 0; plane < audio->planes; plane++) {
 				float *mix_data = mix->buffer[plane];
 				float *mix_end = &mix_data[float_size];
@@ -197,7 +213,32 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 			}
 		}
 	}
+}
+
+/* the input callback points the recording data of a mix at the streaming
+ * buffer when both modes would come out identical, so the mix has only been
+ * computed once and both outputs get the same data */
+static uint32_t get_shared_mixes(struct audio_output *audio,
+				 struct audio_output_data *streaming,
+				 struct audio_output_data *recording)
+{
+	uint32_t shared_mixes = 0;
+
+	if (!get_cached_multiple_rendering())
+		return 0;
 
+	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
+		if (recording[mix_idx].data[0] != streaming[mix_idx].data[0])
+			continue;
+
+		shared_mixes |= (1 << mix_idx);
+
+		if (audio->mixes[OBS_STREAMING_AUDIO_RENDERING][mix_idx]
+			    .inputs.num)
+			os_atomic_inc_long(&audio->shared_mixes);
+	}
+
+	return shared_mixes;
 }
 
 static void input_and_output(struct audio_output *audio, uint64_t audio_time,
@@ -206,6 +247,7 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 	size_t bytes = AUDIO_OUTPUT_FRAMES * audio->block_size;
 	struct audio_output_data data[NUM_RENDERING_MODES][MAX_AUDIO_MIXES];
 	uint32_t active_mixes = 0;
+	uint32_t shared_mixes;
 	uint64_t new_ts = 0;
 	bool success;
 
@@ -257,12 +299,17 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 	if (!success)
 		return;
 
+	shared_mixes = get_shared_mixes(audio,
+					data[OBS_STREAMING_AUDIO_RENDERING],
+					data[OBS_RECORDING_AUDIO_RENDERING]);
+
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, shared_mixes);
 
 	/* output */
 	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES,
+				(shared_mixes & (1 << i)) != 0);
 }
 
 static void *audio_thread(void *param)
@@ -530,6 +577,11 @@ const struct audio_output_info *audio_output_get_info(const audio_t *audio)
 	return audio ? &audio->info : NULL;
 }
 
+uint32_t audio_output_get_shared_mixes(const audio_t *audio)
+{
+	return audio ? (uint32_t)os_atomic_load_long(&audio->shared_mixes) : 0;
+}
+
 bool audio_output_active(const audio_t *audio)
 {
 	if (!audio)
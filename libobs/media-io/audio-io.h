@@ -85,6 +85,9 @@ struct audio_output_data {
 	float *data[MAX_AUDIO_CHANNELS];
 };
 
+/* in multiple rendering mode, the callback may set the recording data of a
+ * mix to the streaming data pointers to mark that the mix is identical for
+ * both modes and has only been written to the streaming buffer */
 typedef bool (*audio_input_callback_t)(void *param, uint64_t start_ts,
 				       uint64_t end_ts, uint64_t *new_ts,
 				       uint32_t active_mixers,
@@ -232,6 +235,10 @@ EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
 EXPORT const struct audio_output_info *
 audio_output_get_info(const audio_t *audio);
 
+/** Number of active mixes that were computed once and shared between the
+ * streaming and recording outputs */
+EXPORT uint32_t audio_output_get_shared_mixes(const audio_t *audio);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/c99defs.h"
+#include "../util/sse-intrin.h"
 #include <math.h>
 
 #ifdef _MSC_VER
@@ -38,6 +39,95 @@ static inline float db_to_mul(const float db)
 	return isfinite((double)db) ? powf(10.0f, db / 20.0f) : 0.0f;
 }
 
+/* adds count samples of src into dst (dst[i] += src[i]).  the result is
+ * bit-identical to the scalar loop, only the loads/stores are batched */
+static inline void mix_float_samples(float *dst, const float *src,
+				     size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128 d0 = _mm_loadu_ps(dst + i);
+		__m128 d1 = _mm_loadu_ps(dst + i + 4);
+		__m128 d2 = _mm_loadu_ps(dst + i + 8);
+		__m128 d3 = _mm_loadu_ps(dst + i + 12);
+
+		d0 = _mm_add_ps(d0, _mm_loadu_ps(src + i));
+		d1 = _mm_add_ps(d1, _mm_loadu_ps(src + i + 4));
+		d2 = _mm_add_ps(d2, _mm_loadu_ps(src + i + 8));
+		d3 = _mm_add_ps(d3, _mm_loadu_ps(src + i + 12));
+
+		_mm_storeu_ps(dst + i, d0);
+		_mm_storeu_ps(dst + i + 4, d1);
+		_mm_storeu_ps(dst + i + 8, d2);
+		_mm_storeu_ps(dst + i + 12, d3);
+	}
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+						  _mm_loadu_ps(src + i)));
+
+	for (; i < count; i++)
+		dst[i] += src[i];
+}
+
+/* dst[i] = src[i] * vol for count samples, dst may be the same as src.
+ * bit-identical to the scalar loop, like mix_float_samples */
+static inline void scale_float_samples(float *dst, const float *src, float vol,
+				       size_t count)
+{
+	const __m128 v = _mm_set1_ps(vol);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128 s0 = _mm_mul_ps(_mm_loadu_ps(src + i), v);
+		__m128 s1 = _mm_mul_ps(_mm_loadu_ps(src + i + 4), v);
+		__m128 s2 = _mm_mul_ps(_mm_loadu_ps(src + i + 8), v);
+		__m128 s3 = _mm_mul_ps(_mm_loadu_ps(src + i + 12), v);
+
+		_mm_storeu_ps(dst + i, s0);
+		_mm_storeu_ps(dst + i + 4, s1);
+		_mm_storeu_ps(dst + i + 8, s2);
+		_mm_storeu_ps(dst + i + 12, s3);
+	}
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), v));
+
+	for (; i < count; i++)
+		dst[i] = src[i] * vol;
+}
+
+/* dst[i] = src[i] * vol[i] for count samples, dst may be the same as src */
+static inline void scale_float_samples_ramp(float *dst, const float *src,
+					    const float *vol, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128 s0 = _mm_mul_ps(_mm_loadu_ps(src + i),
+				       _mm_loadu_ps(vol + i));
+		__m128 s1 = _mm_mul_ps(_mm_loadu_ps(src + i + 4),
+				       _mm_loadu_ps(vol + i + 4));
+		__m128 s2 = _mm_mul_ps(_mm_loadu_ps(src + i + 8),
+				       _mm_loadu_ps(vol + i + 8));
+		__m128 s3 = _mm_mul_ps(_mm_loadu_ps(src + i + 12),
+				       _mm_loadu_ps(vol + i + 12));
+
+		_mm_storeu_ps(dst + i, s0);
+		_mm_storeu_ps(dst + i + 4, s1);
+		_mm_storeu_ps(dst + i + 8, s2);
+		_mm_storeu_ps(dst + i + 12, s3);
+	}
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i),
+						  _mm_loadu_ps(vol + i)));
+
+	for (; i < count; i++)
+		dst[i] = src[i] * vol[i];
+}
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
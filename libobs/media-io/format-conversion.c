@@ -200,6 +200,50 @@ void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize,
 	}
 }
 
+/* builds 16 packed 444 pixels from 16 luma values and the 8 chroma pairs
+ * they share.  each chroma pair is a 16-bit value that ends up in the low
+ * bytes of its two pixels: [chroma lo][chroma hi][lum][0] */
+static FORCE_INLINE void pack_lum_chroma_lo(uint32_t *out, __m128i lum,
+					    __m128i chroma)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lum_lo = _mm_unpacklo_epi8(lum, zero);
+	__m128i lum_hi = _mm_unpackhi_epi8(lum, zero);
+	__m128i ch_lo = _mm_unpacklo_epi16(chroma, chroma);
+	__m128i ch_hi = _mm_unpackhi_epi16(chroma, chroma);
+	__m128i *dst = (__m128i *)out;
+
+	_mm_storeu_si128(dst, _mm_unpacklo_epi16(ch_lo, lum_lo));
+	_mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(ch_lo, lum_lo));
+	_mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(ch_hi, lum_hi));
+	_mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(ch_hi, lum_hi));
+}
+
+/* same, but with the luma value in the lowest byte and the chroma pair in
+ * the middle two: [lum][chroma lo][chroma hi][0] */
+static FORCE_INLINE void pack_lum_chroma_mid(uint32_t *out, __m128i lum,
+					     __m128i chroma)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lum_lo = _mm_unpacklo_epi8(lum, zero);
+	__m128i lum_hi = _mm_unpackhi_epi8(lum, zero);
+	__m128i ch_lo = _mm_slli_epi32(_mm_unpacklo_epi16(chroma, zero), 8);
+	__m128i ch_hi = _mm_slli_epi32(_mm_unpackhi_epi16(chroma, zero), 8);
+	__m128i *dst = (__m128i *)out;
+
+	_mm_storeu_si128(dst, _mm_or_si128(_mm_unpacklo_epi16(lum_lo, zero),
+					   _mm_unpacklo_epi32(ch_lo, ch_lo)));
+	_mm_storeu_si128(dst + 1,
+			 _mm_or_si128(_mm_unpackhi_epi16(lum_lo, zero),
+				      _mm_unpackhi_epi32(ch_lo, ch_lo)));
+	_mm_storeu_si128(dst + 2,
+			 _mm_or_si128(_mm_unpacklo_epi16(lum_hi, zero),
+				      _mm_unpacklo_epi32(ch_hi, ch_hi)));
+	_mm_storeu_si128(dst + 3,
+			 _mm_or_si128(_mm_unpackhi_epi16(lum_hi, zero),
+				      _mm_unpackhi_epi32(ch_hi, ch_hi)));
+}
+
 void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize)
@@ -214,14 +258,34 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
 		register const uint8_t *lum0, *lum1;
 		register uint32_t *output0, *output1;
-		uint32_t x;
+		uint32_t x = 0;
 
 		lum0 = input[0] + y * 2 * in_linesize[0];
 		lum1 = lum0 + in_linesize[0];
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+		/* 16 pixels of both lines at a time */
+		for (; x + 8 <= width_d2; x += 8) {
+			__m128i u = _mm_loadl_epi64((const __m128i *)chroma0);
+			__m128i v = _mm_loadl_epi64((const __m128i *)chroma1);
+			__m128i vu = _mm_unpacklo_epi8(v, u);
+
+			__m128i l0 = _mm_loadu_si128((const __m128i *)lum0);
+			__m128i l1 = _mm_loadu_si128((const __m128i *)lum1);
+
+			pack_lum_chroma_lo(output0, l0, vu);
+			pack_lum_chroma_lo(output1, l1, vu);
+
+			chroma0 += 8;
+			chroma1 += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
 			uint32_t out;
 			out = (*(chroma0++) << 8) | *(chroma1++);
 
@@ -247,7 +311,7 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		const uint16_t *chroma;
 		register const uint8_t *lum0, *lum1;
 		register uint32_t *output0, *output1;
-		uint32_t x;
+		uint32_t x = 0;
 
 		chroma = (const uint16_t *)(input[1] + y * in_linesize[1]);
 		lum0 = input[0] + y * 2 * in_linesize[0];
@@ -255,7 +319,24 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+		/* 16 pixels of both lines at a time */
+		for (; x + 8 <= width_d2; x += 8) {
+			__m128i uv = _mm_loadu_si128((const __m128i *)chroma);
+
+			__m128i l0 = _mm_loadu_si128((const __m128i *)lum0);
+			__m128i l1 = _mm_loadu_si128((const __m128i *)lum1);
+
+			pack_lum_chroma_mid(output0, l0, uv);
+			pack_lum_chroma_mid(output1, l1, uv);
+
+			chroma += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
 			uint32_t out = *(chroma++) << 8;
 
 			*(output0++) = *(lum0++) | out;
@@ -267,52 +348,68 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 	}
 }
 
+/* every packed 422 dword (two pixels) becomes two 444 pixels: the first is
+ * the dword as-is, and the second has the first luma replaced by the second
+ * one, which is always 16 bits above it */
+static FORCE_INLINE void decompress_422_line(const uint32_t *input32,
+					     uint32_t width_d2,
+					     uint32_t *output32,
+					     bool leading_lum)
+{
+	const uint32_t lum_mask = leading_lum ? 0x000000FF : 0x0000FF00;
+	const __m128i odd_mask = _mm_set_epi32(-1, 0, -1, 0);
+	const __m128i lum_mask_v = _mm_set1_epi32((int)lum_mask);
+	uint32_t x = 0;
+
+	for (; x + 4 <= width_d2; x += 4) {
+		__m128i dw = _mm_loadu_si128((const __m128i *)(input32 + x));
+		__m128i second = _mm_or_si128(
+			_mm_andnot_si128(lum_mask_v, dw),
+			_mm_and_si128(_mm_srli_epi32(dw, 16), lum_mask_v));
+		__m128i *dst = (__m128i *)(output32 + x * 2);
+
+		_mm_storeu_si128(
+			dst, _mm_or_si128(
+				     _mm_andnot_si128(odd_mask,
+						      _mm_unpacklo_epi32(dw, dw)),
+				     _mm_and_si128(odd_mask,
+						   _mm_unpacklo_epi32(second,
+								      second))));
+		_mm_storeu_si128(
+			dst + 1,
+			_mm_or_si128(
+				_mm_andnot_si128(odd_mask,
+						 _mm_unpackhi_epi32(dw, dw)),
+				_mm_and_si128(odd_mask,
+					      _mm_unpackhi_epi32(second,
+								 second))));
+	}
+
+	for (; x < width_d2; x++) {
+		register uint32_t dw = input32[x];
+
+		output32[x * 2] = dw;
+		output32[x * 2 + 1] = (dw & ~lum_mask) | ((dw >> 16) & lum_mask);
+	}
+}
+
 void decompress_422(const uint8_t *input, uint32_t in_linesize,
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize, bool leading_lum)
 {
-	uint32_t width_d2 = min_uint32(in_linesize, out_linesize) / 2;
+	/* each input dword is two pixels, which take up 8 bytes of output */
+	uint32_t width_d2 = min_uint32(in_linesize / 4, out_linesize / 8);
 	uint32_t y;
 
-	register const uint32_t *input32;
-	register const uint32_t *input32_end;
-	register uint32_t *output32;
-
-	if (leading_lum) {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32 =
+			(const uint32_t *)(input + y * in_linesize);
+		uint32_t *output32 = (uint32_t *)(output + y * out_linesize);
 
-				output32[0] = dw;
-				dw &= 0xFFFFFF00;
-				dw |= (uint8_t)(dw >> 16);
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
-	} else {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
-
-				output32[0] = dw;
-				dw &= 0xFFFF00FF;
-				dw |= (dw >> 16) & 0xFF00;
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
+		/* separate calls so each one gets its own inlined copy */
+		if (leading_lum)
+			decompress_422_line(input32, width_d2, output32, true);
+		else
+			decompress_422_line(input32, width_d2, output32, false);
 	}
 }
@@ -32,32 +32,71 @@
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
+/* scaled frames a scaler keeps before reusing the least recently used one
+ * that no input is holding */
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
+/* frames waiting for an input's thread in fan-out mode.  kept small so that
+ * a slow input can't hold on to most of the frame cache */
+#define MAX_QUEUED_FRAMES 2
+
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
 };
 
-struct video_input {
+struct queued_frame {
+	size_t idx;
+	struct video_data streaming_frame;
+	struct video_data recording_frame;
+};
+
+struct scaled_frame {
+	struct video_frame frame;
+	long refs;
+	uint64_t last_used;
+
+	/* the output frame it was scaled from */
+	const uint8_t *source;
+	uint64_t timestamp;
+};
+
+/* inputs asking for the same conversion share a scaler, each frame is scaled
+ * once and handed to every one of them */
+struct shared_scaler {
 	struct video_scale_info conversion;
 	video_scaler_t *scaler;
-	struct video_frame frame[MAX_CONVERT_BUFFERS];
-	int cur_frame;
+	long refs;
+
+	pthread_mutex_t mutex;
+	DARRAY(struct scaled_frame *) frames;
+	uint64_t use_count;
+};
+
+struct video_input {
+	struct video_scale_info conversion;
+	struct shared_scaler *scaler;
 
 	void (*callback)(void *param, struct video_data *streaming_frame,
 			 struct video_data *recording_frame);
 	void *param;
-};
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+	volatile long skipped_frames;
+	volatile long total_frames;
+
+	/* fan-out mode only */
+	struct video_output *video;
+	pthread_t thread;
+	bool thread_active;
+	volatile bool stop;
+	os_sem_t *queue_sem;
+	pthread_mutex_t queue_mutex;
+	struct queued_frame queue[MAX_QUEUED_FRAMES];
+	size_t queue_start;
+	size_t queue_num;
+};
 
 struct video_output {
 	struct video_output_info info;
@@ -74,95 +113,508 @@ struct video_output {
 	bool initialized;
 
 	pthread_mutex_t input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input *) inputs;
+	DARRAY(struct shared_scaler *) scalers;
+	bool fanout;
+
+	/* inputs that disconnected from within their own callback are freed
+	 * by their thread, closing waits for them.  protected by data_mutex */
+	long detached_inputs;
+	os_event_t *detached_event;
 
 	size_t available_frames;
-	size_t first_added;
+	size_t locked_frame;
 	size_t last_added;
 	struct cached_frame_info caches[NUM_RENDERING_MODES][MAX_CACHE_SIZE];
 	struct cached_frame_info streaming_cache[MAX_CACHE_SIZE];
 	struct cached_frame_info recording_cache[MAX_CACHE_SIZE];
 
+	/* cache entries waiting to be output, oldest first.  an entry is only
+	 * reused once it's been output and every input that got it released
+	 * it, which in fan-out mode can happen in any order */
+	size_t output_queue[MAX_CACHE_SIZE];
+	size_t first_queued;
+	size_t num_queued;
+	bool cache_used[MAX_CACHE_SIZE];
+	bool cache_output[MAX_CACHE_SIZE];
+	long cache_refs[MAX_CACHE_SIZE];
+	int lost_frames;
+
 	volatile bool raw_active;
 	volatile long gpu_refs;
 };
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
-				      struct video_data *data)
+static inline bool same_conversion(const struct video_scale_info *a,
+				   const struct video_scale_info *b)
 {
-	bool success = true;
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
 
-	if (input->scaler) {
-		struct video_frame *frame;
+/* must be called with input_mutex locked */
+static struct shared_scaler *get_shared_scaler(struct video_output *video,
+					       const struct video_scale_info *to)
+{
+	struct video_scale_info from = {.format = video->info.format,
+					.width = video->info.width,
+					.height = video->info.height,
+					.range = video->info.range,
+					.colorspace = video->info.colorspace};
+	struct shared_scaler *scaler;
+	int ret;
+
+	for (size_t i = 0; i < video->scalers.num; i++) {
+		scaler = video->scalers.array[i];
+
+		if (same_conversion(&scaler->conversion, to)) {
+			scaler->refs++;
+			return scaler;
+		}
+	}
+
+	scaler = bzalloc(sizeof(struct shared_scaler));
+	scaler->conversion = *to;
+	scaler->refs = 1;
+
+	ret = video_scaler_create(&scaler->scaler, to, &from,
+				  VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		bfree(scaler);
+		return NULL;
+	}
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	pthread_mutex_init(&scaler->mutex, NULL);
+	da_push_back(video->scalers, &scaler);
+	return scaler;
+}
 
-		frame = &input->frame[input->cur_frame];
+static void release_shared_scaler(struct video_output *video,
+				  struct shared_scaler *scaler)
+{
+	bool destroy;
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+	if (!scaler)
+		return;
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i] = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
+	pthread_mutex_lock(&video->input_mutex);
+	destroy = --scaler->refs == 0;
+	if (destroy)
+		da_erase_item(video->scalers, &scaler);
+	pthread_mutex_unlock(&video->input_mutex);
+
+	if (!destroy)
+		return;
+
+	for (size_t i = 0; i < scaler->frames.num; i++) {
+		video_frame_free(&scaler->frames.array[i]->frame);
+		bfree(scaler->frames.array[i]);
+	}
+
+	da_free(scaler->frames);
+	video_scaler_destroy(scaler->scaler);
+	pthread_mutex_destroy(&scaler->mutex);
+	bfree(scaler);
+}
+
+static struct scaled_frame *get_unused_frame(struct shared_scaler *scaler)
+{
+	struct scaled_frame *frame = NULL;
+
+	if (scaler->frames.num >= MAX_CONVERT_BUFFERS) {
+		for (size_t i = 0; i < scaler->frames.num; i++) {
+			struct scaled_frame *cur = scaler->frames.array[i];
+
+			if (!cur->refs &&
+			    (!frame || cur->last_used < frame->last_used))
+				frame = cur;
+		}
+	}
+
+	if (!frame) {
+		frame = bzalloc(sizeof(struct scaled_frame));
+		video_frame_init(&frame->frame, scaler->conversion.format,
+				 scaler->conversion.width,
+				 scaler->conversion.height);
+		da_push_back(scaler->frames, &frame);
+	}
+
+	return frame;
+}
+
+/* returns the scaled version of a frame, scaling it only if no other input
+ * did already.  the frame is held until it's released */
+static struct scaled_frame *scale_shared_frame(struct shared_scaler *scaler,
+					       const struct video_data *data)
+{
+	struct scaled_frame *frame = NULL;
+
+	pthread_mutex_lock(&scaler->mutex);
+
+	for (size_t i = 0; i < scaler->frames.num; i++) {
+		struct scaled_frame *cur = scaler->frames.array[i];
+
+		if (cur->source == data->data[0] &&
+		    cur->timestamp == data->timestamp) {
+			frame = cur;
+			break;
+		}
+	}
+
+	if (!frame) {
+		frame = get_unused_frame(scaler);
+
+		if (video_scaler_scale(scaler->scaler, frame->frame.data,
+				       frame->frame.linesize,
+				       (const uint8_t *const *)data->data,
+				       data->linesize)) {
+			frame->source = data->data[0];
+			frame->timestamp = data->timestamp;
 		} else {
-			blog(LOG_WARNING, "video-io: Could not scale frame!");
+			frame->source = NULL;
+			frame = NULL;
+		}
+	}
+
+	if (frame) {
+		frame->refs++;
+		frame->last_used = ++scaler->use_count;
+	}
+
+	pthread_mutex_unlock(&scaler->mutex);
+	return frame;
+}
+
+static void release_scaled_frame(struct shared_scaler *scaler,
+				 struct scaled_frame *frame)
+{
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&scaler->mutex);
+	frame->refs--;
+	pthread_mutex_unlock(&scaler->mutex);
+}
+
+static inline void video_input_free(struct video_input *input)
+{
+	release_shared_scaler(input->video, input->scaler);
+	bfree(input);
+}
+
+static inline bool scale_video_output(struct video_input *input,
+				      struct video_data *data,
+				      struct scaled_frame **scaled)
+{
+	if (!input->scaler)
+		return true;
+
+	*scaled = scale_shared_frame(input->scaler, data);
+	if (!*scaled) {
+		blog(LOG_WARNING, "video-io: Could not scale frame!");
+		return false;
+	}
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		data->data[i] = (*scaled)->frame.data[i];
+		data->linesize[i] = (*scaled)->frame.linesize[i];
+	}
+
+	return true;
+}
+
+static void output_input_frame(struct video_input *input,
+			       struct video_data *streaming_frame,
+			       struct video_data *recording_frame)
+{
+	struct scaled_frame *streaming_scaled = NULL;
+	struct scaled_frame *recording_scaled = NULL;
+
+	if (!obs_get_multiple_rendering()) {
+		if (scale_video_output(input, streaming_frame,
+				       &streaming_scaled))
+			input->callback(input->param, streaming_frame,
+					streaming_frame);
+	} else {
+		if (scale_video_output(input, streaming_frame,
+				       &streaming_scaled) &&
+		    scale_video_output(input, recording_frame,
+				       &recording_scaled)) {
+			input->callback(input->param, streaming_frame,
+					recording_frame);
 		}
 	}
 
+	release_scaled_frame(input->scaler, streaming_scaled);
+	release_scaled_frame(input->scaler, recording_scaled);
+}
+
+static inline void hold_frame(struct video_output *video, size_t idx)
+{
+	pthread_mutex_lock(&video->data_mutex);
+	video->cache_refs[idx]++;
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+static void release_frame(struct video_output *video, size_t idx)
+{
+	pthread_mutex_lock(&video->data_mutex);
+
+	if (--video->cache_refs[idx] == 0 && video->cache_output[idx]) {
+		video->cache_output[idx] = false;
+		video->cache_used[idx] = false;
+		video->available_frames++;
+	}
+
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+static void queue_input_frame(struct video_output *video,
+			      struct video_input *input, size_t idx,
+			      const struct video_data *streaming_frame,
+			      const struct video_data *recording_frame)
+{
+	bool queued = false;
+
+	pthread_mutex_lock(&input->queue_mutex);
+
+	if (input->queue_num < MAX_QUEUED_FRAMES) {
+		size_t pos = (input->queue_start + input->queue_num) %
+			     MAX_QUEUED_FRAMES;
+		struct queued_frame *qf = &input->queue[pos];
+
+		qf->idx = idx;
+		qf->streaming_frame = *streaming_frame;
+		qf->recording_frame = *recording_frame;
+		input->queue_num++;
+		queued = true;
+
+		hold_frame(video, idx);
+	}
+
+	pthread_mutex_unlock(&input->queue_mutex);
+
+	if (queued)
+		os_sem_post(input->queue_sem);
+	else
+		os_atomic_inc_long(&input->skipped_frames);
+}
+
+static bool pop_input_frame(struct video_input *input, struct queued_frame *qf)
+{
+	bool success = false;
+
+	pthread_mutex_lock(&input->queue_mutex);
+
+	if (input->queue_num) {
+		*qf = input->queue[input->queue_start];
+		input->queue_start = (input->queue_start + 1) %
+				     MAX_QUEUED_FRAMES;
+		input->queue_num--;
+		success = true;
+	}
+
+	pthread_mutex_unlock(&input->queue_mutex);
 	return success;
 }
 
+static void stop_input_thread(struct video_input *input);
+
+static void input_thread_detached(struct video_output *video)
+{
+	pthread_mutex_lock(&video->data_mutex);
+	if (--video->detached_inputs == 0)
+		os_event_signal(video->detached_event);
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+static void *input_thread(void *param)
+{
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+	struct queued_frame qf;
+
+	os_set_thread_name("video-io: input thread");
+
+	while (os_sem_wait(input->queue_sem) == 0) {
+		if (os_atomic_load_bool(&input->stop))
+			break;
+		if (!pop_input_frame(input, &qf))
+			continue;
+
+		output_input_frame(input, &qf.streaming_frame,
+				   &qf.recording_frame);
+		release_frame(video, qf.idx);
+
+		/* disconnected from within the callback */
+		if (os_atomic_load_bool(&input->stop))
+			break;
+	}
+
+	/* the input is left to this thread if it was disconnected from
+	 * within its own callback */
+	if (!input->thread_active) {
+		stop_input_thread(input);
+		input_thread_detached(video);
+	}
+
+	return NULL;
+}
+
+static bool start_input_thread(struct video_input *input)
+{
+	input->stop = false;
+	input->queue_start = 0;
+	input->queue_num = 0;
+
+	if (os_sem_init(&input->queue_sem, 0) != 0)
+		goto fail;
+	if (pthread_mutex_init(&input->queue_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_create(&input->thread, NULL, input_thread, input) != 0) {
+		pthread_mutex_destroy(&input->queue_mutex);
+		goto fail;
+	}
+
+	input->thread_active = true;
+	return true;
+
+fail:
+	os_sem_destroy(input->queue_sem);
+	input->queue_sem = NULL;
+	return false;
+}
+
+/* releases frames still queued for an input whose thread has exited */
+static void stop_input_thread(struct video_input *input)
+{
+	struct queued_frame qf;
+
+	while (pop_input_frame(input, &qf))
+		release_frame(input->video, qf.idx);
+
+	pthread_mutex_destroy(&input->queue_mutex);
+	os_sem_destroy(input->queue_sem);
+	input->queue_sem = NULL;
+
+	/* the thread owned the input if it wasn't joined */
+	if (!input->thread_active)
+		video_input_free(input);
+}
+
+/* returns false if the input was handed over to its own thread.  must not be
+ * called with input_mutex locked, the thread may be waiting on it */
+static bool join_input_thread(struct video_input *input)
+{
+	if (!input->queue_sem)
+		return true;
+
+	os_atomic_set_bool(&input->stop, true);
+
+	if (pthread_equal(pthread_self(), input->thread)) {
+		struct video_output *video = input->video;
+
+		pthread_mutex_lock(&video->data_mutex);
+		if (video->detached_inputs++ == 0)
+			os_event_reset(video->detached_event);
+		pthread_mutex_unlock(&video->data_mutex);
+
+		input->thread_active = false;
+		pthread_detach(input->thread);
+		return false;
+	}
+
+	os_sem_post(input->queue_sem);
+	pthread_join(input->thread, NULL);
+	stop_input_thread(input);
+	input->thread_active = false;
+	return true;
+}
+
+/* frames that were never output at all also count towards the total */
+static void count_skipped_frames(struct video_output *video, int count,
+				 bool lost)
+{
+	for (int i = 0; i < count; i++) {
+		os_atomic_inc_long(&video->skipped_frames);
+		if (lost)
+			os_atomic_inc_long(&video->total_frames);
+
+		for (size_t j = 0; j < video->inputs.num; j++) {
+			struct video_input *input = video->inputs.array[j];
+			os_atomic_inc_long(&input->skipped_frames);
+			if (lost)
+				os_atomic_inc_long(&input->total_frames);
+		}
+	}
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
+	struct video_data streaming_frame;
+	struct video_data recording_frame;
 	bool complete;
 	bool skipped;
+	size_t idx;
 
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->data_mutex);
 
+	idx = video->output_queue[video->first_queued];
+
 	struct cached_frame_info *main_frame_info =
-		&video->caches[OBS_MAIN_VIDEO_RENDERING][video->first_added];
+		&video->caches[OBS_MAIN_VIDEO_RENDERING][idx];
 	struct cached_frame_info *streaming_frame_info =
-		&video->caches[OBS_STREAMING_VIDEO_RENDERING][video->first_added];
+		&video->caches[OBS_STREAMING_VIDEO_RENDERING][idx];
 	struct cached_frame_info *recording_frame_info =
-		&video->caches[OBS_RECORDING_VIDEO_RENDERING][video->first_added];
+		&video->caches[OBS_RECORDING_VIDEO_RENDERING][idx];
+
+	if (!obs_get_multiple_rendering()) {
+		streaming_frame = main_frame_info->frame;
+		recording_frame = main_frame_info->frame;
+	} else {
+		streaming_frame = streaming_frame_info->frame;
+		recording_frame = recording_frame_info->frame;
+	}
+
+	/* held until every input got the frame */
+	video->cache_refs[idx]++;
 
 	pthread_mutex_unlock(&video->data_mutex);
 
+	obs_latency_trace_frame(OBS_LATENCY_VIDEO_OUTPUT,
+				main_frame_info->frame.timestamp);
+
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
-		if (!obs_get_multiple_rendering()) {
-			struct video_data frame = main_frame_info->frame;
-			if (scale_video_output(input, &frame))
-				input->callback(input->param, &frame, &frame);
+		struct video_input *input = video->inputs.array[i];
+
+		os_atomic_inc_long(&input->total_frames);
+
+		if (input->queue_sem) {
+			queue_input_frame(video, input, idx, &streaming_frame,
+					  &recording_frame);
 		} else {
-			struct video_data stream_frame =
-				streaming_frame_info->frame;
-			struct video_data record_frame =
-				recording_frame_info->frame;
-			if (scale_video_output(input, &stream_frame) &&
-			    scale_video_output(input, &record_frame)) {
-				input->callback(input->param, &stream_frame,
-						&record_frame);
-			}
+			struct video_data stream_frame = streaming_frame;
+			struct video_data record_frame = recording_frame;
+			output_input_frame(input, &stream_frame,
+					   &record_frame);
 		}
 	}
 
-	pthread_mutex_unlock(&video->input_mutex);
-
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->data_mutex);
@@ -182,11 +634,10 @@ static inline bool video_output_cur_frame(struct video_output *video)
 	}
 
 	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
-
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		video->cache_output[idx] = true;
+		if (++video->first_queued == video->info.cache_size)
+			video->first_queued = 0;
+		video->num_queued--;
 	} else if (skipped) {
 		if (!obs_get_multiple_rendering()) {
 			--main_frame_info->skipped;
@@ -194,10 +645,18 @@ static inline bool video_output_cur_frame(struct video_output *video)
 			--streaming_frame_info->skipped;
 			--recording_frame_info->skipped;
 		}
-		os_atomic_inc_long(&video->skipped_frames);
+		count_skipped_frames(video, 1, false);
+	}
+
+	if (video->lost_frames) {
+		count_skipped_frames(video, video->lost_frames, true);
+		video->lost_frames = 0;
 	}
 
 	pthread_mutex_unlock(&video->data_mutex);
+	pthread_mutex_unlock(&video->input_mutex);
+
+	release_frame(video, idx);
 
 	/* -------------------------------- */
 
@@ -286,6 +745,8 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
+	if (os_event_init(&out->detached_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
 		goto fail;
 
@@ -300,6 +761,25 @@ fail:
 	return VIDEO_OUTPUT_FAIL;
 }
 
+/* detached input threads still release frames and their scaler */
+static void wait_for_detached_inputs(struct video_output *video)
+{
+	if (!video->detached_event)
+		return;
+
+	for (;;) {
+		long detached;
+
+		pthread_mutex_lock(&video->data_mutex);
+		detached = video->detached_inputs;
+		pthread_mutex_unlock(&video->data_mutex);
+
+		if (!detached)
+			break;
+		os_event_wait(video->detached_event);
+	}
+}
+
 void video_output_close(video_t *video)
 {
 	if (!video)
@@ -307,9 +787,16 @@ void video_output_close(video_t *video)
 
 	video_output_stop(video);
 
-	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array[i];
+		if (join_input_thread(input))
+			video_input_free(input);
+	}
+
+	wait_for_detached_inputs(video);
+
 	da_free(video->inputs);
+	da_free(video->scalers);
 
 	for (enum obs_audio_rendering_mode mode = OBS_MAIN_AUDIO_RENDERING;
 	     mode <= OBS_RECORDING_AUDIO_RENDERING; mode++) {
@@ -319,6 +806,7 @@ void video_output_close(video_t *video)
 	}
 
 	os_sem_destroy(video->update_semaphore);
+	os_event_destroy(video->detached_event);
 	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 	bfree(video);
@@ -330,8 +818,8 @@ static size_t video_get_input_idx(const video_t *video,
 				  void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
-		if (input != NULL && input->callback == callback && input->param == param)
+		struct video_input *input = video->inputs.array[i];
+		if (input->callback == callback && input->param == param)
 			return i;
 	}
 
@@ -341,35 +829,14 @@ static size_t video_get_input_idx(const video_t *video,
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
+	input->video = video;
+
 	if (input->conversion.width != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
+		input->scaler = get_shared_scaler(video, &input->conversion);
+		if (!input->scaler)
 			return false;
-		}
-
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					 input->conversion.format,
-					 input->conversion.width,
-					 input->conversion.height);
 	}
 
 	return true;
@@ -395,26 +862,30 @@ bool video_output_connect(
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param = param;
+		input->callback = callback;
+		input->param = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = video->info.format;
-			input.conversion.width = video->info.width;
-			input.conversion.height = video->info.height;
+			input->conversion.format = video->info.format;
+			input->conversion.width = video->info.width;
+			input->conversion.height = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
+
+		success = video_input_init(input, video);
+		if (success && video->fanout && !start_input_thread(input)) {
+			blog(LOG_WARNING, "video_output_connect: Failed to "
+					  "create input thread");
+		}
 
-		success = video_input_init(&input, video);
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -423,6 +894,8 @@ bool video_output_connect(
 				os_atomic_set_bool(&video->raw_active, true);
 			}
 			da_push_back(video->inputs, &input);
+		} else {
+			video_input_free(input);
 		}
 	}
 
@@ -448,12 +921,27 @@ static void log_skipped(video_t *video)
 		     percentage_skipped);
 }
 
+static void log_input_skipped(struct video_input *input)
+{
+	long skipped = os_atomic_load_long(&input->skipped_frames);
+	long total = os_atomic_load_long(&input->total_frames);
+
+	if (skipped)
+		blog(LOG_INFO,
+		     "video-io: Input disconnected, number of skipped "
+		     "frames: %ld/%ld (%0.1f%%)",
+		     skipped, total,
+		     total ? (double)skipped / (double)total * 100.0 : 0.0);
+}
+
 void video_output_disconnect(video_t *video,
 			     void (*callback)(void *param,
                                               struct video_data *streaming_frame,
                                               struct video_data *recording_frame),
 			     void *param)
 {
+	struct video_input *input = NULL;
+
 	if (!video || !callback)
 		return;
 
@@ -461,7 +949,7 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
 
 		if (video->inputs.num == 0) {
@@ -473,6 +961,13 @@ void video_output_disconnect(video_t *video,
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	if (input) {
+		if (input->queue_sem)
+			log_input_skipped(input);
+		if (join_input_thread(input))
+			video_input_free(input);
+	}
 }
 
 bool video_output_active(const video_t *video)
@@ -503,22 +998,32 @@ bool video_output_lock_frame(video_t *video, struct video_frame **frames,
 	pthread_mutex_lock(&video->data_mutex);
 
 	if (video->available_frames == 0) {
-		for (enum obs_video_rendering_mode mode = start; mode <= end;
-		     mode++) {
-			video->caches[mode][video->last_added].count += count;
-			video->caches[mode][video->last_added].skipped += count;
+		if (video->num_queued) {
+			for (enum obs_video_rendering_mode mode = start;
+			     mode <= end; mode++) {
+				struct cached_frame_info *cfi;
+				cfi = &video->caches[mode][video->last_added];
+				cfi->count += count;
+				cfi->skipped += count;
+			}
+		} else {
+			/* every entry is still held by inputs (fan-out
+			 * mode), so there's no queued frame to repeat */
+			video->lost_frames += count;
 		}
 		locked = false;
 	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
+		size_t idx = 0;
+		while (video->cache_used[idx])
+			idx++;
+
+		video->cache_used[idx] = true;
+		video->locked_frame = idx;
 
 		for (enum obs_video_rendering_mode mode = start; mode <= end;
 		     mode++) {
 			struct cached_frame_info *cfi;
-			cfi = &video->caches[mode][video->last_added];
+			cfi = &video->caches[mode][idx];
 			cfi->frame.timestamp = timestamp[mode];
 			cfi->count = count;
 			cfi->skipped = 0;
@@ -541,6 +1046,9 @@ void video_output_unlock_frame(video_t *video)
 	pthread_mutex_lock(&video->data_mutex);
 
 	video->available_frames--;
+	video->last_added = video->locked_frame;
+	video->output_queue[(video->first_queued + video->num_queued++) %
+			    video->info.cache_size] = video->locked_frame;
 	os_sem_post(video->update_semaphore);
 
 	pthread_mutex_unlock(&video->data_mutex);
@@ -607,6 +1115,74 @@ uint32_t video_output_get_total_frames(const video_t *video)
 	return video ? (uint32_t)os_atomic_load_long(&video->total_frames) : 0;
 }
 
+void video_output_set_fanout(video_t *video, bool enable)
+{
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+	video->fanout = enable;
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+bool video_output_fanout_enabled(const video_t *video)
+{
+	return video ? video->fanout : false;
+}
+
+static bool get_input_frames(const video_t *video,
+			     void (*callback)(void *param,
+					      struct video_data *streaming_frame,
+					      struct video_data *recording_frame),
+			     void *param, uint32_t *skipped, uint32_t *total)
+{
+	struct video_output *out = (struct video_output *)video;
+	bool found = false;
+	size_t idx;
+
+	if (!video)
+		return false;
+
+	pthread_mutex_lock(&out->input_mutex);
+
+	idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input *input = video->inputs.array[idx];
+		*skipped = (uint32_t)os_atomic_load_long(&input->skipped_frames);
+		*total = (uint32_t)os_atomic_load_long(&input->total_frames);
+		found = true;
+	}
+
+	pthread_mutex_unlock(&out->input_mutex);
+	return found;
+}
+
+uint32_t video_output_get_input_skipped_frames(
+	const video_t *video,
+	void (*callback)(void *param, struct video_data *streaming_frame,
+			 struct video_data *recording_frame),
+	void *param)
+{
+	uint32_t skipped = 0;
+	uint32_t total = 0;
+
+	get_input_frames(video, callback, param, &skipped, &total);
+	return skipped;
+}
+
+uint32_t video_output_get_input_total_frames(
+	const video_t *video,
+	void (*callback)(void *param, struct video_data *streaming_frame,
+			 struct video_data *recording_frame),
+	void *param)
+{
+	uint32_t skipped = 0;
+	uint32_t total = 0;
+
+	get_input_frames(video, callback, param, &skipped, &total);
+	return total;
+}
+
 /* Note: These four functions below are a very slight bit of a hack.  If the
  * texture encoder thread is active while the raw encoder thread is active, the
  * total frame count will just be doubled while they're both active.  Which is
@@ -264,6 +264,31 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+/**
+ * Fan-out mode gives each connected input a thread of its own with a small
+ * frame queue, so a slow input (such as a heavy encoder preset) only skips
+ * frames itself instead of holding up the other inputs.
+ *
+ * It's off by default, including for the main video output, because it
+ * moves raw video callbacks off the video thread.  Only inputs connected
+ * after it's enabled get their own thread.
+ */
+EXPORT void video_output_set_fanout(video_t *video, bool enable);
+EXPORT bool video_output_fanout_enabled(const video_t *video);
+
+/** Frames skipped/offered for a single input, which in fan-out mode also
+ * counts frames dropped because that input's queue was full */
+EXPORT uint32_t video_output_get_input_skipped_frames(
+	const video_t *video,
+	void (*callback)(void *param, struct video_data *streaming_frame,
+			 struct video_data *recording_frame),
+	void *param);
+EXPORT uint32_t video_output_get_input_total_frames(
+	const video_t *video,
+	void (*callback)(void *param, struct video_data *streaming_frame,
+			 struct video_data *recording_frame),
+	void *param);
+
 extern void video_output_inc_texture_encoders(video_t *video);
 extern void video_output_dec_texture_encoders(video_t *video);
 extern void video_output_inc_texture_frames(video_t *video);
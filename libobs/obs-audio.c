@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "media-io/audio-math.h"
 
 struct ts_info {
 	uint64_t start;
@@ -60,9 +61,12 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 static inline void mix_audio(struct audio_output_data *main_mixes,
 			     struct audio_output_data *streaming_mixes,
 			     struct audio_output_data *recording_mixes,
-			     obs_source_t *source, size_t channels,
+			     bool share_mixes, obs_source_t *source,
+			     uint32_t mixers, size_t channels,
 			     size_t sample_rate, struct ts_info *ts)
 {
+	struct audio_output_data *mixes[NUM_RENDERING_MODES] = {
+		main_mixes, streaming_mixes, recording_mixes};
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
 	enum obs_audio_rendering_mode start =
@@ -73,6 +77,10 @@ static inline void mix_audio(struct audio_output_data *main_mixes,
 		get_cached_multiple_rendering() ? OBS_RECORDING_AUDIO_RENDERING
 					     : OBS_MAIN_AUDIO_RENDERING;
 
+	/* shared recording mixes point at the streaming buffers */
+	if (share_mixes)
+		end = OBS_STREAMING_AUDIO_RENDERING;
+
 	if (source->audio_ts < ts->start || ts->end <= source->audio_ts)
 		return;
 
@@ -85,37 +93,24 @@ static inline void mix_audio(struct audio_output_data *main_mixes,
 		total_floats -= start_point;
 	}
 
-	for (enum obs_audio_rendering_mode mode = start; mode <= end; mode++) {
-		for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-			for (size_t ch = 0; ch < channels; ch++) {
-				register float *mix = NULL;
-				switch (mode) {
-				case OBS_MAIN_AUDIO_RENDERING: {
-					mix = main_mixes[mix_idx].data[ch];
-					break;
-				}
-				case OBS_STREAMING_AUDIO_RENDERING: {
-					mix = streaming_mixes[mix_idx].data[ch];
-					break;
-				}
-				case OBS_RECORDING_AUDIO_RENDERING: {
-					mix = recording_mixes[mix_idx].data[ch];
-					break;
-				}
-				}
-
-				register float *aud =
+	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
+		/* inactive mixes have no outputs, and the source has already
+		 * zeroed its buffers for them, so there is nothing to add */
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
+
+		for (size_t ch = 0; ch < channels; ch++) {
+			for (enum obs_audio_rendering_mode mode = start;
+			     mode <= end; mode++) {
+				float *mix = mixes[mode][mix_idx].data[ch];
+				float *aud =
 					source->audio_output_buf[mode][mix_idx]
 								[ch];
-				register float *end;
-				if(!mix || !aud)
+				if (!mix || !aud)
 					return;
 
-				mix += start_point;
-				end = aud + total_floats;
-
-				while (aud < end)
-					*(mix++) += *(aud++);
+				mix_float_samples(mix + start_point, aud,
+						  total_floats);
 			}
 		}
 	}
@@ -517,6 +512,22 @@ static inline const char *calc_min_ts(struct obs_core_data *data,
 	return buffering_name;
 }
 
+/* the streaming and recording mixes can only differ when a scene item is
+ * visible in just one of the two modes, otherwise every source renders the
+ * same audio for both and the mixes are only computed once */
+static bool share_audio_mixes(struct obs_core_audio *audio,
+			      struct audio_output_data *streaming_mixes,
+			      struct audio_output_data *recording_mixes)
+{
+	if (!get_cached_multiple_rendering() ||
+	    os_atomic_load_long(&audio->split_mode_items) != 0)
+		return false;
+
+	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++)
+		recording_mixes[mix_idx] = streaming_mixes[mix_idx];
+	return true;
+}
+
 static inline void release_audio_sources(struct obs_core_audio *audio)
 {
 	for (size_t i = 0; i < audio->render_order.num; i++)
@@ -537,6 +548,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	struct ts_info ts = {start_ts_in, end_ts_in};
 	size_t audio_size;
 	uint64_t min_ts;
+	bool share_mixes;
 	enum obs_audio_rendering_mode mode =
 		get_cached_multiple_rendering() ? OBS_STREAMING_AUDIO_RENDERING
 					     : OBS_MAIN_AUDIO_RENDERING;
@@ -644,6 +656,9 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	/* ------------------------------------------------ */
 	/* mix audio */
+	share_mixes =
+		share_audio_mixes(audio, streaming_mixes, recording_mixes);
+
 	if (!audio->buffering_wait_ticks) {
 		for (size_t i = 0; i < audio->root_nodes.num; i++) {
 			obs_source_t *source = audio->root_nodes.array[i];
@@ -657,8 +672,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 						    [0][0] &&
 			    source->audio_ts)
 				mix_audio(main_mixes, streaming_mixes,
-					  recording_mixes, source, channels,
-					  sample_rate, &ts);
+					  recording_mixes, share_mixes, source,
+					  mixers, channels, sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
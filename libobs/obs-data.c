@@ -32,6 +32,9 @@ struct obs_data_item {
 	volatile long ref;
 	struct obs_data *parent;
 	struct obs_data_item *next;
+	struct obs_data_item *prev;
+	struct obs_data_item *hash_next;
+	uint32_t hash;
 	enum obs_data_type type;
 	size_t name_len;
 	size_t data_len;
@@ -46,6 +49,12 @@ struct obs_data {
 	volatile long ref;
 	char *json;
 	struct obs_data_item *first_item;
+	struct obs_data_item *last_item;
+	size_t num_items;
+
+	/* name index, only built for objects with many items */
+	struct obs_data_item **index;
+	size_t index_size;
 };
 
 struct obs_data_array {
@@ -64,6 +73,9 @@ struct obs_data_number {
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
+/* objects get a hash index once they have this many items */
+#define INDEX_THRESHOLD 32
+
 static inline size_t get_align_size(size_t size)
 {
 	const size_t alignment = base_get_alignment();
@@ -297,50 +309,152 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 
 	strcpy(get_item_name(item), name);
 	memcpy(get_item_data(item), data, size);
+	item->hash = str_hash(name);
 
 	item_data_addref(item);
 	return item;
 }
 
-static struct obs_data_item **get_item_prev_next(struct obs_data *data,
-						 struct obs_data_item *current)
+static inline struct obs_data_item **get_index_bucket(struct obs_data *data,
+							uint32_t hash)
 {
-	if (!current || !data)
-		return NULL;
+	return &data->index[hash & (data->index_size - 1)];
+}
 
-	struct obs_data_item **prev_next = &data->first_item;
+static void rebuild_index(struct obs_data *data, size_t size)
+{
 	struct obs_data_item *item = data->first_item;
 
-	while (item) {
-		if (item == current)
-			return prev_next;
+	bfree(data->index);
+	data->index = bzalloc(size * sizeof(struct obs_data_item *));
+	data->index_size = size;
 
-		prev_next = &item->next;
+	while (item) {
+		struct obs_data_item **bucket =
+			get_index_bucket(data, item->hash);
+		item->hash_next = *bucket;
+		*bucket = item;
 		item = item->next;
 	}
+}
 
-	return NULL;
+static void index_add(struct obs_data *data, struct obs_data_item *item)
+{
+	struct obs_data_item **bucket;
+
+	if (!data->index) {
+		if (data->num_items >= INDEX_THRESHOLD)
+			rebuild_index(data, INDEX_THRESHOLD * 2);
+		return;
+	}
+
+	if (data->num_items > data->index_size) {
+		rebuild_index(data, data->index_size * 2);
+		return;
+	}
+
+	bucket = get_index_bucket(data, item->hash);
+	item->hash_next = *bucket;
+	*bucket = item;
 }
 
-static inline void obs_data_item_detach(struct obs_data_item *item)
+/* only compares pointers, old_ptr may already have been freed */
+static void index_replace(struct obs_data *data, uint32_t hash,
+			  struct obs_data_item *old_ptr,
+			  struct obs_data_item *new_ptr)
+{
+	struct obs_data_item **prev_next;
+
+	if (!data->index)
+		return;
+
+	prev_next = get_index_bucket(data, hash);
+	while (*prev_next) {
+		if (*prev_next == old_ptr) {
+			*prev_next = new_ptr;
+			break;
+		}
+
+		prev_next = &(*prev_next)->hash_next;
+	}
+}
+
+static inline bool item_attached(struct obs_data_item *item)
 {
-	struct obs_data_item **prev_next =
-		get_item_prev_next(item->parent, item);
+	return item->prev || (item->parent && item->parent->first_item == item);
+}
 
-	if (prev_next) {
-		*prev_next = item->next;
-		item->next = NULL;
+static void obs_data_item_attach(struct obs_data *data,
+				 struct obs_data_item *item,
+				 struct obs_data_item *prev)
+{
+	item->parent = data;
+	item->prev = prev;
+
+	if (prev) {
+		item->next = prev->next;
+		prev->next = item;
+	} else {
+		item->next = data->first_item;
+		data->first_item = item;
 	}
+
+	if (item->next)
+		item->next->prev = item;
+	else
+		data->last_item = item;
+
+	data->num_items++;
+	index_add(data, item);
+}
+
+static inline void obs_data_item_detach(struct obs_data_item *item)
+{
+	struct obs_data *data = item->parent;
+
+	if (!item_attached(item))
+		return;
+
+	index_replace(data, item->hash, item, item->hash_next);
+
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		data->first_item = item->next;
+
+	if (item->next)
+		item->next->prev = item->prev;
+	else
+		data->last_item = item->prev;
+
+	data->num_items--;
+	item->next = NULL;
+	item->prev = NULL;
+	item->hash_next = NULL;
 }
 
+/* called after the item has been reallocated, so old_ptr is only compared */
 static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 					  struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next =
-		get_item_prev_next(new_ptr->parent, old_ptr);
+	struct obs_data *data = new_ptr->parent;
+
+	if (new_ptr->prev) {
+		if (new_ptr->prev->next != old_ptr)
+			return;
+		new_ptr->prev->next = new_ptr;
+	} else if (data && data->first_item == old_ptr) {
+		data->first_item = new_ptr;
+	} else {
+		return;
+	}
 
-	if (prev_next)
-		*prev_next = new_ptr;
+	if (new_ptr->next)
+		new_ptr->next->prev = new_ptr;
+	else
+		data->last_item = new_ptr;
+
+	index_replace(data, new_ptr->hash, old_ptr, new_ptr);
 }
 
 static struct obs_data_item *
@@ -763,6 +877,7 @@ static inline void obs_data_destroy(struct obs_data *data)
 
 	/* NOTE: don't use bfree for json text, allocated by json */
 	free(data->json);
+	bfree(data->index);
 	bfree(data);
 }
 
@@ -932,7 +1047,24 @@ static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 	if (!data)
 		return NULL;
 
-	struct obs_data_item *item = data->first_item;
+	struct obs_data_item *item;
+
+	if (data->index) {
+		uint32_t hash = str_hash(name);
+
+		item = data->index[hash & (data->index_size - 1)];
+		while (item) {
+			if (item->hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			item = item->hash_next;
+		}
+
+		return NULL;
+	}
+
+	item = data->first_item;
 
 	while (item) {
 		if (strcmp(get_item_name(item), name) == 0)
@@ -944,6 +1076,28 @@ static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 	return NULL;
 }
 
+/* items are kept sorted by name; names usually come in sorted order (e.g.
+ * when loading saved json), so check the end of the list first */
+static struct obs_data_item *find_insert_pos(struct obs_data *data,
+					     const char *name)
+{
+	struct obs_data_item *prev = data->last_item;
+	struct obs_data_item *item;
+
+	if (!prev || strcmp(get_item_name(prev), name) < 0)
+		return prev;
+
+	prev = NULL;
+	item = data->first_item;
+
+	while (item && strcmp(get_item_name(item), name) < 0) {
+		prev = item;
+		item = item->next;
+	}
+
+	return prev;
+}
+
 static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 			  const char *name, const void *ptr, size_t size,
 			  enum obs_data_type type, bool default_data,
@@ -955,30 +1109,8 @@ static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 		new_item = obs_data_item_create(name, ptr, size, type,
 						default_data, autoselect_data);
 
-		obs_data_item_t *prev = obs_data_first(data);
-		obs_data_item_t *next = obs_data_first(data);
-		obs_data_item_next(&next);
-		for (; prev && next;
-		     obs_data_item_next(&prev), obs_data_item_next(&next)) {
-			if (strcmp(get_item_name(next), name) > 0)
-				break;
-		}
-
-		new_item->parent = data;
-		if (prev && strcmp(get_item_name(prev), name) < 0) {
-			prev->next = new_item;
-			new_item->next = next;
-
-		} else {
-			data->first_item = new_item;
-			new_item->next = prev;
-		}
-
-		if (!prev)
-			data->first_item = new_item;
-
-		obs_data_item_release(&prev);
-		obs_data_item_release(&next);
+		obs_data_item_attach(data, new_item,
+				     find_insert_pos(data, name));
 
 	} else if (default_data) {
 		obs_data_item_set_default_data(item, ptr, size, type);
@@ -15,6 +15,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <inttypes.h>
+
 #include "obs.h"
 #include "obs-internal.h"
 #include "util/util_uint64.h"
@@ -50,6 +52,7 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
 	pthread_mutex_init_value(&encoder->pause.mutex);
+	pthread_mutex_init_value(&encoder->stats_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -66,6 +69,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->pause.mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->stats_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->orig_info.get_defaults) {
 		encoder->orig_info.get_defaults(encoder->context.settings);
@@ -199,12 +204,104 @@ static inline bool gpu_encode_available(const struct obs_encoder *encoder)
 	       obs->video.using_nv12_tex;
 }
 
+static void *audio_worker_thread(void *data);
+
+static void free_audio_worker(struct obs_encoder *encoder)
+{
+	struct encoder_audio_worker *worker = &encoder->audio_worker;
+
+	if (!worker->thread_created)
+		return;
+
+	pthread_join(worker->thread, NULL);
+	worker->thread_created = false;
+
+	spsc_ring_free(&worker->queue);
+	os_sem_destroy(worker->sem);
+	worker->sem = NULL;
+}
+
+static void start_audio_worker(struct obs_encoder *encoder)
+{
+	struct encoder_audio_worker *worker = &encoder->audio_worker;
+
+	worker->stop = false;
+	worker->abort = false;
+	worker->next_buffer = 0;
+
+	spsc_ring_init(&worker->queue, sizeof(struct encoder_audio_chunk),
+		       ENCODER_AUDIO_QUEUE_SIZE);
+
+	if (os_sem_init(&worker->sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&worker->thread, NULL, audio_worker_thread,
+			   encoder) != 0)
+		goto fail;
+
+	worker->thread_created = true;
+	return;
+
+fail:
+	blog(LOG_WARNING,
+	     "encoder '%s': Failed to create audio thread, encoding "
+	     "on the audio thread instead",
+	     encoder->context.name);
+
+	spsc_ring_free(&worker->queue);
+	os_sem_destroy(worker->sem);
+	worker->sem = NULL;
+}
+
+static void log_encoder_stats(struct obs_encoder *encoder)
+{
+	struct obs_encoder_stats stats;
+
+	pthread_mutex_lock(&encoder->stats_mutex);
+	stats = encoder->stats;
+	pthread_mutex_unlock(&encoder->stats_mutex);
+
+	if (!stats.frames_encoded)
+		return;
+
+	blog(LOG_INFO,
+	     "encoder '%s' audio thread: %" PRIu64 " frames encoded, "
+	     "encode time: avg %.3f ms, max %.3f ms, "
+	     "max queue depth: %" PRIu32 ", queue stalls: %" PRIu64,
+	     encoder->context.name, stats.frames_encoded,
+	     (double)stats.total_encode_ns / (double)stats.frames_encoded /
+		     1000000.0,
+	     (double)stats.max_encode_ns / 1000000.0, stats.max_queue_depth,
+	     stats.queue_stalls);
+}
+
+/* encodes everything that's still queued before returning */
+static void stop_audio_worker(struct obs_encoder *encoder)
+{
+	struct encoder_audio_worker *worker = &encoder->audio_worker;
+
+	if (!worker->thread_created)
+		return;
+
+	os_atomic_set_bool(&worker->stop, true);
+	os_sem_post(worker->sem);
+	free_audio_worker(encoder);
+
+	log_encoder_stats(encoder);
+}
+
 static void add_connection(struct obs_encoder *encoder)
 {
+	pthread_mutex_lock(&encoder->stats_mutex);
+	memset(&encoder->stats, 0, sizeof(encoder->stats));
+	pthread_mutex_unlock(&encoder->stats_mutex);
+
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		struct audio_convert_info audio_info = {0};
 		get_audio_info(encoder, &audio_info);
 
+		if (encoder->audio_thread)
+			start_audio_worker(encoder);
+
 		audio_output_connect(encoder->media, encoder->mixer_idx,
 				     &audio_info, receive_audio, encoder);
 	} else {
@@ -227,6 +324,7 @@ static void remove_connection(struct obs_encoder *encoder, bool shutdown)
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		audio_output_disconnect(encoder->media, encoder->mixer_idx,
 					receive_audio, encoder);
+		stop_audio_worker(encoder);
 	} else {
 		if (gpu_encode_available(encoder)) {
 			stop_gpu_encode(encoder);
@@ -269,6 +367,9 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		     encoder->context.name);
 
 		free_audio_buffers(encoder);
+		free_audio_worker(encoder);
+		for (size_t i = 0; i <= ENCODER_AUDIO_QUEUE_SIZE; i++)
+			bfree(encoder->audio_worker.buffers[i]);
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
@@ -277,6 +378,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
 		pthread_mutex_destroy(&encoder->pause.mutex);
+		pthread_mutex_destroy(&encoder->stats_mutex);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void *)encoder->info.id);
@@ -679,6 +781,49 @@ enum obs_encoder_type obs_get_encoder_type(const char *id)
 	return info ? info->type : OBS_ENCODER_AUDIO;
 }
 
+void obs_encoder_set_audio_thread(obs_encoder_t *encoder, bool enable)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_audio_thread"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_AUDIO) {
+		blog(LOG_WARNING,
+		     "obs_encoder_set_audio_thread: "
+		     "encoder '%s' is not an audio encoder",
+		     obs_encoder_get_name(encoder));
+		return;
+	}
+	if (encoder_active(encoder)) {
+		blog(LOG_WARNING,
+		     "encoder '%s': Cannot change the audio thread "
+		     "while the encoder is active",
+		     obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->audio_thread = enable;
+}
+
+bool obs_encoder_audio_thread_enabled(const obs_encoder_t *encoder)
+{
+	return obs_encoder_valid(encoder, "obs_encoder_audio_thread_enabled")
+		       ? encoder->audio_thread
+		       : false;
+}
+
+bool obs_encoder_get_stats(obs_encoder_t *encoder,
+			   struct obs_encoder_stats *stats)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_stats"))
+		return false;
+	if (!obs_ptr_valid(stats, "obs_encoder_get_stats"))
+		return false;
+
+	pthread_mutex_lock(&encoder->stats_mutex);
+	*stats = encoder->stats;
+	pthread_mutex_unlock(&encoder->stats_mutex);
+	return true;
+}
+
 void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 				 uint32_t height)
 {
@@ -924,13 +1069,64 @@ void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+static inline struct obs_latency_tag *
+get_trace_tag(struct obs_encoder *encoder, int64_t pts)
+{
+	int64_t idx = pts / (encoder->timebase_num ? encoder->timebase_num : 1);
+	idx %= OBS_LATENCY_ENCODER_TAGS;
+	if (idx < 0)
+		idx += OBS_LATENCY_ENCODER_TAGS;
+
+	return &encoder->trace_tags[idx];
+}
+
+void obs_encoder_trace_frame(struct obs_encoder *encoder, int64_t pts,
+			     uint64_t frame_ts)
+{
+	struct obs_latency_tag *tag;
+
+	if (!obs_latency_tracing())
+		return;
+
+	tag = get_trace_tag(encoder, pts);
+	tag->pts = pts;
+	tag->frame_ts = frame_ts;
+
+	obs_latency_trace_frame(OBS_LATENCY_ENCODE, frame_ts);
+}
+
+static inline uint64_t get_packet_trace_ts(struct obs_encoder *encoder,
+					   int64_t pts)
+{
+	struct obs_latency_tag *tag;
+
+	if (encoder->info.type != OBS_ENCODER_VIDEO || !obs_latency_tracing())
+		return 0;
+
+	tag = get_trace_tag(encoder, pts);
+	return tag->pts == pts ? tag->frame_ts : 0;
+}
+
+static inline bool on_audio_worker(const struct obs_encoder *encoder)
+{
+	const struct encoder_audio_worker *worker = &encoder->audio_worker;
+	return worker->thread_created &&
+	       pthread_equal(pthread_self(), worker->thread);
+}
+
 void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 			     bool received, struct encoder_packet *pkt)
 {
 	if (!success) {
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
 		     encoder->context.name);
-		full_stop(encoder);
+
+		/* the worker doesn't own the audio connection, the audio
+		 * thread stops the encoder once it sees the abort */
+		if (on_audio_worker(encoder))
+			os_atomic_set_bool(&encoder->audio_worker.abort, true);
+		else
+			full_stop(encoder);
 		return;
 	}
 
@@ -945,6 +1141,7 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 		pkt->dts_usec = encoder->start_ts / 1000 +
 				packet_dts_usec(pkt) - encoder->offset_usec;
 		pkt->sys_dts_usec = pkt->dts_usec;
+		pkt->trace_ts = get_packet_trace_ts(encoder, pkt->pts);
 
 		pthread_mutex_lock(&encoder->pause.mutex);
 		pkt->sys_dts_usec += encoder->pause.ts_offset / 1000;
@@ -962,6 +1159,18 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 	}
 }
 
+static void add_encode_time(struct obs_encoder *encoder, uint64_t time)
+{
+	struct obs_encoder_stats *stats = &encoder->stats;
+
+	pthread_mutex_lock(&encoder->stats_mutex);
+	stats->frames_encoded++;
+	stats->total_encode_ns += time;
+	if (time > stats->max_encode_ns)
+		stats->max_encode_ns = time;
+	pthread_mutex_unlock(&encoder->stats_mutex);
+}
+
 static const char *do_encode_name = "do_encode";
 bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame)
 {
@@ -979,10 +1188,14 @@ bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame)
 	pkt.timebase_den = encoder->timebase_den;
 	pkt.encoder = encoder;
 
+	uint64_t start = os_gettime_ns();
+
 	profile_start(encoder->profile_encoder_encode_name);
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 				       &received);
 	profile_end(encoder->profile_encoder_encode_name);
+
+	add_encode_time(encoder, os_gettime_ns() - start);
 	send_off_encoder_packet(encoder, success, received, &pkt);
 
 	profile_end(do_encode_name);
@@ -1078,6 +1291,8 @@ static void receive_video(void *param, struct video_data *streaming_frame,
 	enc_frame.frames = 1;
 	enc_frame.pts = encoder->cur_pts;
 
+	obs_encoder_trace_frame(encoder, enc_frame.pts, frame->timestamp);
+
 	if (do_encode(encoder, &enc_frame))
 		encoder->cur_pts += encoder->timebase_num;
 
@@ -1284,6 +1499,116 @@ bool audio_pause_check(struct pause_data *pause, struct audio_data *data,
 	return ignore_audio;
 }
 
+static void encode_audio(struct obs_encoder *encoder, struct audio_data *data)
+{
+	if (!encoder->first_received) {
+		encoder->first_raw_ts = data->timestamp;
+		encoder->first_received = true;
+		clear_audio(encoder);
+	}
+
+	if (audio_pause_check(&encoder->pause, data, encoder->samplerate))
+		return;
+
+	if (!buffer_audio(encoder, data))
+		return;
+
+	while (encoder->audio_input_buffer[0].size >=
+	       encoder->framesize_bytes) {
+		if (!send_audio_data(encoder)) {
+			break;
+		}
+	}
+}
+
+/* called on the audio thread, only waits if the worker falls behind by the
+ * whole queue.  returns false once the worker has failed to encode. */
+static bool queue_audio(struct obs_encoder *encoder,
+			const struct audio_data *data)
+{
+	struct encoder_audio_worker *worker = &encoder->audio_worker;
+	struct encoder_audio_chunk chunk;
+	size_t plane_size = data->frames * encoder->blocksize;
+	size_t size = plane_size * encoder->planes;
+	size_t idx = worker->next_buffer;
+	uint32_t depth;
+
+	if (os_atomic_load_bool(&worker->abort))
+		return false;
+
+	if (spsc_ring_size(&worker->queue) >= worker->queue.capacity) {
+		pthread_mutex_lock(&encoder->stats_mutex);
+		encoder->stats.queue_stalls++;
+		pthread_mutex_unlock(&encoder->stats_mutex);
+
+		while (spsc_ring_size(&worker->queue) >=
+		       worker->queue.capacity) {
+			if (os_atomic_load_bool(&worker->abort))
+				return false;
+			os_sleep_ms(1);
+		}
+	}
+
+	if (worker->buffer_sizes[idx] < size) {
+		worker->buffers[idx] = brealloc(worker->buffers[idx], size);
+		worker->buffer_sizes[idx] = size;
+	}
+
+	for (size_t i = 0; i < encoder->planes; i++)
+		memcpy(worker->buffers[idx] + plane_size * i, data->data[i],
+		       plane_size);
+
+	chunk.timestamp = data->timestamp;
+	chunk.frames = data->frames;
+	chunk.buffer = idx;
+
+	spsc_ring_push_back(&worker->queue, &chunk);
+	worker->next_buffer = (idx + 1) % (ENCODER_AUDIO_QUEUE_SIZE + 1);
+	os_sem_post(worker->sem);
+
+	depth = (uint32_t)spsc_ring_size(&worker->queue);
+
+	pthread_mutex_lock(&encoder->stats_mutex);
+	encoder->stats.queue_depth = depth;
+	if (depth > encoder->stats.max_queue_depth)
+		encoder->stats.max_queue_depth = depth;
+	pthread_mutex_unlock(&encoder->stats_mutex);
+	return true;
+}
+
+static void *audio_worker_thread(void *param)
+{
+	struct obs_encoder *encoder = param;
+	struct encoder_audio_worker *worker = &encoder->audio_worker;
+	struct encoder_audio_chunk chunk;
+
+	os_set_thread_name("obs-encoder: audio thread");
+
+	while (os_sem_wait(worker->sem) == 0) {
+		struct audio_data data = {0};
+		size_t plane_size;
+
+		if (os_atomic_load_bool(&worker->abort))
+			break;
+		if (!spsc_ring_pop_front(&worker->queue, &chunk)) {
+			if (os_atomic_load_bool(&worker->stop))
+				break;
+			continue;
+		}
+
+		plane_size = chunk.frames * encoder->blocksize;
+		for (size_t i = 0; i < encoder->planes; i++)
+			data.data[i] = worker->buffers[chunk.buffer] +
+				       plane_size * i;
+		data.frames = chunk.frames;
+		data.timestamp = chunk.timestamp;
+
+		encode_audio(encoder, &data);
+	}
+
+	return NULL;
+}
+
 static const char *receive_audio_name = "receive_audio";
 static void receive_audio(void *param, size_t mix_idx,
 			  struct audio_data *streaming_data,
@@ -1319,24 +1644,13 @@ static void receive_audio(void *param, size_t mix_idx,
 			goto end;
 	}
 
-	if (!encoder->first_received) {
-		encoder->first_raw_ts = data->timestamp;
-		encoder->first_received = true;
-		clear_audio(encoder);
-	}
-
-	if (audio_pause_check(&encoder->pause, data, encoder->samplerate))
-		goto end;
-
-	if (!buffer_audio(encoder, data))
-		goto end;
-
-	while (encoder->audio_input_buffer[0].size >=
-	       encoder->framesize_bytes) {
-		if (!send_audio_data(encoder)) {
-			break;
-		}
-	}
+	if (encoder->audio_worker.thread_created) {
+		/* stopped here rather than on the worker, this thread holds
+		 * the audio output's input mutex that disconnecting takes */
+		if (!queue_audio(encoder, data))
+			full_stop(encoder);
+	} else
+		encode_audio(encoder, data);
 
 	UNUSED_PARAMETER(mix_idx);
 
@@ -85,6 +85,10 @@ struct encoder_packet {
 
 	/** Encoder from which the track originated from */
 	obs_encoder_t *encoder;
+
+	/** Timestamp of the raw frame the packet was encoded from, only set
+	 * while latency tracing is enabled */
+	uint64_t trace_ts;
 };
 
 /** Encoder input frame */
@@ -0,0 +1,179 @@
+#include "obs-internal.h"
+
+/* frames that haven't been used for this long are freed */
+#define MAX_IDLE_TIME_NS 5000000000ULL
+
+/* upper limit of memory held by unused frames */
+#define MAX_RESIDENT_BYTES (512ULL * 1024ULL * 1024ULL)
+
+static size_t frame_data_size(const struct obs_source_frame *frame)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < MAX_AV_PLANES && frame->data[i]; i++) {
+		uint32_t height = frame->height;
+
+		switch (frame->format) {
+		case VIDEO_FORMAT_I420:
+		case VIDEO_FORMAT_NV12:
+			if (i > 0)
+				height /= 2;
+			break;
+		case VIDEO_FORMAT_I40A:
+			if (i == 1 || i == 2)
+				height /= 2;
+			break;
+		default:
+			break;
+		}
+
+		size += (size_t)frame->linesize[i] * height;
+	}
+
+	return size;
+}
+
+static inline bool entry_matches(const struct obs_frame_pool_entry *entry,
+				 enum video_format format, uint32_t width,
+				 uint32_t height)
+{
+	const struct obs_source_frame *frame = entry->frame;
+	return frame->format == format && frame->width == width &&
+	       frame->height == height;
+}
+
+static inline void remove_entry(struct obs_frame_pool *pool, size_t idx)
+{
+	struct obs_frame_pool_entry *entry = pool->frames.array + idx;
+
+	pool->bytes_resident -= entry->size;
+	da_erase(pool->frames, idx);
+}
+
+void obs_frame_pool_init(struct obs_frame_pool *pool)
+{
+	memset(pool, 0, sizeof(*pool));
+	pthread_mutex_init(&pool->mutex, NULL);
+}
+
+void obs_frame_pool_free(struct obs_frame_pool *pool)
+{
+	for (size_t i = 0; i < pool->frames.num; i++)
+		obs_source_frame_destroy(pool->frames.array[i].frame);
+
+	da_free(pool->frames);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+struct obs_source_frame *obs_frame_pool_get(struct obs_frame_pool *pool,
+					    enum video_format format,
+					    uint32_t width, uint32_t height)
+{
+	struct obs_source_frame *frame = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	/* most recently returned frames are at the back */
+	for (size_t i = pool->frames.num; i > 0; i--) {
+		struct obs_frame_pool_entry *entry = pool->frames.array + i - 1;
+
+		if (entry_matches(entry, format, width, height)) {
+			frame = entry->frame;
+			remove_entry(pool, i - 1);
+			break;
+		}
+	}
+
+	if (frame)
+		pool->hits++;
+	else
+		pool->misses++;
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (frame) {
+		struct obs_source_frame reused = {0};
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			reused.data[i] = frame->data[i];
+			reused.linesize[i] = frame->linesize[i];
+		}
+		reused.format = format;
+		reused.width = width;
+		reused.height = height;
+		*frame = reused;
+	} else {
+		frame = obs_source_frame_create(format, width, height);
+	}
+
+	return frame;
+}
+
+void obs_frame_pool_put(struct obs_frame_pool *pool,
+			struct obs_source_frame *frame)
+{
+	struct obs_frame_pool_entry entry;
+	DARRAY(struct obs_source_frame *) evicted = {0};
+
+	if (!frame)
+		return;
+
+	entry.frame = frame;
+	entry.size = frame_data_size(frame);
+	entry.last_used = os_gettime_ns();
+
+	pthread_mutex_lock(&pool->mutex);
+
+	da_push_back(pool->frames, &entry);
+	pool->bytes_resident += entry.size;
+
+	/* least recently used frames are at the front */
+	while (pool->bytes_resident > MAX_RESIDENT_BYTES &&
+	       pool->frames.num) {
+		da_push_back(evicted, &pool->frames.array[0].frame);
+		remove_entry(pool, 0);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < evicted.num; i++)
+		obs_source_frame_destroy(evicted.array[i]);
+	da_free(evicted);
+}
+
+void obs_frame_pool_trim(struct obs_frame_pool *pool, uint64_t cur_time)
+{
+	DARRAY(struct obs_source_frame *) evicted = {0};
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->frames.num &&
+	       cur_time > pool->frames.array[0].last_used + MAX_IDLE_TIME_NS) {
+		da_push_back(evicted, &pool->frames.array[0].frame);
+		remove_entry(pool, 0);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < evicted.num; i++)
+		obs_source_frame_destroy(evicted.array[i]);
+	da_free(evicted);
+}
+
+void obs_get_frame_pool_stats(struct obs_frame_pool_stats *stats)
+{
+	struct obs_frame_pool *pool;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!obs)
+		return;
+
+	pool = &obs->frame_pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	stats->hits = pool->hits;
+	stats->misses = pool->misses;
+	stats->bytes_resident = pool->bytes_resident;
+	stats->frames = pool->frames.num;
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include "util/darray.h"
+#include "obs.h"
+
+/*
+ * Interleave queue used by outputs to order encoded audio/video packets by
+ * timestamp before they are sent.
+ *
+ * The queue is a binary min-heap, so adding a packet and taking the next one
+ * to send are both O(log n).  While an output is still starting up, the
+ * queue is kept fully sorted instead (a sorted array is also a valid heap),
+ * because the startup logic walks it in order and discards from the front.
+ */
+
+struct interleaved_packet {
+	struct encoder_packet packet;
+	uint64_t order;
+};
+
+/* packets are ordered by dts, and video goes before audio of the same dts.
+ * for equal dts, newer video goes before older video while audio keeps its
+ * arrival order, which is what the old linear insertion ended up doing */
+static inline bool interleaved_packet_before(const struct interleaved_packet *a,
+					     const struct interleaved_packet *b)
+{
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	if (a->packet.type != b->packet.type)
+		return a->packet.type == OBS_ENCODER_VIDEO;
+	if (a->packet.type == OBS_ENCODER_VIDEO)
+		return a->order > b->order;
+	return a->order < b->order;
+}
+
+static inline int interleaved_packet_compare(const void *a, const void *b)
+{
+	if (interleaved_packet_before(a, b))
+		return -1;
+	if (interleaved_packet_before(b, a))
+		return 1;
+	return 0;
+}
+
+static inline void interleave_sift_up(struct interleaved_packet *array,
+				      size_t idx)
+{
+	struct interleaved_packet item = array[idx];
+
+	while (idx) {
+		size_t parent = (idx - 1) / 2;
+		if (!interleaved_packet_before(&item, &array[parent]))
+			break;
+
+		array[idx] = array[parent];
+		idx = parent;
+	}
+
+	array[idx] = item;
+}
+
+static inline void interleave_sift_down(struct interleaved_packet *array,
+					size_t num, size_t idx)
+{
+	struct interleaved_packet item = array[idx];
+
+	for (;;) {
+		size_t child = idx * 2 + 1;
+		if (child >= num)
+			break;
+
+		if (child + 1 < num &&
+		    interleaved_packet_before(&array[child + 1], &array[child]))
+			child++;
+		if (!interleaved_packet_before(&array[child], &item))
+			break;
+
+		array[idx] = array[child];
+		idx = child;
+	}
+
+	array[idx] = item;
+}
+
+/* adds a packet while keeping the whole queue sorted (startup only) */
+static inline void interleave_insert_sorted(struct darray *queue,
+					    uint64_t *order,
+					    const struct encoder_packet *packet)
+{
+	struct interleaved_packet *array = queue->array;
+	struct interleaved_packet item = {*packet, (*order)++};
+	size_t lo = 0;
+	size_t hi = queue->num;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (interleaved_packet_before(&item, &array[mid]))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	darray_insert(sizeof(item), queue, lo, &item);
+}
+
+static inline void interleave_push(struct darray *queue, uint64_t *order,
+				   const struct encoder_packet *packet)
+{
+	struct interleaved_packet item = {*packet, (*order)++};
+
+	darray_push_back(sizeof(item), queue, &item);
+	interleave_sift_up(queue->array, queue->num - 1);
+}
+
+/* removes the first packet of the queue */
+static inline void interleave_pop(struct darray *queue,
+				  struct encoder_packet *packet)
+{
+	struct interleaved_packet *array = queue->array;
+
+	if (packet)
+		*packet = array[0].packet;
+
+	array[0] = array[queue->num - 1];
+	darray_pop_back(sizeof(*array), queue);
+
+	if (queue->num)
+		interleave_sift_down(array, queue->num, 0);
+}
+
+/* fully re-sorts the queue after packet timestamps were changed.  the
+ * packets are treated as if they had been re-added in their current order */
+static inline void interleave_sort(struct darray *queue, uint64_t *order)
+{
+	struct interleaved_packet *array = queue->array;
+
+	for (size_t i = 0; i < queue->num; i++)
+		array[i].order = (*order)++;
+
+	if (queue->num)
+		qsort(array, queue->num, sizeof(*array),
+		      interleaved_packet_compare);
+}
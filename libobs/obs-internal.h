@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/spsc-ring.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -35,6 +36,7 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 //#include <caption/caption.h>
 
@@ -344,12 +346,26 @@ struct obs_core_audio {
 
 	float user_volume;
 
+	/* scene items that are visible in only one of the streaming and
+	 * recording modes; while there are none, both mixes are identical */
+	volatile long split_mode_items;
+
 	DARRAY(struct audio_monitor*)   monitors;
 	char                            *monitoring_device_name;
 	char                            *monitoring_device_id;
 	pthread_mutex_t                 monitoring_mutex;
 };
 
+/* name and UUID lookup tables for sources, outputs, encoders and services,
+ * so lookups don't have to walk the lists under their mutexes */
+struct obs_context_index {
+	pthread_rwlock_t lock;
+	struct obs_context_data **names;
+	struct obs_context_data **uuids;
+	size_t size;
+	size_t count;
+};
+
 /* user sources, output channels, and displays */
 struct obs_core_data {
 	struct obs_source *first_source;
@@ -373,6 +389,8 @@ struct obs_core_data {
 
 	long long unnamed_index;
 
+	struct obs_context_index context_index;
+
 	obs_data_t *private_data;
 
 	volatile bool valid;
@@ -413,6 +431,72 @@ struct obs_core_hotkeys {
 	char *sceneitem_hide;
 };
 
+/* unused async frames, shared by all sources and reused by format and size */
+struct obs_frame_pool_entry {
+	struct obs_source_frame *frame;
+	size_t size;
+	uint64_t last_used;
+};
+
+struct obs_frame_pool {
+	pthread_mutex_t mutex;
+	DARRAY(struct obs_frame_pool_entry) frames;
+	uint64_t bytes_resident;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+extern void obs_frame_pool_init(struct obs_frame_pool *pool);
+extern void obs_frame_pool_free(struct obs_frame_pool *pool);
+extern struct obs_source_frame *obs_frame_pool_get(struct obs_frame_pool *pool,
+						   enum video_format format,
+						   uint32_t width,
+						   uint32_t height);
+extern void obs_frame_pool_put(struct obs_frame_pool *pool,
+			       struct obs_source_frame *frame);
+extern void obs_frame_pool_trim(struct obs_frame_pool *pool,
+				uint64_t cur_time);
+
+/* per-frame latency tracing, see obs-latency.c */
+#define OBS_LATENCY_MAX_FRAMES 512
+#define OBS_LATENCY_ENCODER_TAGS 128
+
+struct obs_latency_frame {
+	uint64_t frame_ts;
+	uint64_t stage_ts[OBS_LATENCY_TOTAL];
+};
+
+struct obs_latency_event {
+	uint64_t frame_ts;
+	uint64_t start;
+	uint64_t end;
+	enum obs_latency_stage stage;
+};
+
+/* frame timestamps of frames submitted to an encoder, by pts */
+struct obs_latency_tag {
+	int64_t pts;
+	uint64_t frame_ts;
+};
+
+struct obs_latency_tracer {
+	volatile bool enabled;
+
+	pthread_mutex_t mutex;
+	uint64_t pending_capture;
+	struct obs_latency_frame frames[OBS_LATENCY_MAX_FRAMES];
+	size_t next_frame;
+	struct obs_latency_histogram histograms[OBS_LATENCY_STAGE_COUNT];
+	struct circlebuf events;
+};
+
+extern void obs_latency_init(struct obs_latency_tracer *tracer);
+extern void obs_latency_free(struct obs_latency_tracer *tracer);
+extern void obs_latency_trace_capture(uint64_t capture_ts);
+extern void obs_latency_trace_begin_frame(uint64_t frame_ts);
+extern void obs_latency_trace_frame(enum obs_latency_stage stage,
+				    uint64_t frame_ts);
+
 struct obs_core {
 	struct obs_module *first_module;
 	DARRAY(struct obs_module_path) module_paths;
@@ -441,17 +525,23 @@ struct obs_core {
 	struct obs_core_audio audio;
 	struct obs_core_data data;
 	struct obs_core_hotkeys hotkeys;
+	struct obs_frame_pool frame_pool;
+	struct obs_latency_tracer latency;
 
 	bool multiple_rendering;
 	enum obs_replay_buffer_rendering_mode replay_buffer_rendering_mode;
 	enum obs_video_rendering_mode video_rendering_mode;
-	enum obs_audio_rendering_mode audio_rendering_mode;
 
 	obs_task_handler_t ui_task_handler;
 };
 
 extern struct obs_core *obs;
 
+static inline bool obs_latency_tracing(void)
+{
+	return os_atomic_load_bool(&obs->latency.enabled);
+}
+
 struct obs_graphics_context {
 	uint64_t last_time;
 	uint64_t interval;
@@ -515,6 +605,14 @@ struct obs_context_data {
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
 
+	/* protected by obs->data.context_index.lock */
+	char                            uuid[37];
+	uint32_t                        name_hash;
+	uint32_t                        uuid_hash;
+	struct obs_context_data         *name_next;
+	struct obs_context_data         *uuid_next;
+	bool                            indexed;
+
 	bool                            private;
 
 	DARRAY(char*)                   rename_cache;
@@ -582,6 +680,9 @@ struct async_frame {
 	struct obs_source_frame *frame;
 	long unused_count;
 	bool used;
+
+	/* system time the frame was output, for latency tracing */
+	uint64_t trace_ts;
 };
 
 enum audio_action_type {
@@ -808,6 +909,12 @@ extern void obs_transition_enum_sources(obs_source_t *transition,
 extern void obs_transition_save(obs_source_t *source, obs_data_t *data);
 extern void obs_transition_load(obs_source_t *source, obs_data_t *data);
 
+extern bool obs_scene_audio_render_modes(
+	obs_source_t *source, uint64_t *ts_out,
+	struct obs_source_audio_mix **audio_output,
+	enum obs_audio_rendering_mode start, enum obs_audio_rendering_mode end,
+	uint32_t mixers, size_t channels, size_t sample_rate);
+
 struct audio_monitor *audio_monitor_create(obs_source_t *source);
 void audio_monitor_reset(struct audio_monitor *monitor);
 extern void audio_monitor_destroy(struct audio_monitor *monitor);
@@ -962,7 +1069,8 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	DARRAY(struct interleaved_packet) interleaved_packets;
+	uint64_t interleaved_order;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -1073,6 +1181,32 @@ struct encoder_callback {
 	void *param;
 };
 
+/* audio chunks that can wait for an audio encoder's worker thread */
+#define ENCODER_AUDIO_QUEUE_SIZE 16
+
+struct encoder_audio_chunk {
+	uint64_t timestamp;
+	uint32_t frames;
+	size_t buffer;
+};
+
+/* encodes audio on a thread of its own, fed by the audio thread */
+struct encoder_audio_worker {
+	pthread_t thread;
+	bool thread_created;
+	os_sem_t *sem;
+	volatile bool stop;
+	volatile bool abort;
+
+	struct spsc_ring queue;
+
+	/* one more buffer than the queue holds, so the producer never writes
+	 * to the buffer of the chunk that's being encoded */
+	uint8_t *buffers[ENCODER_AUDIO_QUEUE_SIZE + 1];
+	size_t buffer_sizes[ENCODER_AUDIO_QUEUE_SIZE + 1];
+	size_t next_buffer;
+};
+
 struct obs_encoder {
 	struct obs_context_data context;
 	struct obs_encoder_info info;
@@ -1107,6 +1241,9 @@ struct obs_encoder {
 
 	int64_t cur_pts;
 
+	/* raw frame timestamps of the frames that are still being encoded */
+	struct obs_latency_tag trace_tags[OBS_LATENCY_ENCODER_TAGS];
+
 	struct circlebuf audio_input_buffer[MAX_AV_PLANES];
 	uint8_t *audio_output_buffer[MAX_AV_PLANES];
 
@@ -1134,6 +1271,12 @@ struct obs_encoder {
 
 	struct pause_data pause;
 
+	bool audio_thread;
+	struct encoder_audio_worker audio_worker;
+
+	pthread_mutex_t stats_mutex;
+	struct obs_encoder_stats stats;
+
 	const char *profile_encoder_encode_name;
 	char *last_error_message;
 };
@@ -1160,6 +1303,8 @@ extern void obs_encoder_remove_output(struct obs_encoder *encoder,
 extern bool start_gpu_encode(obs_encoder_t *encoder);
 extern void stop_gpu_encode(obs_encoder_t *encoder);
 
+extern void obs_encoder_trace_frame(struct obs_encoder *encoder, int64_t pts,
+				    uint64_t frame_ts);
 extern bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame);
 extern void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 				    bool received, struct encoder_packet *pkt);
@@ -0,0 +1,307 @@
+#include <inttypes.h>
+
+#include "util/dstr.h"
+#include "util/platform.h"
+#include "obs-internal.h"
+
+/* number of trace events kept for the chrome trace file */
+#define MAX_EVENTS 65536
+
+static const char *stage_names[OBS_LATENCY_STAGE_COUNT] = {
+	"capture",    "render", "video_output", "encode",
+	"interleave", "send",   "total",
+};
+
+static inline void reset_histogram(struct obs_latency_histogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min_ns = UINT64_MAX;
+}
+
+static void reset_tracer(struct obs_latency_tracer *tracer)
+{
+	memset(tracer->frames, 0, sizeof(tracer->frames));
+	tracer->next_frame = 0;
+	tracer->pending_capture = 0;
+
+	for (size_t i = 0; i < OBS_LATENCY_STAGE_COUNT; i++)
+		reset_histogram(&tracer->histograms[i]);
+
+	circlebuf_free(&tracer->events);
+}
+
+void obs_latency_init(struct obs_latency_tracer *tracer)
+{
+	memset(tracer, 0, sizeof(*tracer));
+	pthread_mutex_init(&tracer->mutex, NULL);
+	reset_tracer(tracer);
+}
+
+void obs_latency_free(struct obs_latency_tracer *tracer)
+{
+	circlebuf_free(&tracer->events);
+	pthread_mutex_destroy(&tracer->mutex);
+}
+
+static void add_sample(struct obs_latency_histogram *hist, uint64_t ns)
+{
+	uint64_t usec = ns / 1000;
+	size_t bucket = 0;
+
+	while (usec > 1 && bucket < OBS_LATENCY_HISTOGRAM_BUCKETS - 1) {
+		usec >>= 1;
+		bucket++;
+	}
+
+	hist->count++;
+	hist->total_ns += ns;
+	hist->buckets[bucket]++;
+	if (ns < hist->min_ns)
+		hist->min_ns = ns;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+}
+
+static void add_event(struct obs_latency_tracer *tracer,
+		      enum obs_latency_stage stage, uint64_t frame_ts,
+		      uint64_t start, uint64_t end)
+{
+	struct obs_latency_event event = {frame_ts, start, end, stage};
+
+	if (tracer->events.size >= MAX_EVENTS * sizeof(event))
+		circlebuf_pop_front(&tracer->events, NULL, sizeof(event));
+	circlebuf_push_back(&tracer->events, &event, sizeof(event));
+
+	add_sample(&tracer->histograms[stage], end - start);
+}
+
+/* frames are looked up from the newest one, which is where nearly all
+ * lookups end up */
+static struct obs_latency_frame *find_frame(struct obs_latency_tracer *tracer,
+					    uint64_t frame_ts)
+{
+	size_t idx = tracer->next_frame;
+
+	for (size_t i = 0; i < OBS_LATENCY_MAX_FRAMES; i++) {
+		struct obs_latency_frame *frame;
+
+		idx = (idx ? idx : OBS_LATENCY_MAX_FRAMES) - 1;
+		frame = &tracer->frames[idx];
+
+		if (!frame->frame_ts)
+			break;
+		if (frame->frame_ts == frame_ts)
+			return frame;
+	}
+
+	return NULL;
+}
+
+static void mark_stage(struct obs_latency_tracer *tracer,
+		       struct obs_latency_frame *frame,
+		       enum obs_latency_stage stage, uint64_t ts)
+{
+	int prev = (int)stage - 1;
+
+	while (prev >= 0 && !frame->stage_ts[prev])
+		prev--;
+
+	/* a frame can reach the later stages several times (once per encoder
+	 * and output), only the first time is kept for the stages after it */
+	if (!frame->stage_ts[stage])
+		frame->stage_ts[stage] = ts;
+
+	if (prev >= 0)
+		add_event(tracer, stage, frame->frame_ts, frame->stage_ts[prev],
+			  ts);
+
+	if (stage == OBS_LATENCY_SEND) {
+		uint64_t start = frame->stage_ts[OBS_LATENCY_CAPTURE];
+		if (!start)
+			start = frame->stage_ts[OBS_LATENCY_RENDER];
+		if (start)
+			add_event(tracer, OBS_LATENCY_TOTAL, frame->frame_ts,
+				  start, ts);
+	}
+}
+
+void obs_latency_trace_capture(uint64_t capture_ts)
+{
+	struct obs_latency_tracer *tracer = &obs->latency;
+
+	if (!obs_latency_tracing() || !capture_ts)
+		return;
+
+	/* the oldest frame composited into the next render is what counts */
+	pthread_mutex_lock(&tracer->mutex);
+	if (!tracer->pending_capture || capture_ts < tracer->pending_capture)
+		tracer->pending_capture = capture_ts;
+	pthread_mutex_unlock(&tracer->mutex);
+}
+
+void obs_latency_trace_begin_frame(uint64_t frame_ts)
+{
+	struct obs_latency_tracer *tracer = &obs->latency;
+	struct obs_latency_frame *frame;
+	uint64_t ts;
+
+	if (!obs_latency_tracing())
+		return;
+
+	ts = os_gettime_ns();
+
+	pthread_mutex_lock(&tracer->mutex);
+
+	frame = &tracer->frames[tracer->next_frame];
+	tracer->next_frame = (tracer->next_frame + 1) % OBS_LATENCY_MAX_FRAMES;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->frame_ts = frame_ts;
+	frame->stage_ts[OBS_LATENCY_CAPTURE] = tracer->pending_capture;
+	tracer->pending_capture = 0;
+
+	mark_stage(tracer, frame, OBS_LATENCY_RENDER, ts);
+
+	pthread_mutex_unlock(&tracer->mutex);
+}
+
+void obs_latency_trace_frame(enum obs_latency_stage stage, uint64_t frame_ts)
+{
+	struct obs_latency_tracer *tracer = &obs->latency;
+	struct obs_latency_frame *frame;
+	uint64_t ts;
+
+	if (!obs_latency_tracing() || !frame_ts)
+		return;
+
+	ts = os_gettime_ns();
+
+	pthread_mutex_lock(&tracer->mutex);
+	frame = find_frame(tracer, frame_ts);
+	if (frame)
+		mark_stage(tracer, frame, stage, ts);
+	pthread_mutex_unlock(&tracer->mutex);
+}
+
+void obs_latency_trace_packet(enum obs_latency_stage stage,
+			      const struct encoder_packet *packet)
+{
+	if (!obs || !packet || packet->type != OBS_ENCODER_VIDEO)
+		return;
+	if (stage <= OBS_LATENCY_ENCODE || stage >= OBS_LATENCY_TOTAL)
+		return;
+
+	obs_latency_trace_frame(stage, packet->trace_ts);
+}
+
+void obs_latency_trace_enable(bool enable)
+{
+	if (!obs)
+		return;
+
+	os_atomic_set_bool(&obs->latency.enabled, enable);
+}
+
+bool obs_latency_trace_enabled(void)
+{
+	return obs && obs_latency_tracing();
+}
+
+void obs_latency_trace_reset(void)
+{
+	if (!obs)
+		return;
+
+	pthread_mutex_lock(&obs->latency.mutex);
+	reset_tracer(&obs->latency);
+	pthread_mutex_unlock(&obs->latency.mutex);
+}
+
+bool obs_latency_get_histogram(enum obs_latency_stage stage,
+			       struct obs_latency_histogram *hist)
+{
+	if (!obs || (unsigned)stage >= OBS_LATENCY_STAGE_COUNT)
+		return false;
+
+	pthread_mutex_lock(&obs->latency.mutex);
+	*hist = obs->latency.histograms[stage];
+	pthread_mutex_unlock(&obs->latency.mutex);
+
+	if (!hist->count)
+		hist->min_ns = 0;
+	return true;
+}
+
+uint64_t
+obs_latency_histogram_percentile(const struct obs_latency_histogram *hist,
+				 double percentile)
+{
+	uint64_t target;
+	uint64_t count = 0;
+
+	if (!hist->count)
+		return 0;
+
+	target = (uint64_t)((double)hist->count * percentile + 0.5);
+	if (!target)
+		target = 1;
+
+	for (size_t i = 0; i < OBS_LATENCY_HISTOGRAM_BUCKETS; i++) {
+		count += hist->buckets[i];
+		if (count >= target)
+			return (2ULL << i) * 1000;
+	}
+
+	return hist->max_ns;
+}
+
+bool obs_latency_trace_save(const char *path)
+{
+	struct obs_latency_tracer *tracer;
+	struct dstr json = {0};
+	size_t num;
+	bool success;
+
+	if (!obs)
+		return false;
+
+	tracer = &obs->latency;
+
+	dstr_copy(&json, "{\"traceEvents\":[");
+
+	/* one lane per stage */
+	for (size_t i = 0; i < OBS_LATENCY_STAGE_COUNT; i++)
+		dstr_catf(&json,
+			  "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+			  "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			  i ? "," : "", (int)i, stage_names[i]);
+
+	pthread_mutex_lock(&tracer->mutex);
+
+	num = tracer->events.size / sizeof(struct obs_latency_event);
+	for (size_t i = 0; i < num; i++) {
+		struct obs_latency_event *event = circlebuf_data(
+			&tracer->events, i * sizeof(struct obs_latency_event));
+
+		dstr_catf(&json,
+			  ",\n{\"name\":\"%s\",\"cat\":\"latency\",\"ph\":\"X\","
+			  "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+			  "\"args\":{\"frame\":%" PRIu64 "}}",
+			  stage_names[event->stage], (int)event->stage,
+			  (double)event->start / 1000.0,
+			  (double)(event->end - event->start) / 1000.0,
+			  event->frame_ts);
+	}
+
+	pthread_mutex_unlock(&tracer->mutex);
+
+	dstr_cat(&json, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	success = os_quick_write_utf8_file(path, json.array, json.len, false);
+	if (!success)
+		blog(LOG_WARNING, "obs_latency_trace_save: Failed to write '%s'",
+		     path);
+
+	dstr_free(&json);
+	return success;
+}
@@ -171,8 +171,8 @@ fail:
 static inline void free_packets(struct obs_output *output)
 {
 	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array +
-					   i);
+		obs_encoder_packet_release(
+			&output->interleaved_packets.array[i].packet);
 	da_free(output->interleaved_packets);
 }
 
@@ -1330,7 +1330,7 @@ double last_caption_timestamp = 0;
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet out = output->interleaved_packets.array[0].packet;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
@@ -1338,7 +1338,7 @@ static inline void send_interleaved(struct obs_output *output)
 	if (!has_higher_opposing_ts(output, &out))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	interleave_pop(&output->interleaved_packets.da, NULL);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1406,7 +1406,7 @@ static size_t get_interleaved_start_idx(struct obs_output *output)
 
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			&output->interleaved_packets.array[i].packet;
 		int64_t diff;
 
 		if (packet->type != OBS_ENCODER_AUDIO) {
@@ -1442,7 +1442,7 @@ static int prune_premature_packets(struct obs_output *output)
 	}
 
 	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	video = &output->interleaved_packets.array[video_idx].packet;
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
@@ -1456,7 +1456,7 @@ static int prune_premature_packets(struct obs_output *output)
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
+		audio = &output->interleaved_packets.array[audio_idx].packet;
 		if (audio_idx > max_idx)
 			max_idx = audio_idx;
 
@@ -1472,7 +1472,7 @@ static void discard_to_idx(struct obs_output *output, size_t idx)
 {
 	for (size_t i = 0; i < idx; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			&output->interleaved_packets.array[i].packet;
 		obs_encoder_packet_release(packet);
 	}
 
@@ -1490,7 +1490,7 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			&output->interleaved_packets.array[i].packet;
 		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
 		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video",
 		     (int)packet->track_idx, packet->dts_usec,
@@ -1518,7 +1518,7 @@ static int find_first_packet_type_idx(struct obs_output *output,
 {
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			&output->interleaved_packets.array[i].packet;
 
 		if (packet->type == type) {
 			if (type == OBS_ENCODER_AUDIO &&
@@ -1539,7 +1539,7 @@ static int find_last_packet_type_idx(struct obs_output *output,
 {
 	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
+			&output->interleaved_packets.array[i - 1].packet;
 
 		if (packet->type == type) {
 			if (type == OBS_ENCODER_AUDIO &&
@@ -1559,7 +1559,8 @@ find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
 		       size_t audio_idx)
 {
 	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return (idx != -1) ? &output->interleaved_packets.array[idx].packet
+			   : NULL;
 }
 
 static inline struct encoder_packet *
@@ -1567,7 +1568,8 @@ find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
 		      size_t audio_idx)
 {
 	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return (idx != -1) ? &output->interleaved_packets.array[idx].packet
+			   : NULL;
 }
 
 static bool get_audio_and_video_packets(struct obs_output *output,
@@ -1651,7 +1653,7 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	/* apply new offsets to all existing packet DTS/PTS values */
 	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
 		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+			&output->interleaved_packets.array[i].packet;
 		apply_interleaved_packet_offset(output, packet);
 	}
 
@@ -1659,36 +1661,23 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 }
 
 static inline void insert_interleaved_packet(struct obs_output *output,
-					     struct encoder_packet *out)
-{
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
+					     struct encoder_packet *out,
+					     bool started)
+{
+	/* the startup logic walks the packets in order, so keep them fully
+	 * sorted until the output has started sending */
+	if (started)
+		interleave_push(&output->interleaved_packets.da,
+				&output->interleaved_order, out);
+	else
+		interleave_insert_sorted(&output->interleaved_packets.da,
+					 &output->interleaved_order, out);
 }
 
 static void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-	       sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	interleave_sort(&output->interleaved_packets.da,
+			&output->interleaved_order);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
@@ -1698,7 +1687,7 @@ static void discard_unused_audio_packets(struct obs_output *output,
 
 	for (; idx < output->interleaved_packets.num; idx++) {
 		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+			&output->interleaved_packets.array[idx].packet;
 
 		if (p->dts_usec >= dts_usec)
 			break;
@@ -1719,6 +1708,8 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 
 	if (packet->type == OBS_ENCODER_AUDIO)
 		packet->track_idx = get_track_index(output, packet);
+	else
+		obs_latency_trace_packet(OBS_LATENCY_INTERLEAVE, packet);
 
 	pthread_mutex_lock(&output->interleaved_mutex);
 
@@ -1745,7 +1736,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	else
 		check_received(output, packet);
 
-	insert_interleaved_packet(output, &out);
+	insert_interleaved_packet(output, &out, was_started);
 	set_higher_ts(output, &out);
 
 	/* when both video and audio have been received, we're ready
@@ -251,6 +251,21 @@ static void scene_enum_all_sources(void *data,
 	scene_enum_sources(data, enum_callback, param, false);
 }
 
+static void set_mode_visibility(struct obs_scene_item *item,
+				bool stream_visible, bool recording_visible)
+{
+	bool was_split = item->stream_visible != item->recording_visible;
+	bool split = stream_visible != recording_visible;
+
+	item->stream_visible = stream_visible;
+	item->recording_visible = recording_visible;
+
+	if (split && !was_split)
+		os_atomic_inc_long(&obs->audio.split_mode_items);
+	else if (!split && was_split)
+		os_atomic_dec_long(&obs->audio.split_mode_items);
+}
+
 static inline void detach_sceneitem(struct obs_scene_item *item)
 {
 	if (item->prev)
@@ -1071,30 +1086,45 @@ static uint32_t scene_getheight(void *data)
 	return scene->custom_size ? scene->cy : obs->video.base_height;
 }
 
-static void apply_scene_item_audio_actions(struct obs_scene_item *item,
-					   float *buf, uint64_t ts,
-					   size_t sample_rate)
+static inline bool item_audible_in_mode(const struct obs_scene_item *item,
+					enum obs_audio_rendering_mode mode)
 {
-	bool cur_visible;
+	switch (mode) {
+	case OBS_STREAMING_AUDIO_RENDERING:
+		return item->visible && item->stream_visible;
+	case OBS_RECORDING_AUDIO_RENDERING:
+		return item->visible && item->recording_visible;
+	default:
+		return item->visible;
+	}
+}
 
-	if (obs_get_multiple_rendering()) {
-		switch (obs_get_audio_rendering_mode()) {
-		case OBS_MAIN_AUDIO_RENDERING: {
-			cur_visible = item->visible;
-			break;
-		}
-		case OBS_STREAMING_AUDIO_RENDERING: {
-			cur_visible = item->visible && item->stream_visible;
-			break;
-		}
-		case OBS_RECORDING_AUDIO_RENDERING: {
-			cur_visible = item->visible && item->recording_visible;
-			break;
-		}
-		}
-	} else {
-		cur_visible = item->visible;
+static inline void fill_visibility(float (*bufs)[AUDIO_OUTPUT_FRAMES],
+				   enum obs_audio_rendering_mode start,
+				   enum obs_audio_rendering_mode end,
+				   const bool *cur_visible, size_t from,
+				   size_t to)
+{
+	for (enum obs_audio_rendering_mode mode = start; mode <= end; mode++) {
+		float val = cur_visible[mode] ? 1.0f : 0.0f;
+
+		for (size_t i = from; i < to; i++)
+			bufs[mode][i] = val;
 	}
+}
+
+/* the visibility ramp of every rendering mode is computed in the same pass,
+ * as applying the actions consumes them */
+static void apply_scene_item_audio_actions(struct obs_scene_item *item,
+					   float (*bufs)[AUDIO_OUTPUT_FRAMES],
+					   enum obs_audio_rendering_mode start,
+					   enum obs_audio_rendering_mode end,
+					   uint64_t ts, size_t sample_rate)
+{
+	bool cur_visible[NUM_RENDERING_MODES];
+
+	for (enum obs_audio_rendering_mode mode = start; mode <= end; mode++)
+		cur_visible[mode] = item_audible_in_mode(item, mode);
 
 	uint64_t frame_num = 0;
 	size_t deref_count = 0;
@@ -1121,37 +1151,20 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 		if (!item->visible)
 			deref_count++;
 
-		if (buf && new_frame_num > frame_num) {
-			for (; frame_num < new_frame_num; frame_num++)
-				buf[frame_num] = cur_visible ? 1.0f : 0.0f;
+		if (bufs && new_frame_num > frame_num) {
+			fill_visibility(bufs, start, end, cur_visible,
+					(size_t)frame_num, (size_t)new_frame_num);
+			frame_num = new_frame_num;
 		}
 
-		if (obs_get_multiple_rendering()) {
-			switch (obs_get_audio_rendering_mode()) {
-			case OBS_MAIN_AUDIO_RENDERING: {
-				cur_visible = item->visible;
-				break;
-			}
-			case OBS_STREAMING_AUDIO_RENDERING: {
-				cur_visible = item->visible &&
-					      item->stream_visible;
-				break;
-			}
-			case OBS_RECORDING_AUDIO_RENDERING: {
-				cur_visible = item->visible &&
-					      item->recording_visible;
-				break;
-			}
-			}
-		} else {
-			cur_visible = item->visible;
-		}
+		for (enum obs_audio_rendering_mode mode = start; mode <= end;
+		     mode++)
+			cur_visible[mode] = item_audible_in_mode(item, mode);
 	}
 
-	if (buf) {
-		for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
-			buf[frame_num] = cur_visible ? 1.0f : 0.0f;
-	}
+	if (bufs)
+		fill_visibility(bufs, start, end, cur_visible,
+				(size_t)frame_num, AUDIO_OUTPUT_FRAMES);
 
 	pthread_mutex_unlock(&item->actions_mutex);
 
@@ -1163,7 +1176,10 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 	}
 }
 
-static bool apply_scene_item_volume(struct obs_scene_item *item, float *buf,
+static bool apply_scene_item_volume(struct obs_scene_item *item,
+				    float (*bufs)[AUDIO_OUTPUT_FRAMES],
+				    enum obs_audio_rendering_mode start,
+				    enum obs_audio_rendering_mode end,
 				    uint64_t ts, size_t sample_rate)
 {
 	bool actions_pending;
@@ -1182,8 +1198,8 @@ static bool apply_scene_item_volume(struct obs_scene_item *item, float *buf,
 						   1000000000ULL, sample_rate);
 
 		if (!ts || action.timestamp < (ts + duration)) {
-			apply_scene_item_audio_actions(item, buf, ts,
-						       sample_rate);
+			apply_scene_item_audio_actions(item, bufs, start, end,
+						       ts, sample_rate);
 			return true;
 		}
 	}
@@ -1194,7 +1210,9 @@ static bool apply_scene_item_volume(struct obs_scene_item *item, float *buf,
 static void process_all_audio_actions(struct obs_scene_item *item,
 				      size_t sample_rate)
 {
-	while (apply_scene_item_volume(item, NULL, 0, sample_rate))
+	while (apply_scene_item_volume(item, NULL, OBS_MAIN_AUDIO_RENDERING,
+				       OBS_MAIN_AUDIO_RENDERING, 0,
+				       sample_rate))
 		;
 }
 
@@ -1230,73 +1248,95 @@ static inline void render_item_audio(struct obs_scene_item *item,
 		*timestamp = source_ts;
 }
 
-static bool scene_audio_render(void *data, uint64_t *ts_out,
-			       struct obs_source_audio_mix *audio_output,
-			       uint32_t mixers, size_t channels,
-			       size_t sample_rate)
+static inline struct obs_source *
+get_item_audio_source(struct obs_scene_item *item)
 {
-	uint64_t timestamp = 0;
-	float buf[AUDIO_OUTPUT_FRAMES];
-	struct obs_source_audio_mix child_audio;
-	struct obs_scene *scene = data;
-	struct obs_scene_item *item;
+	if (item->visible && transition_active(item->show_transition))
+		return item->show_transition;
+	else if (!item->visible && transition_active(item->hide_transition))
+		return item->hide_transition;
+	return item->source;
+}
 
-	audio_lock(scene);
+/* the timestamp is the same for every rendering mode, as an item audible in
+ * any mode is also visible */
+static uint64_t get_scene_audio_timestamp(struct obs_scene *scene,
+					  enum obs_audio_rendering_mode start,
+					  enum obs_audio_rendering_mode end)
+{
+	uint64_t timestamp = 0;
+	struct obs_scene_item *item = scene->first_item;
 
-	item = scene->first_item;
 	while (item) {
-		struct obs_source *source;
-		if (item->visible && transition_active(item->show_transition))
-			source = item->show_transition;
-		else if (!item->visible &&
-			 transition_active(item->hide_transition))
-			source = item->hide_transition;
-		else
-			source = item->source;
-		if (!obs_source_audio_pending(source) &&
-		    (item->visible ||
-		     transition_active(item->hide_transition))) {
+		struct obs_source *source = get_item_audio_source(item);
+
+		if (obs_source_audio_pending(source)) {
+			item = item->next;
+			continue;
+		}
+
+		if (item->visible || transition_active(item->hide_transition)) {
 			uint64_t source_ts =
 				obs_source_get_audio_timestamp(source);
 
 			if (source_ts && (!timestamp || source_ts < timestamp))
 				timestamp = source_ts;
 		}
-		
-		if (obs_get_multiple_rendering()) {
-			switch (obs_get_audio_rendering_mode()) {
-			case OBS_MAIN_AUDIO_RENDERING: {
-				if (!obs_source_audio_pending(source) &&
-				    item->visible) {
-					render_item_audio(item, &timestamp);
-				}
-				break;
-			}
-			case OBS_STREAMING_AUDIO_RENDERING: {
-				if (!obs_source_audio_pending(source) &&
-				    item->visible && item->stream_visible) {
-					render_item_audio(item, &timestamp);
-				}
-				break;
-			}
-			case OBS_RECORDING_AUDIO_RENDERING: {
-				if (!obs_source_audio_pending(source) &&
-				    item->visible && item->recording_visible) {
-					render_item_audio(item, &timestamp);
-				}
-				break;
-			}
-			}
-		} else {
-			if (!obs_source_audio_pending(source) &&
-			    item->visible) {
+
+		for (enum obs_audio_rendering_mode mode = start; mode <= end;
+		     mode++) {
+			if (item_audible_in_mode(item, mode)) {
 				render_item_audio(item, &timestamp);
+				break;
 			}
 		}
 
 		item = item->next;
 	}
 
+	return timestamp;
+}
+
+static void mix_item_audio(struct obs_source_audio_mix *audio_output,
+			   struct obs_source *source,
+			   enum obs_audio_rendering_mode mode, float *buf,
+			   size_t pos, uint32_t mixers, size_t channels)
+{
+	size_t count = AUDIO_OUTPUT_FRAMES - pos;
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		if ((mixers & (1 << mix)) == 0)
+			continue;
+
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *out = audio_output->output[mix].data[ch];
+			float *in = source->audio_output_buf[mode][mix][ch];
+
+			if (buf)
+				mix_audio_with_buf(out, in, buf, pos, count);
+			else
+				mix_audio(out, in, pos, count);
+		}
+	}
+}
+
+/* renders every rendering mode from start to end in a single pass over the
+ * items, audio_output is indexed by rendering mode */
+static bool scene_audio_render_modes(struct obs_scene *scene, uint64_t *ts_out,
+				     struct obs_source_audio_mix **audio_output,
+				     enum obs_audio_rendering_mode start,
+				     enum obs_audio_rendering_mode end,
+				     uint32_t mixers, size_t channels,
+				     size_t sample_rate)
+{
+	uint64_t timestamp;
+	float bufs[NUM_RENDERING_MODES][AUDIO_OUTPUT_FRAMES];
+	struct obs_scene_item *item;
+
+	audio_lock(scene);
+
+	timestamp = get_scene_audio_timestamp(scene, start, end);
+
 	if (!timestamp) {
 		/* just process all pending audio actions if no audio playing,
 		 * otherwise audio actions will just never be processed */
@@ -1313,19 +1353,12 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 	item = scene->first_item;
 	while (item) {
 		uint64_t source_ts;
-		size_t pos, count;
+		size_t pos;
 		bool apply_buf;
-		struct obs_source *source;
-		if (item->visible && transition_active(item->show_transition))
-			source = item->show_transition;
-		else if (!item->visible &&
-			 transition_active(item->hide_transition))
-			source = item->hide_transition;
-		else
-			source = item->source;
+		struct obs_source *source = get_item_audio_source(item);
 
-		apply_buf = apply_scene_item_volume(item, buf, timestamp,
-						    sample_rate);
+		apply_buf = apply_scene_item_volume(item, bufs, start, end,
+						    timestamp, sample_rate);
 
 		if (obs_source_audio_pending(source)) {
 			item = item->next;
@@ -1340,51 +1373,17 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 
 		pos = (size_t)ns_to_audio_frames(sample_rate,
 						 source_ts - timestamp);
-		count = AUDIO_OUTPUT_FRAMES - pos;
 
-		if (obs_get_multiple_rendering()) {
+		for (enum obs_audio_rendering_mode mode = start; mode <= end;
+		     mode++) {
 			if (!apply_buf &&
-			    ((obs_get_audio_rendering_mode() ==
-				      OBS_MAIN_AUDIO_RENDERING &&
-			      !item->visible  &&
-		              !transition_active(item->hide_transition) ) ||
-			     (obs_get_audio_rendering_mode() ==
-				      OBS_STREAMING_AUDIO_RENDERING &&
-			      !item->visible &&
-			      !transition_active(item->hide_transition) && 
-			      !item->stream_visible) ||
-			     (obs_get_audio_rendering_mode() ==
-				      OBS_RECORDING_AUDIO_RENDERING &&
-			      !item->visible  &&
-			      !transition_active(item->hide_transition) && 
-			      !item->recording_visible))) {
-				item = item->next;
-				continue;
-			}
-		} else {
-			if (!apply_buf && !item->visible  &&
-			    !transition_active(item->hide_transition) ) {
-				item = item->next;
+			    !transition_active(item->hide_transition) &&
+			    !item_audible_in_mode(item, mode))
 				continue;
-			}
-		}
-
-		obs_source_get_audio_mix(source, &child_audio);
-
-		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-			if ((mixers & (1 << mix)) == 0)
-				continue;
-
-			for (size_t ch = 0; ch < channels; ch++) {
-				float *out = audio_output->output[mix].data[ch];
-				float *in = child_audio.output[mix].data[ch];
 
-				if (apply_buf)
-					mix_audio_with_buf(out, in, buf, pos,
-							   count);
-				else
-					mix_audio(out, in, pos, count);
-			}
+			mix_item_audio(audio_output[mode], source, mode,
+				       apply_buf ? bufs[mode] : NULL, pos,
+				       mixers, channels);
 		}
 
 		item = item->next;
@@ -1396,6 +1395,31 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 	return true;
 }
 
+static bool scene_audio_render(void *data, uint64_t *ts_out,
+			       struct obs_source_audio_mix *audio_output,
+			       uint32_t mixers, size_t channels,
+			       size_t sample_rate)
+{
+	enum obs_audio_rendering_mode mode = obs_get_audio_rendering_mode();
+	struct obs_source_audio_mix *outputs[NUM_RENDERING_MODES] = {0};
+
+	outputs[mode] = audio_output;
+	return scene_audio_render_modes(data, ts_out, outputs, mode, mode,
+					mixers, channels, sample_rate);
+}
+
+bool obs_scene_audio_render_modes(obs_source_t *source, uint64_t *ts_out,
+				  struct obs_source_audio_mix **audio_output,
+				  enum obs_audio_rendering_mode start,
+				  enum obs_audio_rendering_mode end,
+				  uint32_t mixers, size_t channels,
+				  size_t sample_rate)
+{
+	return scene_audio_render_modes(source->context.data, ts_out,
+					audio_output, start, end, mixers,
+					channels, sample_rate);
+}
+
 const struct obs_source_info scene_info = {
 	.id = "scene",
 	.type = OBS_SOURCE_TYPE_SCENE,
@@ -1522,8 +1546,7 @@ static inline void duplicate_item_data(struct obs_scene_item *dst,
 	dst->bounds_type = src->bounds_type;
 	dst->bounds_align = src->bounds_align;
 	dst->bounds = src->bounds;
-	dst->stream_visible = src->stream_visible;
-	dst->recording_visible = src->recording_visible;
+	set_mode_visibility(dst, src->stream_visible, src->recording_visible);
 
 	if (src->show_transition) {
 		obs_source_t *transition = obs_source_duplicate(
@@ -2052,6 +2075,7 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 static void obs_sceneitem_destroy(obs_sceneitem_t *item)
 {
 	if (item) {
+		set_mode_visibility(item, true, true);
 		if (item->item_render) {
 			obs_enter_graphics();
 			gs_texrender_destroy(item->item_render);
@@ -2788,7 +2812,7 @@ bool obs_sceneitem_set_stream_visible(obs_sceneitem_t *item,
 	if (!item->parent)
 		return false;
 
-	item->stream_visible = stream_visible;
+	set_mode_visibility(item, stream_visible, item->recording_visible);
 
 	return true;
 }
@@ -2810,7 +2834,7 @@ bool obs_sceneitem_set_recording_visible(obs_sceneitem_t *item,
 	if (!item->parent)
 		return false;
 
-	item->recording_visible = recording_visible;
+	set_mode_visibility(item, item->stream_visible, recording_visible);
 
 	return true;
 }
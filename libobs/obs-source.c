@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-math.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/util_uint64.h"
@@ -608,10 +609,16 @@ void obs_source_frame_init(struct obs_source_frame *frame,
 	}
 }
 
+/* async frames go back to the shared frame pool instead of being freed */
+static inline void async_frame_free(struct obs_source_frame *frame)
+{
+	obs_frame_pool_put(&obs->frame_pool, frame);
+}
+
 static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 {
 	if (os_atomic_dec_long(&frame->refs) == 0)
-		obs_source_frame_destroy(frame);
+		async_frame_free(frame);
 }
 
 static bool obs_source_filter_remove_refless(obs_source_t *source,
@@ -1143,6 +1150,18 @@ static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 bool set_async_texture_size(struct obs_source *source,
 			    const struct obs_source_frame *frame);
 
+static void trace_async_frame(obs_source_t *source,
+			      const struct obs_source_frame *frame)
+{
+	for (size_t i = 0; i < source->async_cache.num; i++) {
+		struct async_frame *af = &source->async_cache.array[i];
+		if (af->frame == frame) {
+			obs_latency_trace_capture(af->trace_ts);
+			break;
+		}
+	}
+}
+
 static void async_tick(obs_source_t *source)
 {
 	uint64_t sys_time = obs->video.video_time;
@@ -1158,6 +1177,9 @@ static void async_tick(obs_source_t *source)
 		}
 
 		source->cur_async_frame = get_closest_frame(source, sys_time);
+
+		if (source->cur_async_frame && obs_latency_tracing())
+			trace_async_frame(source, source->cur_async_frame);
 	}
 
 	source->last_sys_timestamp = sys_time;
@@ -2854,7 +2876,7 @@ static void clean_cache(obs_source_t *source)
 		struct async_frame *af = &source->async_cache.array[i - 1];
 		if (!af->used) {
 			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
+				async_frame_free(af->frame);
 				da_erase(source->async_cache, i - 1);
 			}
 		}
@@ -2867,6 +2889,7 @@ static inline struct obs_source_frame *
 cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 {
 	struct obs_source_frame *new_frame = NULL;
+	uint64_t trace_ts = obs_latency_tracing() ? os_gettime_ns() : 0;
 
 	pthread_mutex_lock(&source->async_mutex);
 
@@ -2894,6 +2917,7 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 			new_frame->format = format;
 			af->used = true;
 			af->unused_count = 0;
+			af->trace_ts = trace_ts;
 			break;
 		}
 	}
@@ -2903,11 +2927,12 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 	if (!new_frame) {
 		struct async_frame new_af;
 
-		new_frame = obs_source_frame_create(format, frame->width,
-						    frame->height);
+		new_frame = obs_frame_pool_get(&obs->frame_pool, format,
+					       frame->width, frame->height);
 		new_af.frame = new_frame;
 		new_af.used = true;
 		new_af.unused_count = 0;
+		new_af.trace_ts = trace_ts;
 		new_frame->refs = 1;
 
 		da_push_back(source->async_cache, &new_af);
@@ -2940,7 +2965,7 @@ obs_source_output_video_internal(obs_source_t *source,
 	pthread_mutex_lock(&source->async_mutex);
 	if (output) {
 		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
+			async_frame_free(output);
 			output = NULL;
 		} else {
 			da_push_back(source->async_frames, &output);
@@ -3329,56 +3354,46 @@ static void copy_audio_data(obs_source_t *source, const uint8_t *const data[],
 		source->audio_storage_size = size;
 }
 
-/* TODO: SSE optimization */
 static void downmix_to_mono_planar(struct obs_source *source, uint32_t frames)
 {
 	size_t channels = audio_output_get_channels(obs->audio.audio);
 	const float channels_i = 1.0f / (float)channels;
 	float **data = (float **)source->audio_data.data;
 
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[0][frame] += data[channel][frame];
-	}
+	for (size_t channel = 1; channel < channels; channel++)
+		mix_float_samples(data[0], data[channel], frames);
 
-	for (uint32_t frame = 0; frame < frames; frame++)
-		data[0][frame] *= channels_i;
+	scale_float_samples(data[0], data[0], channels_i, frames);
 
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[channel][frame] = data[0][frame];
-	}
+	for (size_t channel = 1; channel < channels; channel++)
+		memcpy(data[channel], data[0], frames * sizeof(float));
 }
 
 static void process_audio_balancing(struct obs_source *source, uint32_t frames,
 				    float balance, enum obs_balance_type type)
 {
 	float **data = (float **)source->audio_data.data;
+	float left, right;
 
 	switch (type) {
 	case OBS_BALANCE_TYPE_SINE_LAW:
-		for (uint32_t frame = 0; frame < frames; frame++) {
-			data[0][frame] = data[0][frame] *
-					 sinf((1.0f - balance) * (M_PI / 2.0f));
-			data[1][frame] =
-				data[1][frame] * sinf(balance * (M_PI / 2.0f));
-		}
+		left = sinf((1.0f - balance) * (M_PI / 2.0f));
+		right = sinf(balance * (M_PI / 2.0f));
 		break;
 	case OBS_BALANCE_TYPE_SQUARE_LAW:
-		for (uint32_t frame = 0; frame < frames; frame++) {
-			data[0][frame] = data[0][frame] * sqrtf(1.0f - balance);
-			data[1][frame] = data[1][frame] * sqrtf(balance);
-		}
+		left = sqrtf(1.0f - balance);
+		right = sqrtf(balance);
 		break;
 	case OBS_BALANCE_TYPE_LINEAR:
-		for (uint32_t frame = 0; frame < frames; frame++) {
-			data[0][frame] = data[0][frame] * (1.0f - balance);
-			data[1][frame] = data[1][frame] * balance;
-		}
+		left = 1.0f - balance;
+		right = balance;
 		break;
 	default:
-		break;
+		return;
 	}
+
+	scale_float_samples(data[0], data[0], left, frames);
+	scale_float_samples(data[1], data[1], right, frames);
 }
 
 /* resamples/remixes new audio to the designated main audio output format */
@@ -3616,12 +3631,12 @@ void obs_source_release_frame(obs_source_t *source,
 		return;
 
 	if (!source) {
-		obs_source_frame_destroy(frame);
+		async_frame_free(frame);
 	} else {
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			async_frame_free(frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -4664,32 +4679,17 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 	return source->volume;
 }
 
-static inline void multiply_output_audio(obs_source_t *source, size_t mix,
-					 size_t channels, float vol,
-					 enum obs_video_rendering_mode mode)
-{
-	register float *out = source->audio_output_buf[mode][mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
-}
-
-static inline void multiply_vol_data(obs_source_t *source, size_t mix,
-				     size_t channels, float *vol_data)
+/* writes src scaled by either the volume ramp or the constant volume to dst,
+ * dst may be the same as src */
+static inline void scale_audio(float *dst, const float *src, size_t frames,
+			       float vol, const float *ramp)
 {
-	for (enum obs_audio_rendering_mode mode = OBS_MAIN_AUDIO_RENDERING;
-	     mode <= OBS_RECORDING_AUDIO_RENDERING; mode++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *out =
-				source->audio_output_buf[mode][mix][ch];
-			register float *end = out + AUDIO_OUTPUT_FRAMES;
-			register float *vol = vol_data;
-
-			while (out < end)
-				*(out++) *= *(vol++);
-		}
-	}
+	if (ramp)
+		scale_float_samples_ramp(dst, src, ramp, frames);
+	else if (vol != 1.0f)
+		scale_float_samples(dst, src, vol, frames);
+	else if (dst != src)
+		memcpy(dst, src, frames * sizeof(float));
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -4711,10 +4711,9 @@ static inline void apply_audio_action(obs_source_t *source,
 	}
 }
 
-static void apply_audio_actions(obs_source_t *source, size_t channels,
-				size_t sample_rate)
+static void get_audio_actions_ramp(obs_source_t *source, size_t sample_rate,
+				   float *vol_data)
 {
-	float vol_data[AUDIO_OUTPUT_FRAMES];
 	float cur_vol = get_source_volume(source, source->audio_ts);
 	size_t frame_num = 0;
 
@@ -4750,19 +4749,15 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		vol_data[frame_num] = cur_vol;
 
 	pthread_mutex_unlock(&source->audio_actions_mutex);
-
-	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) != 0)
-			multiply_vol_data(source, mix, channels, vol_data);
-	}
 }
 
-static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
-			       size_t channels, size_t sample_rate)
+/* returns the volume ramp of this tick if any volume/mute actions land in it
+ * (consuming them), otherwise NULL, with the constant volume set in *vol */
+static const float *get_audio_volume(obs_source_t *source, size_t sample_rate,
+				     float *vol_data, float *vol)
 {
 	struct audio_action action;
 	bool actions_pending;
-	float vol;
 
 	pthread_mutex_lock(&source->audio_actions_mutex);
 
@@ -4777,33 +4772,46 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 			conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
-			apply_audio_actions(source, channels, sample_rate);
-			return;
+			get_audio_actions_ramp(source, sample_rate, vol_data);
+			return vol_data;
 		}
 	}
 
-	vol = get_source_volume(source, source->audio_ts);
-	if (vol == 1.0f)
+	*vol = get_source_volume(source, source->audio_ts);
+	return NULL;
+}
+
+static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
+			       size_t channels, size_t sample_rate,
+			       enum obs_audio_rendering_mode start,
+			       enum obs_audio_rendering_mode end)
+{
+	float vol_data[AUDIO_OUTPUT_FRAMES];
+	const float *ramp;
+	float vol = 1.0f;
+
+	ramp = get_audio_volume(source, sample_rate, vol_data, &vol);
+	if (!ramp && vol == 1.0f)
 		return;
 
-	if (vol == 0.0f || mixers == 0) {
-		for (enum obs_audio_rendering_mode mode =
-			     OBS_MAIN_AUDIO_RENDERING;
-		     mode <= OBS_RECORDING_AUDIO_RENDERING; mode++) {
+	for (enum obs_audio_rendering_mode mode = start; mode <= end; mode++) {
+		if (!ramp && (vol == 0.0f || mixers == 0)) {
 			memset(source->audio_output_buf[mode][0][0], 0,
 			       AUDIO_OUTPUT_FRAMES * sizeof(float) *
 				       MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES);
+			continue;
 		}
-		return;
-	}
 
-	for (int i = 0; i < NUM_RENDERING_MODES; i++) {
 		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-			uint32_t mix_and_val = (1 << mix);
-			if ((source->audio_mixers & mix_and_val) != 0 &&
-			    (mixers & mix_and_val) != 0)
-				multiply_output_audio(source, mix, channels,
-						      vol, i);
+			if ((source->audio_mixers & mixers & (1 << mix)) == 0)
+				continue;
+
+			for (size_t ch = 0; ch < channels; ch++) {
+				float *out =
+					source->audio_output_buf[mode][mix][ch];
+				scale_audio(out, out, AUDIO_OUTPUT_FRAMES, vol,
+					    ramp);
+			}
 		}
 	}
 }
@@ -4814,6 +4822,12 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 	struct obs_source_audio_mix main_audio_data;
 	struct obs_source_audio_mix streaming_audio_data;
 	struct obs_source_audio_mix recording_audio_data;
+	enum obs_audio_rendering_mode start =
+		obs_get_multiple_rendering() ? OBS_STREAMING_AUDIO_RENDERING
+					     : OBS_MAIN_AUDIO_RENDERING;
+	enum obs_audio_rendering_mode end =
+		obs_get_multiple_rendering() ? OBS_RECORDING_AUDIO_RENDERING
+					     : OBS_MAIN_AUDIO_RENDERING;
 	bool success;
 	uint64_t ts;
 
@@ -4830,20 +4844,13 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 					[OBS_RECORDING_AUDIO_RENDERING][mix][ch];
 		}
 
-		if ((source->audio_mixers & mixers & (1 << mix)) != 0) {
-			memset(source->audio_output_buf[OBS_MAIN_AUDIO_RENDERING]
-						       [mix][0],
-			       0,
-			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
-			memset(source->audio_output_buf
-				       [OBS_STREAMING_AUDIO_RENDERING][mix][0],
-			       0,
-			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
-			memset(source->audio_output_buf
-				       [OBS_RECORDING_AUDIO_RENDERING][mix][0],
-			       0,
+		if ((source->audio_mixers & mixers & (1 << mix)) == 0)
+			continue;
+
+		for (enum obs_audio_rendering_mode mode = start; mode <= end;
+		     mode++)
+			memset(source->audio_output_buf[mode][mix][0], 0,
 			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
-		}
 	}
 
 	if (!obs_get_multiple_rendering()) {
@@ -4851,6 +4858,16 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 		success = source->info.audio_render(source->context.data, &ts,
 						    &main_audio_data, mixers,
 						    channels, sample_rate);
+	} else if (source->info.type == OBS_SOURCE_TYPE_SCENE) {
+		struct obs_source_audio_mix *outputs[NUM_RENDERING_MODES] = {
+			&main_audio_data, &streaming_audio_data,
+			&recording_audio_data};
+
+		/* scenes render both modes in one pass over their items */
+		success = obs_scene_audio_render_modes(
+			source, &ts, outputs, OBS_STREAMING_AUDIO_RENDERING,
+			OBS_RECORDING_AUDIO_RENDERING, mixers, channels,
+			sample_rate);
 	} else {
 		obs_set_audio_rendering_mode(OBS_STREAMING_AUDIO_RENDERING);
 		success = source->info.audio_render(source->context.data, &ts,
@@ -4862,6 +4879,8 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 		success |= source->info.audio_render(source->context.data, &ts,
 					  &recording_audio_data, mixers,
 					  channels, sample_rate);
+
+		obs_set_audio_rendering_mode(OBS_MAIN_AUDIO_RENDERING);
 	}
 
 	source->audio_ts = success ? ts : 0;
@@ -4876,19 +4895,16 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 		if ((mixers & mix_bit) == 0)
 			continue;
 
-		for (enum obs_audio_rendering_mode mode =
-			     OBS_MAIN_AUDIO_RENDERING;
-		     mode <= OBS_RECORDING_AUDIO_RENDERING; mode++) {
-			if ((source->audio_mixers & mix_bit) == 0) {
-				memset(source->audio_output_buf[mode][mix][0],
-				       0,
-				       sizeof(float) * AUDIO_OUTPUT_FRAMES *
-					       channels);
-			}
-		}
+		if ((source->audio_mixers & mix_bit) != 0)
+			continue;
+
+		for (enum obs_audio_rendering_mode mode = start; mode <= end;
+		     mode++)
+			memset(source->audio_output_buf[mode][mix][0], 0,
+			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
 	}
 
-	apply_audio_volume(source, mixers, channels, sample_rate);
+	apply_audio_volume(source, mixers, channels, sample_rate, start, end);
 }
 
 static void audio_submix(obs_source_t *source, size_t channels,
@@ -4924,6 +4940,31 @@ static void audio_submix(obs_source_t *source, size_t channels,
 	obs_source_output_audio(source, &audio);
 }
 
+/* copies the front of an input buffer to out, scaling it on the way */
+static inline void copy_input_audio(float *out, struct circlebuf *buf,
+				    size_t size, float vol, const float *ramp)
+{
+	size_t start_size = buf->capacity - buf->start_pos;
+	const float *in =
+		(const float *)((uint8_t *)buf->data + buf->start_pos);
+
+	if (start_size >= size) {
+		scale_audio(out, in, size / sizeof(float), vol, ramp);
+
+	} else if (start_size % sizeof(float) == 0) {
+		size_t start_frames = start_size / sizeof(float);
+
+		scale_audio(out, in, start_frames, vol, ramp);
+		scale_audio(out + start_frames, buf->data,
+			    (size - start_size) / sizeof(float), vol,
+			    ramp ? ramp + start_frames : NULL);
+
+	} else {
+		circlebuf_peek_front(buf, out, size);
+		scale_audio(out, out, size / sizeof(float), vol, ramp);
+	}
+}
+
 static inline void process_audio_source_tick(obs_source_t *source,
 					     uint32_t mixers, size_t channels,
 					     size_t sample_rate, size_t size)
@@ -4935,7 +4976,12 @@ static inline void process_audio_source_tick(obs_source_t *source,
 	enum obs_video_rendering_mode end =
 		obs_get_multiple_rendering() ? OBS_RECORDING_AUDIO_RENDERING
 					     : OBS_MAIN_AUDIO_RENDERING;
-	// Main audio
+	float vol_data[AUDIO_OUTPUT_FRAMES];
+	const float *ramp = NULL;
+	float vol = 1.0f;
+	uint32_t out_mixes;
+	uint32_t copy_mixes;
+
 	pthread_mutex_lock(&source->audio_buf_mutex);
 
 	for (enum obs_video_rendering_mode mode = start; mode <= end; mode++) {
@@ -4944,57 +4990,46 @@ static inline void process_audio_source_tick(obs_source_t *source,
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 			return;
 		}
-
-		for (size_t ch = 0; ch < channels; ch++)
-			circlebuf_peek_front(
-				&source->audio_input_buf[mode][ch],
-				source->audio_output_buf[mode][0][ch], size);
 	}
 
-	pthread_mutex_unlock(&source->audio_buf_mutex);
+	if (audio_submix) {
+		/* submixes only feed mix 0 (unscaled) and mix 1 */
+		out_mixes = 0x3;
+		copy_mixes = (source->audio_mixers & 1) != 0 ? 0x3 : 0x1;
+	} else {
+		ramp = get_audio_volume(source, sample_rate, vol_data, &vol);
 
-	for (size_t mix = 1; mix < MAX_AUDIO_MIXES; mix++) {
-		uint32_t mix_and_val = (1 << mix);
+		out_mixes = (1 << MAX_AUDIO_MIXES) - 1;
+		copy_mixes = source->audio_mixers & mixers;
+		if (!ramp && vol == 0.0f)
+			copy_mixes = 0;
+	}
 
-		if (audio_submix) {
-			if (mix > 1)
-				break;
+	/* the volume is applied while copying out of the input buffers, so
+	 * each output buffer is only written once per tick */
+	for (enum obs_video_rendering_mode mode = start; mode <= end; mode++) {
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			uint32_t mix_bit = 1 << mix;
 
-			mixers = 1;
-			mix_and_val = 1;
-		}
+			if ((out_mixes & mix_bit) == 0)
+				continue;
 
-		if ((source->audio_mixers & mix_and_val) == 0 ||
-		    (mixers & mix_and_val) == 0) {
-			for (enum obs_video_rendering_mode mode = start;
-			     mode <= end; mode++)
+			if ((copy_mixes & mix_bit) == 0) {
 				memset(source->audio_output_buf[mode][mix][0],
 				       0, size * channels);
-			continue;
-		}
+				continue;
+			}
 
-		for (size_t ch = 0; ch < channels; ch++) {
-			for (enum obs_video_rendering_mode mode = start;
-			     mode <= end; mode++)
-				memcpy(source->audio_output_buf[mode][mix][ch],
-				       source->audio_output_buf[mode][0][ch],
-				       size);
+			for (size_t ch = 0; ch < channels; ch++)
+				copy_input_audio(
+					source->audio_output_buf[mode][mix][ch],
+					&source->audio_input_buf[mode][ch],
+					size, vol, ramp);
 		}
 	}
 
-	if (audio_submix) {
-		source->audio_pending = false;
-		return;
-	}
-
-	if ((source->audio_mixers & 1) == 0 || (mixers & 1) == 0) {
-		for (enum obs_video_rendering_mode mode = start; mode <= end;
-		     mode++)
-			memset(source->audio_output_buf[mode][0][0], 0,
-			       size * channels);
-	}
+	pthread_mutex_unlock(&source->audio_buf_mutex);
 
-	apply_audio_volume(source, mixers, channels, sample_rate);
 	source->audio_pending = false;
 }
 
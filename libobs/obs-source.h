@@ -196,6 +196,12 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_SRGB (1 << 15)
 
+/**
+ * Source type can be created on any thread, at the same time as other
+ * sources.  obs_load_sources creates sources of such types in parallel.
+ */
+#define OBS_SOURCE_THREADSAFE_CREATE (1 << 16)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
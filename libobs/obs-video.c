@@ -74,6 +74,8 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 
 	pthread_mutex_unlock(&data->sources_mutex);
 
+	obs_frame_pool_trim(&obs->frame_pool, cur_time);
+
 	return cur_time;
 }
 
@@ -844,6 +846,8 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 	struct video_data recording_frame = {0};
 	bool frame_ready = 0;
 
+	obs_latency_trace_begin_frame(video->video_time);
+
 	profile_start(output_frame_gs_context_name);
 	gs_enter_context(video->graphics);
 
@@ -682,6 +682,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&obs->data.draw_callbacks_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_rwlock_init(&data->context_index.lock, NULL) != 0)
+		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
@@ -740,6 +742,9 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
 	pthread_mutex_destroy(&data->draw_callbacks_mutex);
+	pthread_rwlock_destroy(&data->context_index.lock);
+	bfree(data->context_index.names);
+	bfree(data->context_index.uuids);
 	da_free(data->draw_callbacks);
 	da_free(data->tick_callbacks);
 	obs_data_release(data->private_data);
@@ -892,6 +897,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	pthread_mutex_init_value(&obs->audio.monitoring_mutex);
 	pthread_mutex_init_value(&obs->video.gpu_encoder_mutex);
 	pthread_mutex_init_value(&obs->video.task_mutex);
+	obs_frame_pool_init(&obs->frame_pool);
+	obs_latency_init(&obs->latency);
 
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
@@ -918,7 +925,6 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	obs->replay_buffer_rendering_mode =
 		OBS_RECORDING_REPLAY_BUFFER_RENDERING;
 	obs->video_rendering_mode = OBS_MAIN_VIDEO_RENDERING;
-	obs->audio_rendering_mode = OBS_MAIN_AUDIO_RENDERING;
 	return true;
 }
 
@@ -1065,6 +1071,7 @@ void obs_shutdown(void)
 
 	stop_video();
 	stop_hotkeys();
+	signal_handler_dispatch_shutdown();
 
 	module = obs->first_module;
 	while (module) {
@@ -1078,6 +1085,8 @@ void obs_shutdown(void)
 	obs_free_data();
 	obs_free_video();
 	obs_free_graphics();
+	obs_frame_pool_free(&obs->frame_pool);
+	obs_latency_free(&obs->latency);
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 	obs->procs = NULL;
@@ -1621,25 +1630,65 @@ void obs_enum_services(bool (*enum_proc)(void *, obs_service_t *), void *param)
 		 param);
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-					pthread_mutex_t *mutex,
+static inline void *get_context_by_name(enum obs_obj_type type,
+					const char *name,
 					void *(*addref)(void *))
 {
-	struct obs_context_data **first = vfirst;
-	struct obs_context_data *context;
+	struct obs_context_index *index = &obs->data.context_index;
+	struct obs_context_data *context = NULL;
+	uint32_t hash;
 
-	pthread_mutex_lock(mutex);
+	if (!name)
+		return NULL;
+
+	hash = str_hash(name);
+
+	pthread_rwlock_rdlock(&index->lock);
+
+	if (index->size)
+		context = index->names[hash & (index->size - 1)];
 
-	context = *first;
 	while (context) {
-		if (!context->private && strcmp(context->name, name) == 0) {
+		if (context->type == type && context->name_hash == hash &&
+		    strcmp(context->name, name) == 0) {
 			context = addref(context);
 			break;
 		}
-		context = context->next;
+		context = context->name_next;
 	}
 
-	pthread_mutex_unlock(mutex);
+	pthread_rwlock_unlock(&index->lock);
+	return context;
+}
+
+static inline void *get_context_by_uuid(enum obs_obj_type type,
+					const char *uuid,
+					void *(*addref)(void *))
+{
+	struct obs_context_index *index = &obs->data.context_index;
+	struct obs_context_data *context = NULL;
+	uint32_t hash;
+
+	if (!uuid)
+		return NULL;
+
+	hash = str_hash(uuid);
+
+	pthread_rwlock_rdlock(&index->lock);
+
+	if (index->size)
+		context = index->uuids[hash & (index->size - 1)];
+
+	while (context) {
+		if (context->type == type && context->uuid_hash == hash &&
+		    strcmp(context->uuid, uuid) == 0) {
+			context = addref(context);
+			break;
+		}
+		context = context->uuid_next;
+	}
+
+	pthread_rwlock_unlock(&index->lock);
 	return context;
 }
 
@@ -1670,29 +1719,49 @@ static inline void *obs_id_(void *data)
 
 obs_source_t *obs_get_source_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_source, name,
-				   &obs->data.sources_mutex,
+	return get_context_by_name(OBS_OBJ_TYPE_SOURCE, name,
 				   obs_source_addref_safe_);
 }
 
 obs_output_t *obs_get_output_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_output, name,
-				   &obs->data.outputs_mutex,
+	return get_context_by_name(OBS_OBJ_TYPE_OUTPUT, name,
 				   obs_output_addref_safe_);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_encoder, name,
-				   &obs->data.encoders_mutex,
+	return get_context_by_name(OBS_OBJ_TYPE_ENCODER, name,
 				   obs_encoder_addref_safe_);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_service, name,
-				   &obs->data.services_mutex,
+	return get_context_by_name(OBS_OBJ_TYPE_SERVICE, name,
+				   obs_service_addref_safe_);
+}
+
+obs_source_t *obs_get_source_by_uuid(const char *uuid)
+{
+	return get_context_by_uuid(OBS_OBJ_TYPE_SOURCE, uuid,
+				   obs_source_addref_safe_);
+}
+
+obs_output_t *obs_get_output_by_uuid(const char *uuid)
+{
+	return get_context_by_uuid(OBS_OBJ_TYPE_OUTPUT, uuid,
+				   obs_output_addref_safe_);
+}
+
+obs_encoder_t *obs_get_encoder_by_uuid(const char *uuid)
+{
+	return get_context_by_uuid(OBS_OBJ_TYPE_ENCODER, uuid,
+				   obs_encoder_addref_safe_);
+}
+
+obs_service_t *obs_get_service_by_uuid(const char *uuid)
+{
+	return get_context_by_uuid(OBS_OBJ_TYPE_SERVICE, uuid,
 				   obs_service_addref_safe_);
 }
 
@@ -1846,20 +1915,19 @@ enum obs_video_rendering_mode obs_get_video_rendering_mode(void)
 		return obs->video_rendering_mode;
 }
 
+/* the audio rendering mode is per thread so that the audio of each mode can
+ * be rendered independently */
+static THREAD_LOCAL enum obs_audio_rendering_mode audio_rendering_mode =
+	OBS_MAIN_AUDIO_RENDERING;
+
 void obs_set_audio_rendering_mode(enum obs_audio_rendering_mode mode)
 {
-	if (!obs)
-		return;
-
-	obs->audio_rendering_mode = mode;
+	audio_rendering_mode = mode;
 }
 
 enum obs_audio_rendering_mode obs_get_audio_rendering_mode(void)
 {
-	if (!obs)
-		return OBS_MAIN_AUDIO_RENDERING;
-	else
-		return obs->audio_rendering_mode;
+	return audio_rendering_mode;
 }
 
 void obs_set_replay_buffer_rendering_mode(
@@ -2032,33 +2100,146 @@ obs_source_t *obs_load_source(obs_data_t *source_data)
 	return obs_load_source_type(source_data);
 }
 
-void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb,
-		      void *private_data)
-{
-	struct obs_core_data *data = &obs->data;
-	DARRAY(obs_source_t *) sources;
+/* upper limit of threads used to create sources in obs_load_sources */
+#define MAX_LOAD_THREADS 8
+
+struct load_sources_data {
+	obs_data_array_t *array;
+	obs_source_t **sources;
 	size_t count;
-	size_t i;
 
-	da_init(sources);
+	/* indices of the sources that can be created in parallel */
+	DARRAY(size_t) parallel;
+	volatile long next;
+};
 
-	count = obs_data_array_count(array);
-	da_reserve(sources, count);
+static inline bool threadsafe_create_type(obs_data_t *source_data)
+{
+	const char *id = obs_data_get_string(source_data, "id");
+	const char *v_id = obs_data_get_string(source_data, "versioned_id");
+	const struct obs_source_info *info = get_source_info(*v_id ? v_id : id);
 
-	pthread_mutex_lock(&data->sources_mutex);
+	return info && (info->output_flags & OBS_SOURCE_THREADSAFE_CREATE) != 0;
+}
 
-	for (i = 0; i < count; i++) {
-		obs_data_t *source_data = obs_data_array_item(array, i);
-		obs_source_t *source = obs_load_source(source_data);
+/* filters are created along with their parent, so they have to be safe to
+ * create in parallel too */
+static bool threadsafe_create(obs_data_t *source_data)
+{
+	obs_data_array_t *filters = obs_data_get_array(source_data, "filters");
+	bool threadsafe = threadsafe_create_type(source_data);
+	size_t count = obs_data_array_count(filters);
 
-		da_push_back(sources, &source);
+	for (size_t i = 0; threadsafe && i < count; i++) {
+		obs_data_t *filter_data = obs_data_array_item(filters, i);
+		threadsafe = threadsafe_create_type(filter_data);
+		obs_data_release(filter_data);
+	}
+
+	obs_data_array_release(filters);
+	return threadsafe;
+}
+
+static void load_source_idx(struct load_sources_data *load, size_t idx)
+{
+	obs_data_t *source_data = obs_data_array_item(load->array, idx);
+	load->sources[idx] = obs_load_source(source_data);
+	obs_data_release(source_data);
+}
+
+static void load_sources_work(struct load_sources_data *load)
+{
+	for (;;) {
+		size_t i = (size_t)os_atomic_inc_long(&load->next) - 1;
+
+		if (i >= load->parallel.num)
+			break;
+
+		load_source_idx(load, load->parallel.array[i]);
+	}
+}
+
+static void *load_sources_thread(void *param)
+{
+	os_set_thread_name("libobs: source loader");
+	load_sources_work(param);
+	return NULL;
+}
+
+/*
+ *   Creating sources is where the time goes (plugin init, decoding images,
+ * etc), so sources of types that set OBS_SOURCE_THREADSAFE_CREATE are
+ * created on a few worker threads.  Every other source is created first on
+ * the calling thread, one after the other.  A source doesn't depend on any
+ * other source to be created: filters are created along with their parent,
+ * and scenes only look up their items when they're loaded.  Loading then
+ * happens on the calling thread in the original order once every source
+ * exists, so anything that changes the graph (scene items, transitions,
+ * load callbacks) stays serialized.
+ */
+static void create_sources(struct load_sources_data *load)
+{
+	pthread_t threads[MAX_LOAD_THREADS];
+	size_t num_threads = 0;
+	size_t max_threads;
+	int cores = os_get_logical_cores();
+
+	da_init(load->parallel);
+
+	for (size_t i = 0; i < load->count; i++) {
+		obs_data_t *source_data = obs_data_array_item(load->array, i);
+
+		if (threadsafe_create(source_data))
+			da_push_back(load->parallel, &i);
+		else
+			load_source_idx(load, i);
 
 		obs_data_release(source_data);
 	}
 
+	max_threads = load->parallel.num ? load->parallel.num - 1 : 0;
+	if (cores > 1 && (size_t)(cores - 1) < max_threads)
+		max_threads = (size_t)(cores - 1);
+	else if (cores <= 1)
+		max_threads = 0;
+	if (max_threads > MAX_LOAD_THREADS)
+		max_threads = MAX_LOAD_THREADS;
+
+	for (size_t i = 0; i < max_threads; i++) {
+		if (pthread_create(&threads[num_threads], NULL,
+				   load_sources_thread, load) == 0)
+			num_threads++;
+	}
+
+	load_sources_work(load);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	da_free(load->parallel);
+}
+
+void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb,
+		      void *private_data)
+{
+	struct obs_core_data *data = &obs->data;
+	struct load_sources_data load = {0};
+	size_t i;
+
+	load.array = array;
+	load.count = obs_data_array_count(array);
+	if (!load.count)
+		return;
+
+	load.sources = bzalloc(sizeof(obs_source_t *) * load.count);
+
+	create_sources(&load);
+
+	pthread_mutex_lock(&data->sources_mutex);
+
 	/* tell sources that we want to load */
-	for (i = 0; i < sources.num; i++) {
-		obs_source_t *source = sources.array[i];
+	for (i = 0; i < load.count; i++) {
+		obs_source_t *source = load.sources[i];
 		obs_data_t *source_data = obs_data_array_item(array, i);
 		if (source) {
 			if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
@@ -2070,12 +2251,12 @@ void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb,
 		obs_data_release(source_data);
 	}
 
-	for (i = 0; i < sources.num; i++)
-		obs_source_release(sources.array[i]);
+	for (i = 0; i < load.count; i++)
+		obs_source_release(load.sources[i]);
 
 	pthread_mutex_unlock(&data->sources_mutex);
 
-	da_free(sources);
+	bfree(load.sources);
 }
 
 obs_data_t *obs_save_source(obs_source_t *source)
@@ -2282,6 +2463,176 @@ void obs_context_data_free(struct obs_context_data *context)
 	memset(context, 0, sizeof(*context) - sizeof(pthread_mutex_t));
 }
 
+static inline uint64_t uuid_random(uint64_t *state)
+{
+	uint64_t val = (*state += 0x9E3779B97F4A7C15ULL);
+	val = (val ^ (val >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	val = (val ^ (val >> 27)) * 0x94D049BB133111EBULL;
+	return val ^ (val >> 31);
+}
+
+/* version 4 style UUID, only needs to be unique within the process */
+static void generate_uuid(struct obs_context_data *context)
+{
+	static volatile long counter = 0;
+	uint64_t state = os_gettime_ns() ^ (uint64_t)(uintptr_t)context ^
+			 ((uint64_t)os_atomic_inc_long(&counter) << 40);
+	uint64_t hi = uuid_random(&state);
+	uint64_t lo = uuid_random(&state);
+
+	hi = (hi & ~0xF000ULL) | 0x4000ULL;
+	lo = (lo & ~(0xCULL << 60)) | (0x8ULL << 60);
+
+	snprintf(context->uuid, sizeof(context->uuid),
+		 "%08x-%04x-%04x-%04x-%012llx", (uint32_t)(hi >> 32),
+		 (uint32_t)(hi >> 16) & 0xFFFF, (uint32_t)hi & 0xFFFF,
+		 (uint32_t)(lo >> 48),
+		 (unsigned long long)(lo & 0xFFFFFFFFFFFFULL));
+}
+
+static inline void index_name_add(struct obs_context_index *index,
+				  struct obs_context_data *context)
+{
+	struct obs_context_data **bucket;
+
+	/* private contexts can't be looked up by name */
+	if (context->private || !context->name)
+		return;
+
+	context->name_hash = str_hash(context->name);
+	bucket = &index->names[context->name_hash & (index->size - 1)];
+	context->name_next = *bucket;
+	*bucket = context;
+}
+
+static inline void index_uuid_add(struct obs_context_index *index,
+				  struct obs_context_data *context)
+{
+	struct obs_context_data **bucket =
+		&index->uuids[context->uuid_hash & (index->size - 1)];
+	context->uuid_next = *bucket;
+	*bucket = context;
+}
+
+static void index_name_remove(struct obs_context_index *index,
+			      struct obs_context_data *context)
+{
+	struct obs_context_data **prev_next;
+
+	if (context->private || !context->name)
+		return;
+
+	prev_next = &index->names[context->name_hash & (index->size - 1)];
+	while (*prev_next) {
+		if (*prev_next == context) {
+			*prev_next = context->name_next;
+			break;
+		}
+		prev_next = &(*prev_next)->name_next;
+	}
+
+	context->name_next = NULL;
+}
+
+static void index_uuid_remove(struct obs_context_index *index,
+			      struct obs_context_data *context)
+{
+	struct obs_context_data **prev_next =
+		&index->uuids[context->uuid_hash & (index->size - 1)];
+
+	while (*prev_next) {
+		if (*prev_next == context) {
+			*prev_next = context->uuid_next;
+			break;
+		}
+		prev_next = &(*prev_next)->uuid_next;
+	}
+
+	context->uuid_next = NULL;
+}
+
+static void index_resize(struct obs_context_index *index, size_t size)
+{
+	struct obs_context_data **names = index->names;
+	struct obs_context_data **uuids = index->uuids;
+	size_t old_size = index->size;
+
+	struct obs_context_data ***name_tails;
+
+	index->names = bzalloc(size * sizeof(struct obs_context_data *));
+	index->uuids = bzalloc(size * sizeof(struct obs_context_data *));
+	index->size = size;
+
+	for (size_t i = 0; i < old_size; i++) {
+		struct obs_context_data *context = uuids[i];
+
+		while (context) {
+			struct obs_context_data *next = context->uuid_next;
+			index_uuid_add(index, context);
+			context = next;
+		}
+	}
+
+	/* names are appended so duplicate names keep their order, and the
+	 * newest one is still found first */
+	name_tails = bmalloc(size * sizeof(struct obs_context_data **));
+	for (size_t i = 0; i < size; i++)
+		name_tails[i] = &index->names[i];
+
+	for (size_t i = 0; i < old_size; i++) {
+		struct obs_context_data *context = names[i];
+
+		while (context) {
+			struct obs_context_data *next = context->name_next;
+			size_t idx = context->name_hash & (size - 1);
+
+			context->name_next = NULL;
+			*name_tails[idx] = context;
+			name_tails[idx] = &context->name_next;
+			context = next;
+		}
+	}
+
+	bfree(name_tails);
+	bfree(names);
+	bfree(uuids);
+}
+
+static void obs_context_index_add(struct obs_context_data *context)
+{
+	struct obs_context_index *index = &obs->data.context_index;
+
+	generate_uuid(context);
+	context->uuid_hash = str_hash(context->uuid);
+
+	pthread_rwlock_wrlock(&index->lock);
+
+	if (++index->count > index->size)
+		index_resize(index, index->size ? index->size * 2 : 64);
+
+	index_uuid_add(index, context);
+	index_name_add(index, context);
+	context->indexed = true;
+
+	pthread_rwlock_unlock(&index->lock);
+}
+
+static void obs_context_index_remove(struct obs_context_data *context)
+{
+	struct obs_context_index *index = &obs->data.context_index;
+
+	pthread_rwlock_wrlock(&index->lock);
+
+	if (context->indexed) {
+		index_uuid_remove(index, context);
+		index_name_remove(index, context);
+		context->indexed = false;
+		index->count--;
+	}
+
+	pthread_rwlock_unlock(&index->lock);
+}
+
 void obs_context_data_insert(struct obs_context_data *context,
 			     pthread_mutex_t *mutex, void *pfirst)
 {
@@ -2300,10 +2651,15 @@ void obs_context_data_insert(struct obs_context_data *context,
 	if (context->next)
 		context->next->prev_next = &context->next;
 	pthread_mutex_unlock(mutex);
+
+	obs_context_index_add(context);
 }
 
 void obs_context_data_remove(struct obs_context_data *context)
 {
+	if (context && context->indexed)
+		obs_context_index_remove(context);
+
 	if (context && context->mutex) {
 		pthread_mutex_lock(context->mutex);
 		if (context->prev_next)
@@ -2319,13 +2675,24 @@ void obs_context_data_remove(struct obs_context_data *context)
 void obs_context_data_setname(struct obs_context_data *context,
 			      const char *name)
 {
+	struct obs_context_index *index = &obs->data.context_index;
+
+	pthread_rwlock_wrlock(&index->lock);
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
+	if (context->indexed)
+		index_name_remove(index, context);
+
+	/* the old name is kept around, other threads may still be using it */
 	if (context->name)
 		da_push_back(context->rename_cache, &context->name);
 	context->name = dup_name(name, context->private);
 
+	if (context->indexed)
+		index_name_add(index, context);
+
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+	pthread_rwlock_unlock(&index->lock);
 }
 
 profiler_name_store_t *obs_get_profiler_name_store(void)
@@ -2380,6 +2747,15 @@ const char *obs_obj_get_id(void *obj)
 	return NULL;
 }
 
+const char *obs_obj_get_uuid(void *obj)
+{
+	struct obs_context_data *context = obj;
+	if (!context || !*context->uuid)
+		return NULL;
+
+	return context->uuid;
+}
+
 bool obs_obj_invalid(void *obj)
 {
 	struct obs_context_data *context = obj;
@@ -664,6 +664,24 @@ EXPORT obs_encoder_t *obs_get_encoder_by_name(const char *name);
 /** Gets an service by its name. */
 EXPORT obs_service_t *obs_get_service_by_name(const char *name);
 
+/**
+ * Gets a source by its UUID.
+ *
+ *   UUIDs are generated when an object is created and are unique for the
+ * lifetime of the process.  Increments the source reference counter, use
+ * obs_source_release to release it when complete.
+ */
+EXPORT obs_source_t *obs_get_source_by_uuid(const char *uuid);
+
+/** Gets an output by its UUID. */
+EXPORT obs_output_t *obs_get_output_by_uuid(const char *uuid);
+
+/** Gets an encoder by its UUID. */
+EXPORT obs_encoder_t *obs_get_encoder_by_uuid(const char *uuid);
+
+/** Gets a service by its UUID. */
+EXPORT obs_service_t *obs_get_service_by_uuid(const char *uuid);
+
 enum obs_base_effect {
 	OBS_EFFECT_DEFAULT,         /**< RGB/YUV */
 	OBS_EFFECT_DEFAULT_RECT,    /**< RGB/YUV (using texture_rect) */
@@ -726,10 +744,10 @@ EXPORT void obs_set_video_rendering_mode(enum obs_video_rendering_mode mode);
 /** Gets current video rendering mode */
 EXPORT enum obs_video_rendering_mode obs_get_video_rendering_mode(void);
 
-/** Sets audio rendering mode*/
+/** Sets audio rendering mode of the calling thread */
 EXPORT void obs_set_audio_rendering_mode(enum obs_audio_rendering_mode mode);
 
-/** Gets current audio rendering mode */
+/** Gets the audio rendering mode of the calling thread */
 EXPORT enum obs_audio_rendering_mode obs_get_audio_rendering_mode(void);
 
 /** Set the replay buffer rendering mode*/
@@ -784,6 +802,7 @@ enum obs_obj_type {
 
 EXPORT enum obs_obj_type obs_obj_get_type(void *obj);
 EXPORT const char *obs_obj_get_id(void *obj);
+EXPORT const char *obs_obj_get_uuid(void *obj);
 EXPORT bool obs_obj_invalid(void *obj);
 EXPORT void *obs_obj_get_data(void *obj);
 EXPORT bool obs_obj_is_private(void *obj);
@@ -2245,6 +2264,31 @@ EXPORT uint32_t obs_encoder_get_height(const obs_encoder_t *encoder);
 /** For audio encoders, returns the sample rate of the audio */
 EXPORT uint32_t obs_encoder_get_sample_rate(const obs_encoder_t *encoder);
 
+/**
+ * For audio encoders, encodes on a worker thread of the encoder's own instead
+ * of the audio thread.  If the encoder is active, this function will trigger
+ * a warning, and do nothing.
+ */
+EXPORT void obs_encoder_set_audio_thread(obs_encoder_t *encoder, bool enable);
+
+/** For audio encoders, returns true if encoding on a worker thread */
+EXPORT bool obs_encoder_audio_thread_enabled(const obs_encoder_t *encoder);
+
+struct obs_encoder_stats {
+	uint64_t frames_encoded;
+	uint64_t total_encode_ns;
+	uint64_t max_encode_ns;
+
+	/* audio encoders on a worker thread only */
+	uint32_t queue_depth;
+	uint32_t max_queue_depth;
+	uint64_t queue_stalls;
+};
+
+/** Returns encode time and queue statistics since the encoder started */
+EXPORT bool obs_encoder_get_stats(obs_encoder_t *encoder,
+				  struct obs_encoder_stats *stats);
+
 /**
  * Sets the preferred video format for a video encoder.  If the encoder can use
  * the format specified, it will force a conversion to that format if the
@@ -2467,6 +2511,72 @@ static inline void obs_source_frame_destroy(struct obs_source_frame *frame)
 EXPORT void obs_source_frame_copy(struct obs_source_frame *dst,
 				  const struct obs_source_frame *src);
 
+struct obs_frame_pool_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bytes_resident;
+	size_t frames;
+};
+
+/** Gets statistics of the pool that async video frames are allocated from */
+EXPORT void obs_get_frame_pool_stats(struct obs_frame_pool_stats *stats);
+
+/* ------------------------------------------------------------------------- */
+/* Latency tracing */
+
+/**
+ * Points of the video pipeline that a frame passes through while latency
+ * tracing is enabled.  The histogram of a stage holds the time it took a
+ * frame to get there from the previous stage it went through, the histogram
+ * of OBS_LATENCY_TOTAL holds the time from capture (or render, for frames
+ * without an async source) until the packet was sent.
+ */
+enum obs_latency_stage {
+	OBS_LATENCY_CAPTURE,      /**< Frame output by an async source */
+	OBS_LATENCY_RENDER,       /**< Frame rendered by the video thread */
+	OBS_LATENCY_VIDEO_OUTPUT, /**< Raw frame handed to video outputs */
+	OBS_LATENCY_ENCODE,       /**< Raw frame received by an encoder */
+	OBS_LATENCY_INTERLEAVE,   /**< Packet interleaved by an output */
+	OBS_LATENCY_SEND,         /**< Packet sent by an output */
+	OBS_LATENCY_TOTAL,
+};
+
+#define OBS_LATENCY_STAGE_COUNT (OBS_LATENCY_TOTAL + 1)
+#define OBS_LATENCY_HISTOGRAM_BUCKETS 32
+
+struct obs_latency_histogram {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+
+	/** bucket i counts samples of [2^i, 2^(i+1)) microseconds, bucket 0
+	 * also counts anything shorter */
+	uint64_t buckets[OBS_LATENCY_HISTOGRAM_BUCKETS];
+};
+
+EXPORT void obs_latency_trace_enable(bool enable);
+EXPORT bool obs_latency_trace_enabled(void);
+
+/** Clears all histograms and recorded trace events */
+EXPORT void obs_latency_trace_reset(void);
+
+EXPORT bool obs_latency_get_histogram(enum obs_latency_stage stage,
+				      struct obs_latency_histogram *hist);
+
+/** Returns the upper bound of the bucket the given percentile (0.0-1.0)
+ * falls into, in nanoseconds */
+EXPORT uint64_t
+obs_latency_histogram_percentile(const struct obs_latency_histogram *hist,
+				 double percentile);
+
+/** Writes the most recent trace events as a Chrome trace JSON file */
+EXPORT bool obs_latency_trace_save(const char *path);
+
+/** Marks a packet stage, for outputs that send packets themselves */
+EXPORT void obs_latency_trace_packet(enum obs_latency_stage stage,
+				     const struct encoder_packet *packet);
+
 /* ------------------------------------------------------------------------- */
 /* Get source icon type */
 EXPORT enum obs_icon_type obs_source_get_icon_type(const char *id);
@@ -61,6 +61,19 @@ EXPORT wchar_t *wcsdepad(wchar_t *str);
 EXPORT char **strlist_split(const char *str, char split_ch, bool include_empty);
 EXPORT void strlist_free(char **strlist);
 
+/* FNV-1a hash of a string, for indexing things by name */
+static inline uint32_t str_hash(const char *str)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (uint8_t)*(str++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
 static inline void dstr_init(struct dstr *dst);
 static inline void dstr_init_move(struct dstr *dst, struct dstr *src);
 static inline void dstr_init_move_array(struct dstr *dst, char *str);
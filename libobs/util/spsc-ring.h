@@ -0,0 +1,168 @@
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+#include <stdlib.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free single-producer/single-consumer ring buffer of fixed-size
+ * elements.
+ *
+ * One thread at a time may push, peek and revoke (the producer), and one
+ * thread at a time may pop (the consumer).  Neither side ever waits on the
+ * other.  Capacity is fixed at init time and rounded up to a power of two.
+ *
+ * Positions are free-running counters; use spsc_ring_begin/spsc_ring_end to
+ * walk the queued elements from the producer side.  An element that the
+ * consumer has not taken yet can be revoked by the producer, which is how
+ * outputs drop queued frames without stalling the send thread.
+ */
+
+enum spsc_slot_state {
+	SPSC_SLOT_QUEUED,
+	SPSC_SLOT_REVOKED,
+	SPSC_SLOT_TAKEN,
+};
+
+struct spsc_ring {
+	uint8_t *data;
+	volatile long *states;
+	size_t element_size;
+	size_t capacity;
+	size_t mask;
+
+	/* head is only written by the consumer, tail only by the producer */
+	volatile long head;
+	volatile long tail;
+};
+
+static inline void spsc_ring_init(struct spsc_ring *ring, size_t element_size,
+				  size_t capacity)
+{
+	size_t new_capacity = 1;
+	while (new_capacity < capacity)
+		new_capacity <<= 1;
+
+	memset(ring, 0, sizeof(struct spsc_ring));
+	ring->element_size = element_size;
+	ring->capacity = new_capacity;
+	ring->mask = new_capacity - 1;
+	ring->data = (uint8_t *)bzalloc(new_capacity * element_size);
+	ring->states = (volatile long *)bzalloc(new_capacity * sizeof(long));
+}
+
+static inline void spsc_ring_free(struct spsc_ring *ring)
+{
+	bfree(ring->data);
+	bfree((void *)ring->states);
+	memset(ring, 0, sizeof(struct spsc_ring));
+}
+
+static inline void *spsc_ring_slot(const struct spsc_ring *ring,
+				   unsigned long pos)
+{
+	return ring->data + (size_t)(pos & ring->mask) * ring->element_size;
+}
+
+/* number of elements pushed but not yet popped, including revoked ones */
+static inline size_t spsc_ring_size(const struct spsc_ring *ring)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	return (size_t)(tail - head);
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer side */
+
+static inline bool spsc_ring_push_back(struct spsc_ring *ring,
+				       const void *item)
+{
+	unsigned long tail = (unsigned long)ring->tail;
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	size_t idx = (size_t)(tail & ring->mask);
+
+	if ((size_t)(tail - head) >= ring->capacity)
+		return false;
+
+	memcpy(spsc_ring_slot(ring, tail), item, ring->element_size);
+	os_atomic_store_long(&ring->states[idx], SPSC_SLOT_QUEUED);
+	os_atomic_store_long(&ring->tail, (long)(tail + 1));
+	return true;
+}
+
+static inline unsigned long spsc_ring_begin(const struct spsc_ring *ring)
+{
+	return (unsigned long)os_atomic_load_long(&ring->head);
+}
+
+static inline unsigned long spsc_ring_end(const struct spsc_ring *ring)
+{
+	return (unsigned long)ring->tail;
+}
+
+/* returns the element at pos, or NULL if it was taken or revoked.  the
+ * returned memory stays valid until the producer pushes again, even if the
+ * consumer takes the element in the meantime */
+static inline void *spsc_ring_peek(const struct spsc_ring *ring,
+				   unsigned long pos)
+{
+	size_t idx = (size_t)(pos & ring->mask);
+
+	if (os_atomic_load_long(&ring->states[idx]) != SPSC_SLOT_QUEUED)
+		return NULL;
+	return spsc_ring_slot(ring, pos);
+}
+
+/* takes an element back before the consumer gets to it.  on success the
+ * element is copied to item and the consumer will skip it */
+static inline bool spsc_ring_revoke(struct spsc_ring *ring, unsigned long pos,
+				    void *item)
+{
+	size_t idx = (size_t)(pos & ring->mask);
+
+	if (!os_atomic_compare_swap_long(&ring->states[idx], SPSC_SLOT_QUEUED,
+					 SPSC_SLOT_REVOKED))
+		return false;
+
+	if (item)
+		memcpy(item, spsc_ring_slot(ring, pos), ring->element_size);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer side */
+
+static inline bool spsc_ring_pop_front(struct spsc_ring *ring, void *item)
+{
+	unsigned long head = (unsigned long)ring->head;
+
+	while (head != (unsigned long)os_atomic_load_long(&ring->tail)) {
+		size_t idx = (size_t)(head & ring->mask);
+		long state = os_atomic_set_long(&ring->states[idx],
+						SPSC_SLOT_TAKEN);
+		bool revoked = state == SPSC_SLOT_REVOKED;
+
+		if (!revoked && item)
+			memcpy(item, spsc_ring_slot(ring, head),
+			       ring->element_size);
+
+		os_atomic_store_long(&ring->head, (long)++head);
+
+		if (!revoked)
+			return true;
+	}
+
+	return false;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,381 @@
+#include "image-cache.h"
+
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+
+#define IMAGE_CACHE_BUDGET_MB 256
+#define BYTES_TO_MBYTES (1024 * 1024)
+
+struct image_cache_entry {
+	char *path;
+	time_t mtime;
+	enum gs_image_alpha_mode alpha_mode;
+
+	/* protected by the cache mutex */
+	long refs;
+	uint64_t hits;
+	uint64_t mem_usage;
+
+	/* held while decoding and creating the texture, so sources showing
+	 * the same file at the same time only decode it once */
+	pthread_mutex_t mutex;
+	bool decoded;
+	gs_image_file3_t if3;
+};
+
+struct image_cache {
+	pthread_mutex_t mutex;
+
+	/* most recently used first */
+	DARRAY(struct image_cache_entry *) entries;
+
+	uint64_t mem_usage;
+	uint64_t budget;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+
+	/* set once the module is unloaded.  sources that are still alive at
+	 * that point free their entries when they release them, and the last
+	 * one frees the cache */
+	bool closed;
+};
+
+static struct image_cache cache;
+
+static void entry_destroy(struct image_cache_entry *entry)
+{
+	obs_enter_graphics();
+	gs_image_file3_free(&entry->if3);
+	obs_leave_graphics();
+
+	pthread_mutex_destroy(&entry->mutex);
+	bfree(entry->path);
+	bfree(entry);
+}
+
+static inline bool entry_matches(struct image_cache_entry *entry,
+				 const char *path, time_t mtime,
+				 enum gs_image_alpha_mode alpha_mode)
+{
+	return entry->mtime == mtime && entry->alpha_mode == alpha_mode &&
+	       strcmp(entry->path, path) == 0;
+}
+
+/* removes unused entries from the back of the list until the cache fits its
+ * budget.  the removed entries are freed by the caller once the cache mutex
+ * is released, freeing them needs the graphics context. */
+static void evict_entries(struct darray *evicted)
+{
+	DARRAY(struct image_cache_entry *) victims;
+	victims.da = *evicted;
+
+	for (size_t i = cache.entries.num; i > 0; i--) {
+		struct image_cache_entry *entry = cache.entries.array[i - 1];
+
+		if (cache.mem_usage <= cache.budget)
+			break;
+		if (entry->refs)
+			continue;
+
+		cache.mem_usage -= entry->mem_usage;
+		cache.evictions++;
+		da_erase(cache.entries, i - 1);
+		da_push_back(victims, &entry);
+	}
+
+	*evicted = victims.da;
+}
+
+static void free_evicted(struct darray *evicted)
+{
+	DARRAY(struct image_cache_entry *) victims;
+	victims.da = *evicted;
+
+	for (size_t i = 0; i < victims.num; i++)
+		entry_destroy(victims.array[i]);
+
+	da_free(victims);
+}
+
+/* gifs may be animated, which is only known once they're decoded */
+static inline bool can_cache(const char *path)
+{
+	const char *ext = os_get_path_extension(path);
+	return !ext || astrcmpi(ext, ".gif") != 0;
+}
+
+/* unused entries of a file that has changed since can never be hit again */
+static void evict_stale_entries(const char *path, time_t mtime,
+				struct darray *evicted)
+{
+	DARRAY(struct image_cache_entry *) victims;
+	victims.da = *evicted;
+
+	for (size_t i = cache.entries.num; i > 0; i--) {
+		struct image_cache_entry *entry = cache.entries.array[i - 1];
+
+		if (entry->refs || entry->mtime == mtime ||
+		    strcmp(entry->path, path) != 0)
+			continue;
+
+		cache.mem_usage -= entry->mem_usage;
+		cache.evictions++;
+		da_erase(cache.entries, i - 1);
+		da_push_back(victims, &entry);
+	}
+
+	*evicted = victims.da;
+}
+
+static struct image_cache_entry *get_entry(const char *path, time_t mtime,
+					   enum gs_image_alpha_mode alpha_mode)
+{
+	DARRAY(struct image_cache_entry *) evicted;
+	struct image_cache_entry *entry = NULL;
+
+	da_init(evicted);
+
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.closed) {
+		pthread_mutex_unlock(&cache.mutex);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < cache.entries.num; i++) {
+		struct image_cache_entry *cur = cache.entries.array[i];
+
+		if (entry_matches(cur, path, mtime, alpha_mode)) {
+			da_erase(cache.entries, i);
+			entry = cur;
+			break;
+		}
+	}
+
+	if (entry) {
+		entry->hits++;
+		cache.hits++;
+	} else {
+		evict_stale_entries(path, mtime, &evicted.da);
+
+		entry = bzalloc(sizeof(*entry));
+		entry->path = bstrdup(path);
+		entry->mtime = mtime;
+		entry->alpha_mode = alpha_mode;
+		pthread_mutex_init(&entry->mutex, NULL);
+		cache.misses++;
+	}
+
+	entry->refs++;
+	da_insert(cache.entries, 0, &entry);
+
+	pthread_mutex_unlock(&cache.mutex);
+
+	free_evicted(&evicted.da);
+	return entry;
+}
+
+static void decode_entry(struct image_cache_entry *entry)
+{
+	gs_image_file_t *image = &entry->if3.image2.image;
+	bool decoded;
+
+	pthread_mutex_lock(&entry->mutex);
+	decoded = !entry->decoded;
+	if (decoded) {
+		gs_image_file3_init(&entry->if3, entry->path,
+				    entry->alpha_mode);
+		entry->decoded = true;
+	}
+	pthread_mutex_unlock(&entry->mutex);
+
+	if (decoded) {
+		DARRAY(struct image_cache_entry *) evicted;
+		da_init(evicted);
+
+		pthread_mutex_lock(&cache.mutex);
+		entry->mem_usage = entry->if3.image2.mem_usage;
+		cache.mem_usage += entry->mem_usage;
+		evict_entries(&evicted.da);
+		pthread_mutex_unlock(&cache.mutex);
+
+		free_evicted(&evicted.da);
+	}
+
+	obs_enter_graphics();
+	pthread_mutex_lock(&entry->mutex);
+	if (image->loaded && !image->texture)
+		gs_image_file3_init_texture(&entry->if3);
+	pthread_mutex_unlock(&entry->mutex);
+	obs_leave_graphics();
+}
+
+struct image_cache_entry *image_cache_get(const char *path, time_t mtime,
+					  enum gs_image_alpha_mode alpha_mode)
+{
+	struct image_cache_entry *entry;
+
+	if (!path || !*path || !can_cache(path))
+		return NULL;
+
+	entry = get_entry(path, mtime, alpha_mode);
+	if (!entry)
+		return NULL;
+
+	decode_entry(entry);
+
+	if (!entry->if3.image2.image.loaded) {
+		image_cache_release(entry, false);
+		return NULL;
+	}
+
+	return entry;
+}
+
+static void cache_destroy(void)
+{
+	da_free(cache.entries);
+	pthread_mutex_destroy(&cache.mutex);
+}
+
+void image_cache_release(struct image_cache_entry *entry, bool evict)
+{
+	DARRAY(struct image_cache_entry *) evicted;
+	bool destroy = false;
+	bool destroy_cache;
+
+	if (!entry)
+		return;
+
+	da_init(evicted);
+
+	pthread_mutex_lock(&cache.mutex);
+
+	/* files that failed to load aren't kept */
+	if (--entry->refs == 0 &&
+	    (evict || cache.closed || !entry->if3.image2.image.loaded)) {
+		da_erase_item(cache.entries, &entry);
+		cache.mem_usage -= entry->mem_usage;
+		if (evict && entry->if3.image2.image.loaded)
+			cache.evictions++;
+		destroy = true;
+	}
+
+	evict_entries(&evicted.da);
+	destroy_cache = cache.closed && !cache.entries.num;
+	pthread_mutex_unlock(&cache.mutex);
+
+	if (destroy)
+		entry_destroy(entry);
+	free_evicted(&evicted.da);
+
+	if (destroy_cache)
+		cache_destroy();
+}
+
+gs_image_file_t *image_cache_entry_image(struct image_cache_entry *entry)
+{
+	return &entry->if3.image2.image;
+}
+
+uint64_t image_cache_entry_memory(struct image_cache_entry *entry)
+{
+	return entry->mem_usage;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void get_stats_proc(void *param, calldata_t *cd)
+{
+	pthread_mutex_lock(&cache.mutex);
+	calldata_set_int(cd, "entries", (long long)cache.entries.num);
+	calldata_set_int(cd, "memory", (long long)cache.mem_usage);
+	calldata_set_int(cd, "hits", (long long)cache.hits);
+	calldata_set_int(cd, "misses", (long long)cache.misses);
+	calldata_set_int(cd, "evictions", (long long)cache.evictions);
+	pthread_mutex_unlock(&cache.mutex);
+
+	UNUSED_PARAMETER(param);
+}
+
+static void log_stats(void)
+{
+	blog(LOG_INFO,
+	     "[image cache] %zu entries using %" PRIu64 " bytes, %" PRIu64
+	     " hits, %" PRIu64 " misses, %" PRIu64 " evictions",
+	     cache.entries.num, cache.mem_usage, cache.hits, cache.misses,
+	     cache.evictions);
+
+	for (size_t i = 0; i < cache.entries.num; i++) {
+		struct image_cache_entry *entry = cache.entries.array[i];
+
+		blog(LOG_INFO,
+		     "[image cache]     '%s': %" PRIu64 " bytes, %" PRIu64
+		     " hits, %ld users",
+		     entry->path, entry->mem_usage, entry->hits, entry->refs);
+	}
+}
+
+static void log_stats_proc(void *param, calldata_t *cd)
+{
+	pthread_mutex_lock(&cache.mutex);
+	log_stats();
+	pthread_mutex_unlock(&cache.mutex);
+
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(cd);
+}
+
+void image_cache_init(void)
+{
+	proc_handler_t *ph = obs_get_proc_handler();
+
+	pthread_mutex_init(&cache.mutex, NULL);
+	da_init(cache.entries);
+	cache.budget = (uint64_t)IMAGE_CACHE_BUDGET_MB * BYTES_TO_MBYTES;
+
+	proc_handler_add(ph,
+			 "void image_cache_get_stats(out int entries, "
+			 "out int memory, out int hits, out int misses, "
+			 "out int evictions)",
+			 get_stats_proc, NULL);
+	proc_handler_add(ph, "void image_cache_log_stats()", log_stats_proc,
+			 NULL);
+}
+
+/* sources are only destroyed after modules are unloaded, so entries that are
+ * still in use are freed when they're released */
+void image_cache_free(void)
+{
+	DARRAY(struct image_cache_entry *) unused;
+	bool destroy_cache;
+
+	da_init(unused);
+
+	pthread_mutex_lock(&cache.mutex);
+
+	log_stats();
+	cache.closed = true;
+
+	for (size_t i = cache.entries.num; i > 0; i--) {
+		struct image_cache_entry *entry = cache.entries.array[i - 1];
+
+		if (entry->refs)
+			continue;
+
+		cache.mem_usage -= entry->mem_usage;
+		da_erase(cache.entries, i - 1);
+		da_push_back(unused, &entry);
+	}
+
+	destroy_cache = !cache.entries.num;
+	pthread_mutex_unlock(&cache.mutex);
+
+	free_evicted(&unused.da);
+
+	if (destroy_cache)
+		cache_destroy();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <obs-module.h>
+#include <graphics/image-file.h>
+
+/*
+ * Decoded images and their textures shared between every image source that
+ * shows the same file.  Entries are keyed on the path, modification time and
+ * alpha mode, and unused ones are kept around until the cache goes over its
+ * memory budget, least recently used first.
+ *
+ * Only still images are cached, animated gifs keep their own playback state
+ * so every source decodes its own.
+ */
+
+struct image_cache_entry;
+
+extern void image_cache_init(void);
+
+/* entries that are still in use are freed once they're released */
+extern void image_cache_free(void);
+
+/* returns a new reference, decoding the file and creating its texture if
+ * needed.  returns NULL for gifs and files that fail to load. */
+extern struct image_cache_entry *
+image_cache_get(const char *path, time_t mtime,
+		enum gs_image_alpha_mode alpha_mode);
+
+/* evict frees the entry right away if this was its last reference, for
+ * sources that unload their image when they're not showing */
+extern void image_cache_release(struct image_cache_entry *entry, bool evict);
+
+extern gs_image_file_t *
+image_cache_entry_image(struct image_cache_entry *entry);
+extern uint64_t image_cache_entry_memory(struct image_cache_entry *entry);
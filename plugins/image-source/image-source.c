@@ -4,6 +4,8 @@
 #include <util/dstr.h>
 #include <sys/stat.h>
 
+#include "image-cache.h"
+
 #define blog(log_level, format, ...)                    \
 	blog(log_level, "[image_source: '%s'] " format, \
 	     obs_source_get_name(context->source), ##__VA_ARGS__)
@@ -12,6 +14,9 @@
 #define info(format, ...) blog(LOG_INFO, format, ##__VA_ARGS__)
 #define warn(format, ...) blog(LOG_WARNING, format, ##__VA_ARGS__)
 
+/* animations larger than this once decoded are decoded during playback */
+#define DEFAULT_GIF_CACHE_MB 64
+
 struct image_source {
 	obs_source_t *source;
 
@@ -23,9 +28,20 @@ struct image_source {
 	uint64_t last_time;
 	bool active;
 
-	gs_image_file3_t if3;
+	uint64_t gif_cache_budget;
+
+	/* still images are shared with every source showing the same file,
+	 * gifs are loaded into if4 */
+	struct image_cache_entry *cached;
+	gs_image_file4_t if4;
 };
 
+static inline gs_image_file_t *get_image(struct image_source *context)
+{
+	return context->cached ? image_cache_entry_image(context->cached)
+			       : &context->if4.image3.image2.image;
+}
+
 static time_t get_modified_timestamp(const char *filename)
 {
 	struct stat stats;
@@ -40,51 +56,61 @@ static const char *image_source_get_name(void *unused)
 	return obs_module_text("ImageInput");
 }
 
-static void image_source_load(struct image_source *context)
+static void image_source_unload(struct image_source *context)
 {
-	char *file = context->file;
+	image_cache_release(context->cached, !context->persistent);
+	context->cached = NULL;
 
 	obs_enter_graphics();
-	gs_image_file3_free(&context->if3);
+	gs_image_file4_free(&context->if4);
 	obs_leave_graphics();
+}
+
+static void image_source_load(struct image_source *context)
+{
+	enum gs_image_alpha_mode alpha_mode =
+		context->linear_alpha ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
+				      : GS_IMAGE_ALPHA_PREMULTIPLY;
+	char *file = context->file;
+
+	image_source_unload(context);
 
 	if (file && *file) {
 		debug("loading texture '%s'", file);
 		context->file_timestamp = get_modified_timestamp(file);
-		gs_image_file3_init(&context->if3, file,
-				    context->linear_alpha
-					    ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
-					    : GS_IMAGE_ALPHA_PREMULTIPLY);
 		context->update_time_elapsed = 0;
 
+		context->cached = image_cache_get(
+			file, context->file_timestamp, alpha_mode);
+		if (context->cached)
+			return;
+
+		gs_image_file4_init(&context->if4, file, alpha_mode,
+				    context->gif_cache_budget);
+
 		obs_enter_graphics();
-		gs_image_file3_init_texture(&context->if3);
+		gs_image_file4_init_texture(&context->if4);
 		obs_leave_graphics();
 
-		if (!context->if3.image2.image.loaded)
+		if (!context->if4.image3.image2.image.loaded)
 			warn("failed to load texture '%s'", file);
 	}
 }
 
-static void image_source_unload(struct image_source *context)
-{
-	obs_enter_graphics();
-	gs_image_file3_free(&context->if3);
-	obs_leave_graphics();
-}
-
 static void image_source_update(void *data, obs_data_t *settings)
 {
 	struct image_source *context = data;
 	const char *file = obs_data_get_string(settings, "file");
 	const bool unload = obs_data_get_bool(settings, "unload");
 	const bool linear_alpha = obs_data_get_bool(settings, "linear_alpha");
+	const int budget_mb = (int)obs_data_get_int(settings, "gif_cache_mb");
 
 	if (context->file)
 		bfree(context->file);
 	context->file = bstrdup(file);
 	context->persistent = !unload;
 	context->linear_alpha = linear_alpha;
+	context->gif_cache_budget = (uint64_t)budget_mb * 1024 * 1024;
 
 	/* Load the image if the source is persistent or showing */
 	if (context->persistent || obs_source_showing(context->source))
@@ -97,6 +123,8 @@ static void image_source_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, "unload", false);
 	obs_data_set_default_bool(settings, "linear_alpha", false);
+	obs_data_set_default_int(settings, "gif_cache_mb",
+				 DEFAULT_GIF_CACHE_MB);
 }
 
 static void image_source_show(void *data)
@@ -138,20 +166,21 @@ static void image_source_destroy(void *data)
 static uint32_t image_source_getwidth(void *data)
 {
 	struct image_source *context = data;
-	return context->if3.image2.image.cx;
+	return get_image(context)->cx;
 }
 
 static uint32_t image_source_getheight(void *data)
 {
 	struct image_source *context = data;
-	return context->if3.image2.image.cy;
+	return get_image(context)->cy;
 }
 
 static void image_source_render(void *data, gs_effect_t *effect)
 {
 	struct image_source *context = data;
+	gs_image_file_t *image = get_image(context);
 
-	if (!context->if3.image2.image.texture)
+	if (!image->texture)
 		return;
 
 	const bool previous = gs_framebuffer_srgb_enabled();
@@ -161,11 +190,9 @@ static void image_source_render(void *data, gs_effect_t *effect)
 	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
 
 	gs_eparam_t *const param = gs_effect_get_param_by_name(effect, "image");
-	gs_effect_set_texture_srgb(param, context->if3.image2.image.texture);
+	gs_effect_set_texture_srgb(param, image->texture);
 
-	gs_draw_sprite(context->if3.image2.image.texture, 0,
-		       context->if3.image2.image.cx,
-		       context->if3.image2.image.cy);
+	gs_draw_sprite(image->texture, 0, image->cx, image->cy);
 
 	gs_blend_state_pop();
 
@@ -175,6 +202,7 @@ static void image_source_render(void *data, gs_effect_t *effect)
 static void image_source_tick(void *data, float seconds)
 {
 	struct image_source *context = data;
+	gs_image_file_t *image = &context->if4.image3.image2.image;
 	uint64_t frame_time = obs_get_video_frame_time();
 
 	context->update_time_elapsed += seconds;
@@ -192,20 +220,18 @@ static void image_source_tick(void *data, float seconds)
 
 	if (obs_source_active(context->source)) {
 		if (!context->active) {
-			if (context->if3.image2.image.is_animated_gif)
+			if (image->is_animated_gif)
 				context->last_time = frame_time;
 			context->active = true;
 		}
 
 	} else {
 		if (context->active) {
-			if (context->if3.image2.image.is_animated_gif) {
-				context->if3.image2.image.cur_frame = 0;
-				context->if3.image2.image.cur_loop = 0;
-				context->if3.image2.image.cur_time = 0;
+			if (image->is_animated_gif) {
+				gs_image_file4_reset(&context->if4);
 
 				obs_enter_graphics();
-				gs_image_file3_update_texture(&context->if3);
+				gs_image_file4_update_texture(&context->if4);
 				obs_leave_graphics();
 			}
 
@@ -215,13 +241,13 @@ static void image_source_tick(void *data, float seconds)
 		return;
 	}
 
-	if (context->last_time && context->if3.image2.image.is_animated_gif) {
+	if (context->last_time && image->is_animated_gif) {
 		uint64_t elapsed = frame_time - context->last_time;
-		bool updated = gs_image_file3_tick(&context->if3, elapsed);
+		bool updated = gs_image_file4_tick(&context->if4, elapsed);
 
 		if (updated) {
 			obs_enter_graphics();
-			gs_image_file3_update_texture(&context->if3);
+			gs_image_file4_update_texture(&context->if4);
 			obs_leave_graphics();
 		}
 	}
@@ -263,6 +289,8 @@ static obs_properties_t *image_source_properties(void *data)
 				obs_module_text("UnloadWhenNotShowing"));
 	obs_properties_add_bool(props, "linear_alpha",
 				obs_module_text("LinearAlpha"));
+	obs_properties_add_int(props, "gif_cache_mb",
+			       obs_module_text("GifCacheSize"), 0, 4096, 16);
 	dstr_free(&path);
 
 	return props;
@@ -271,7 +299,9 @@ static obs_properties_t *image_source_properties(void *data)
 uint64_t image_source_get_memory_usage(void *data)
 {
 	struct image_source *s = data;
-	return s->if3.image2.mem_usage;
+	if (s->cached)
+		return image_cache_entry_memory(s->cached);
+	return s->if4.image3.image2.mem_usage;
 }
 
 static void missing_file_callback(void *src, const char *new_path, void *data)
@@ -308,7 +338,8 @@ static obs_missing_files_t *image_source_missingfiles(void *data)
 static struct obs_source_info image_source_info = {
 	.id = "image_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB |
+			OBS_SOURCE_THREADSAFE_CREATE,
 	.get_name = image_source_get_name,
 	.create = image_source_create,
 	.destroy = image_source_destroy,
@@ -339,6 +370,7 @@ extern struct obs_source_info color_source_info_v3;
 
 bool obs_module_load(void)
 {
+	image_cache_init();
 	obs_register_source(&image_source_info);
 	obs_register_source(&color_source_info_v1);
 	obs_register_source(&color_source_info_v2);
@@ -346,3 +378,8 @@ bool obs_module_load(void)
 	obs_register_source(&slideshow_info);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	image_cache_free();
+}
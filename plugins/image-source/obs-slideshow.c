@@ -27,6 +27,8 @@
 #define S_MODE                         "slide_mode"
 #define S_MODE_AUTO                    "mode_auto"
 #define S_MODE_MANUAL                  "mode_manual"
+#define S_LAZY_LOAD                    "lazy_load"
+#define S_PRELOAD_COUNT                "preload_count"
 
 #define TR_CUT                         "cut"
 #define TR_FADE                        "fade"
@@ -50,6 +52,8 @@
 #define T_MODE                         T_("SlideMode")
 #define T_MODE_AUTO                    T_("SlideMode.Auto")
 #define T_MODE_MANUAL                  T_("SlideMode.Manual")
+#define T_LAZY_LOAD                    T_("LazyLoad")
+#define T_PRELOAD_COUNT                T_("PreloadCount")
 
 #define T_TR_(text) obs_module_text("SlideShow.Transition." text)
 #define T_TR_CUT                       T_TR_("Cut")
@@ -80,6 +84,10 @@ enum behavior {
 struct slideshow {
 	obs_source_t *source;
 
+	/* the loader thread holds its own reference, so the source can be
+	 * destroyed without waiting for it */
+	volatile long refs;
+
 	bool randomize;
 	bool loop;
 	bool restart_on_activate;
@@ -98,6 +106,20 @@ struct slideshow {
 	float elapsed;
 	size_t cur_item;
 
+	/* lazy loading only keeps the previous, current and upcoming slides
+	 * loaded, the loader thread creates and releases their sources */
+	bool lazy_load;
+	size_t preload_count;
+	size_t prev_item;
+	DARRAY(size_t) upcoming;
+	long files_gen;
+	bool pending_transition;
+	bool pending_cut;
+
+	bool load_thread_active;
+	os_sem_t *load_sem;
+	volatile bool stop_loading;
+
 	uint32_t cx;
 	uint32_t cy;
 	uint64_t mem_usage;
@@ -160,6 +182,20 @@ static obs_source_t *get_source(struct darray *array, const char *path)
 	return source;
 }
 
+static obs_source_t *get_item_source(struct slideshow *ss, size_t item)
+{
+	obs_source_t *source = NULL;
+
+	pthread_mutex_lock(&ss->mutex);
+	if (item < ss->files.num) {
+		source = ss->files.array[item].source;
+		obs_source_addref(source);
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	return source;
+}
+
 static obs_source_t *create_source_from_file(const char *file)
 {
 	obs_data_t *settings = obs_data_create();
@@ -191,6 +227,231 @@ static inline size_t random_file(struct slideshow *ss)
 	return (size_t)rand() % ss->files.num;
 }
 
+/* ------------------------------------------------------------------------- */
+/* upcoming slides                                                           */
+
+static inline bool get_next_item(struct slideshow *ss, size_t item,
+				 size_t *next)
+{
+	if (ss->randomize) {
+		*next = item;
+		if (ss->files.num > 1) {
+			while (*next == item)
+				*next = random_file(ss);
+		}
+		return true;
+	}
+
+	if (item + 1 < ss->files.num) {
+		*next = item + 1;
+		return true;
+	}
+
+	*next = 0;
+	return ss->loop;
+}
+
+/* plans the slides after the current one in advance, so that the loader
+ * knows what to preload even when playback is randomized */
+static void plan_upcoming(struct slideshow *ss)
+{
+	size_t count = ss->lazy_load ? ss->preload_count : 1;
+
+	if (!ss->files.num)
+		return;
+
+	while (ss->upcoming.num < count) {
+		size_t last = ss->upcoming.num ? *(size_t *)da_end(ss->upcoming)
+					       : ss->cur_item;
+		size_t next;
+
+		if (!get_next_item(ss, last, &next))
+			break;
+		da_push_back(ss->upcoming, &next);
+	}
+}
+
+static size_t take_next_item(struct slideshow *ss)
+{
+	size_t next;
+
+	pthread_mutex_lock(&ss->mutex);
+	plan_upcoming(ss);
+	if (ss->upcoming.num)
+		next = ss->upcoming.array[0];
+	else
+		get_next_item(ss, ss->cur_item, &next);
+	pthread_mutex_unlock(&ss->mutex);
+
+	return next;
+}
+
+static void set_cur_item(struct slideshow *ss, size_t item)
+{
+	pthread_mutex_lock(&ss->mutex);
+
+	if (ss->upcoming.num && ss->upcoming.array[0] == item)
+		da_erase(ss->upcoming, 0);
+	else
+		da_resize(ss->upcoming, 0);
+
+	ss->prev_item = ss->cur_item;
+	ss->cur_item = item;
+	plan_upcoming(ss);
+
+	pthread_mutex_unlock(&ss->mutex);
+
+	if (ss->lazy_load)
+		os_sem_post(ss->load_sem);
+}
+
+/* ------------------------------------------------------------------------- */
+/* lazy loading                                                              */
+
+static inline bool item_wanted(struct slideshow *ss, size_t item)
+{
+	if (item == ss->cur_item || item == ss->prev_item)
+		return true;
+
+	for (size_t i = 0; i < ss->upcoming.num; i++) {
+		if (ss->upcoming.array[i] == item)
+			return true;
+	}
+
+	return false;
+}
+
+/* the current slide is loaded first, then the upcoming ones in order */
+static bool find_item_to_load(struct slideshow *ss, size_t *item)
+{
+	if (ss->cur_item < ss->files.num &&
+	    !ss->files.array[ss->cur_item].source) {
+		*item = ss->cur_item;
+		return true;
+	}
+
+	for (size_t i = 0; i < ss->upcoming.num; i++) {
+		size_t cur = ss->upcoming.array[i];
+
+		if (cur < ss->files.num && !ss->files.array[cur].source) {
+			*item = cur;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* loads one missing slide and releases the ones that are no longer needed,
+ * returns false once there is nothing left to do */
+static bool update_loaded_slides(struct slideshow *ss)
+{
+	DARRAY(obs_source_t *) unused;
+	obs_source_t *source = NULL;
+	char *path = NULL;
+	size_t item = 0;
+	long gen;
+
+	da_init(unused);
+
+	pthread_mutex_lock(&ss->mutex);
+
+	/* lazy loading may have been turned off in the meantime */
+	if (!ss->lazy_load) {
+		pthread_mutex_unlock(&ss->mutex);
+		return false;
+	}
+
+	for (size_t i = 0; i < ss->files.num; i++) {
+		struct image_file_data *file = &ss->files.array[i];
+
+		if (file->source && !item_wanted(ss, i)) {
+			da_push_back(unused, &file->source);
+			file->source = NULL;
+		}
+	}
+
+	if (find_item_to_load(ss, &item))
+		path = bstrdup(ss->files.array[item].path);
+	gen = ss->files_gen;
+
+	pthread_mutex_unlock(&ss->mutex);
+
+	for (size_t i = 0; i < unused.num; i++)
+		obs_source_release(unused.array[i]);
+	da_free(unused);
+
+	if (!path)
+		return false;
+
+	source = create_source_from_file(path);
+	bfree(path);
+
+	pthread_mutex_lock(&ss->mutex);
+	if (gen == ss->files_gen && !ss->files.array[item].source) {
+		ss->files.array[item].source = source;
+		source = NULL;
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	obs_source_release(source);
+	return true;
+}
+
+static void ss_release(struct slideshow *ss)
+{
+	if (os_atomic_dec_long(&ss->refs) == 0) {
+		free_files(&ss->files.da);
+		da_free(ss->upcoming);
+		os_sem_destroy(ss->load_sem);
+		pthread_mutex_destroy(&ss->mutex);
+		bfree(ss);
+	}
+}
+
+static void *load_thread(void *data)
+{
+	struct slideshow *ss = data;
+
+	os_set_thread_name("slideshow: loader");
+
+	while (os_sem_wait(ss->load_sem) == 0) {
+		if (os_atomic_load_bool(&ss->stop_loading))
+			break;
+
+		while (!os_atomic_load_bool(&ss->stop_loading) &&
+		       update_loaded_slides(ss))
+			;
+	}
+
+	ss_release(ss);
+	return NULL;
+}
+
+/* the loader is only needed once lazy loading is turned on.  it's detached,
+ * as the source may be destroyed on the graphics thread while the loader is
+ * waiting to create or release a slide */
+static bool start_loader(struct slideshow *ss)
+{
+	pthread_t thread;
+
+	if (ss->load_thread_active)
+		return true;
+
+	if (!ss->load_sem && os_sem_init(&ss->load_sem, 0) != 0)
+		return false;
+
+	os_atomic_inc_long(&ss->refs);
+	if (pthread_create(&thread, NULL, load_thread, ss) != 0) {
+		os_atomic_dec_long(&ss->refs);
+		return false;
+	}
+
+	pthread_detach(thread);
+	ss->load_thread_active = true;
+	return true;
+}
+
 /* ------------------------------------------------------------------------- */
 
 static const char *ss_getname(void *unused)
@@ -214,6 +475,17 @@ static void add_file(struct slideshow *ss, struct darray *array,
 
 	if (!new_source)
 		new_source = get_source(&new_files.da, path);
+
+	/* slides are loaded when they're about to be shown */
+	if (ss->lazy_load) {
+		data.path = bstrdup(path);
+		data.source = new_source;
+		da_push_back(new_files, &data);
+
+		*array = new_files.da;
+		return;
+	}
+
 	if (!new_source)
 		new_source = create_source_from_file(path);
 
@@ -251,19 +523,33 @@ static inline bool item_valid(struct slideshow *ss)
 	return ss->files.num && ss->cur_item < ss->files.num;
 }
 
-static void do_transition(void *data, bool to_null)
+static void do_transition(void *data, bool to_null, bool use_cut)
 {
 	struct slideshow *ss = data;
 	bool valid = item_valid(ss);
+	obs_source_t *source = NULL;
+
+	if (valid && (use_cut || !to_null)) {
+		source = get_item_source(ss, ss->cur_item);
+
+		/* not loaded yet, the transition happens on the first tick
+		 * after the loader is done with it */
+		if (!source && ss->lazy_load) {
+			ss->pending_transition = true;
+			ss->pending_cut = use_cut;
+			os_sem_post(ss->load_sem);
+			return;
+		}
+	}
 
-	if (valid && ss->use_cut) {
-		obs_transition_set(ss->transition,
-				   ss->files.array[ss->cur_item].source);
+	ss->pending_transition = false;
+
+	if (valid && use_cut) {
+		obs_transition_set(ss->transition, source);
 
 	} else if (valid && !to_null) {
 		obs_transition_start(ss->transition, OBS_TRANSITION_MODE_AUTO,
-				     ss->tr_speed,
-				     ss->files.array[ss->cur_item].source);
+				     ss->tr_speed, source);
 
 	} else {
 		obs_transition_start(ss->transition, OBS_TRANSITION_MODE_AUTO,
@@ -271,6 +557,8 @@ static void do_transition(void *data, bool to_null)
 		set_media_state(ss, OBS_MEDIA_STATE_ENDED);
 		obs_source_media_ended(ss->source);
 	}
+
+	obs_source_release(source);
 }
 
 static void ss_update(void *data, obs_data_t *settings)
@@ -322,6 +610,19 @@ static void ss_update(void *data, obs_data_t *settings)
 	ss->loop = obs_data_get_bool(settings, S_LOOP);
 	ss->hide = obs_data_get_bool(settings, S_HIDE);
 
+	bool lazy_load = obs_data_get_bool(settings, S_LAZY_LOAD);
+	if (lazy_load && !start_loader(ss)) {
+		warn("Failed to start the slide loader, loading every slide "
+		     "instead");
+		lazy_load = false;
+	}
+
+	pthread_mutex_lock(&ss->mutex);
+	ss->lazy_load = lazy_load;
+	ss->preload_count =
+		(size_t)obs_data_get_int(settings, S_PRELOAD_COUNT);
+	pthread_mutex_unlock(&ss->mutex);
+
 	if (!ss->tr_name || strcmp(tr_name, ss->tr_name) != 0)
 		new_tr = obs_source_create_private(tr_name, NULL, NULL);
 
@@ -387,6 +688,8 @@ static void ss_update(void *data, obs_data_t *settings)
 
 	old_files.da = ss->files.da;
 	ss->files.da = new_files.da;
+	ss->files_gen++;
+	da_resize(ss->upcoming, 0);
 	if (new_tr) {
 		old_tr = ss->transition;
 		ss->transition = new_tr;
@@ -417,6 +720,15 @@ static void ss_update(void *data, obs_data_t *settings)
 
 	/* ------------------------- */
 
+	/* the slides aren't loaded yet, so their size isn't known */
+	if (ss->lazy_load) {
+		struct obs_video_info ovi;
+		if (obs_get_video_info(&ovi)) {
+			cx = ovi.base_width;
+			cy = ovi.base_height;
+		}
+	}
+
 	const char *res_str = obs_data_get_string(settings, S_CUSTOM_SIZE);
 	bool aspect_only = false, use_auto = true;
 	int cx_in = 0, cy_in = 0;
@@ -459,19 +771,17 @@ static void ss_update(void *data, obs_data_t *settings)
 
 	ss->cx = cx;
 	ss->cy = cy;
-	ss->cur_item = 0;
 	ss->elapsed = 0.0f;
 	obs_transition_set_size(ss->transition, cx, cy);
 	obs_transition_set_alignment(ss->transition, OBS_ALIGN_CENTER);
 	obs_transition_set_scale_type(ss->transition,
 				      OBS_TRANSITION_SCALE_ASPECT);
 
-	if (ss->randomize && ss->files.num)
-		ss->cur_item = random_file(ss);
+	set_cur_item(ss, ss->randomize && ss->files.num ? random_file(ss) : 0);
 	if (new_tr)
 		obs_source_add_active_child(ss->source, new_tr);
 	if (ss->files.num) {
-		do_transition(ss, false);
+		do_transition(ss, false, ss->use_cut);
 
 		if (ss->manual)
 			set_media_state(ss, OBS_MEDIA_STATE_PAUSED);
@@ -491,7 +801,7 @@ static void ss_play_pause(void *data, bool pause)
 	if (ss->stop) {
 		ss->stop = false;
 		ss->paused = false;
-		do_transition(ss, false);
+		do_transition(ss, false, ss->use_cut);
 	} else {
 		ss->paused = pause;
 		ss->manual = pause;
@@ -508,10 +818,10 @@ static void ss_restart(void *data)
 	struct slideshow *ss = data;
 
 	ss->elapsed = 0.0f;
-	ss->cur_item = 0;
+	set_cur_item(ss, 0);
 	ss->stop = false;
 	ss->paused = false;
-	do_transition(ss, false);
+	do_transition(ss, false, ss->use_cut);
 
 	set_media_state(ss, OBS_MEDIA_STATE_PLAYING);
 }
@@ -521,9 +831,9 @@ static void ss_stop(void *data)
 	struct slideshow *ss = data;
 
 	ss->elapsed = 0.0f;
-	ss->cur_item = 0;
+	set_cur_item(ss, 0);
 
-	do_transition(ss, true);
+	do_transition(ss, true, ss->use_cut);
 	ss->stop = true;
 	ss->paused = false;
 
@@ -537,10 +847,12 @@ static void ss_next_slide(void *data)
 	if (!ss->files.num || obs_transition_get_time(ss->transition) < 1.0f)
 		return;
 
-	if (++ss->cur_item >= ss->files.num)
-		ss->cur_item = 0;
+	if (ss->cur_item + 1 >= ss->files.num)
+		set_cur_item(ss, 0);
+	else
+		set_cur_item(ss, ss->cur_item + 1);
 
-	do_transition(ss, false);
+	do_transition(ss, false, ss->use_cut);
 }
 
 static void ss_previous_slide(void *data)
@@ -551,11 +863,11 @@ static void ss_previous_slide(void *data)
 		return;
 
 	if (ss->cur_item == 0)
-		ss->cur_item = ss->files.num - 1;
+		set_cur_item(ss, ss->files.num - 1);
 	else
-		--ss->cur_item;
+		set_cur_item(ss, ss->cur_item - 1);
 
-	do_transition(ss, false);
+	do_transition(ss, false, ss->use_cut);
 }
 
 static void play_pause_hotkey(void *data, obs_hotkey_id id,
@@ -633,9 +945,13 @@ static void ss_destroy(void *data)
 		obs_source_release(ss->transition);
 	}
 	
-	free_files(&ss->files.da);
-	pthread_mutex_destroy(&ss->mutex);
-	bfree(ss);
+	/* the loader frees everything else if it's still running */
+	if (ss->load_thread_active) {
+		os_atomic_set_bool(&ss->stop_loading, true);
+		os_sem_post(ss->load_sem);
+	}
+
+	ss_release(ss);
 }
 
 static void *ss_create(obs_data_t *settings, obs_source_t *source)
@@ -643,6 +959,7 @@ static void *ss_create(obs_data_t *settings, obs_source_t *source)
 	struct slideshow *ss = bzalloc(sizeof(*ss));
 
 	ss->source = source;
+	ss->refs = 1;
 
 	ss->manual = false;
 	ss->paused = false;
@@ -703,10 +1020,20 @@ static void ss_video_tick(void *data, float seconds)
 	if (!ss->transition || !ss->slide_time)
 		return;
 
+	/* the slide time starts once the slide is actually up */
+	if (ss->pending_transition) {
+		do_transition(ss, false, ss->pending_cut);
+
+		if (ss->pending_transition)
+			return;
+	}
+
 	if (ss->restart_on_activate && ss->use_cut) {
 		ss->elapsed = 0.0f;
-		ss->cur_item = ss->randomize ? random_file(ss) : 0;
-		do_transition(ss, false);
+		set_cur_item(ss, ss->randomize && ss->files.num
+					 ? random_file(ss)
+					 : 0);
+		do_transition(ss, false, ss->use_cut);
 		ss->restart_on_activate = false;
 		ss->use_cut = false;
 		ss->stop = false;
@@ -724,7 +1051,7 @@ static void ss_video_tick(void *data, float seconds)
 
 		if (active_transition_source) {
 			obs_source_release(active_transition_source);
-			do_transition(ss, true);
+			do_transition(ss, true, ss->use_cut);
 		}
 	}
 
@@ -737,27 +1064,17 @@ static void ss_video_tick(void *data, float seconds)
 
 		if (!ss->loop && ss->cur_item == ss->files.num - 1) {
 			if (ss->hide)
-				do_transition(ss, true);
+				do_transition(ss, true, ss->use_cut);
 			else
-				do_transition(ss, false);
+				do_transition(ss, false, ss->use_cut);
 
 			return;
 		}
 
-		if (ss->randomize) {
-			size_t next = ss->cur_item;
-			if (ss->files.num > 1) {
-				while (next == ss->cur_item)
-					next = random_file(ss);
-			}
-			ss->cur_item = next;
-
-		} else if (++ss->cur_item >= ss->files.num) {
-			ss->cur_item = 0;
+		if (ss->files.num) {
+			set_cur_item(ss, take_next_item(ss));
+			do_transition(ss, false, ss->use_cut);
 		}
-
-		if (ss->files.num)
-			do_transition(ss, false);
 	}
 }
 
@@ -849,6 +1166,8 @@ static void ss_defaults(obs_data_t *settings)
 				    S_BEHAVIOR_ALWAYS_PLAY);
 	obs_data_set_default_string(settings, S_MODE, S_MODE_AUTO);
 	obs_data_set_default_bool(settings, S_LOOP, true);
+	obs_data_set_default_bool(settings, S_LAZY_LOAD, false);
+	obs_data_set_default_int(settings, S_PRELOAD_COUNT, 2);
 }
 
 static const char *file_filter =
@@ -905,6 +1224,9 @@ static obs_properties_t *ss_properties(void *data)
 	obs_properties_add_bool(ppts, S_LOOP, T_LOOP);
 	obs_properties_add_bool(ppts, S_HIDE, T_HIDE);
 	obs_properties_add_bool(ppts, S_RANDOMIZE, T_RANDOMIZE);
+	obs_properties_add_bool(ppts, S_LAZY_LOAD, T_LAZY_LOAD);
+	obs_properties_add_int(ppts, S_PRELOAD_COUNT, T_PRELOAD_COUNT, 0, 16,
+			       1);
 
 	p = obs_properties_add_list(ppts, S_CUSTOM_SIZE, T_CUSTOM_SIZE,
 				    OBS_COMBO_TYPE_EDITABLE,
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Stream setup and packet muxing shared by the ffmpeg-mux helper process and
+ * the in-process muxing mode of the ffmpeg muxer outputs.  The user fills in
+ * params/audio and the headers, then calls ffmpeg_mux_init_context.
+ */
+
+#include "ffmpeg-mux.h"
+
+#include <util/base.h>
+#include <util/dstr.h>
+#include <libavformat/avformat.h>
+
+struct main_params {
+	char *file;
+	/* printable_file is file with any stream key information removed */
+	struct dstr printable_file;
+	int has_video;
+	int tracks;
+	char *vcodec;
+	int vbitrate;
+	int gop;
+	int width;
+	int height;
+	int fps_num;
+	int fps_den;
+	int color_primaries;
+	int color_trc;
+	int colorspace;
+	int color_range;
+	char *acodec;
+	char *muxer_settings;
+};
+
+struct audio_params {
+	char *name;
+	int abitrate;
+	int sample_rate;
+	int channels;
+};
+
+struct header {
+	uint8_t *data;
+	int size;
+};
+
+/* receives the messages of the muxer, level is one of the LOG_* values */
+typedef void (*ffmpeg_mux_log_t)(void *param, int level, const char *msg);
+
+struct ffmpeg_mux {
+	AVFormatContext *output;
+	AVStream *video_stream;
+	AVStream **audio_streams;
+	struct main_params params;
+	struct audio_params *audio;
+	struct header video_header;
+	struct header *audio_header;
+	int num_audio_streams;
+	bool initialized;
+	char error[4096];
+
+	ffmpeg_mux_log_t log;
+	void *log_param;
+};
+
+/* frees everything, writing the trailer first if the context was opened */
+extern void ffmpeg_mux_free(struct ffmpeg_mux *ffm);
+
+/* stores the extra data of the video or audio track described by info */
+extern void ffmpeg_mux_header(struct ffmpeg_mux *ffm, const uint8_t *data,
+			      const struct ffm_packet_info *info);
+
+/* creates the streams and opens the output, returns one of the FFM_ codes */
+extern int ffmpeg_mux_init_context(struct ffmpeg_mux *ffm);
+
+/* writes a packet.  if ref is not NULL it holds the packet data and is
+ * handed over to libavformat, otherwise the data is copied */
+extern bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
+			      AVBufferRef *ref,
+			      const struct ffm_packet_info *info);
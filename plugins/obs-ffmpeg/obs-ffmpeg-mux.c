@@ -14,7 +14,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
-#include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-core.h"
 #include "obs-internal.h"
 #include "obs-ffmpeg-mux.h"
 
@@ -31,6 +31,13 @@
 #define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
 
+/* size of the queue between the encoders and the writer thread, the output
+ * starts dropping video once this much is waiting to be written */
+#define DEFAULT_WRITE_BUFFER_MB 128
+
+/* writes to the pipe that take longer than this are counted as stalls */
+#define WRITE_STALL_NS 20000000ULL
+
 static const char *ffmpeg_mux_getname(void *type)
 {
 	UNUSED_PARAMETER(type);
@@ -51,6 +58,10 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 		obs_encoder_packet_release(&pkt);
 	}
 
+	/* saves that are still reading from the disk buffer hold their own
+	 * reference to it */
+	replay_ring_release(stream->ring);
+	stream->ring = NULL;
 	circlebuf_free(&stream->packets);
 	stream->cur_size = 0;
 	stream->cur_time = 0;
@@ -60,6 +71,35 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	stream->keyframes = 0;
 }
 
+static void writer_clear(struct ffmpeg_muxer *stream)
+{
+	while (stream->writer_packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->writer_packets, &packet,
+				    sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+
+	circlebuf_free(&stream->writer_packets);
+	stream->writer_bytes = 0;
+}
+
+static void stop_writer(struct ffmpeg_muxer *stream)
+{
+	if (!stream->writer_thread_joinable)
+		return;
+
+	pthread_mutex_lock(&stream->writer_mutex);
+	stream->writer_abort = true;
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	os_sem_post(stream->writer_sem);
+	pthread_join(stream->writer_thread, NULL);
+	stream->writer_thread_joinable = false;
+}
+
+static int inproc_destroy(struct mux_inproc *inproc);
+
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -67,10 +107,17 @@ static void ffmpeg_mux_destroy(void *data)
 	replay_buffer_clear(stream);
 	if (stream->mux_thread_joinable)
 		pthread_join(stream->mux_thread, NULL);
-	da_free(stream->mux_packets);
 	circlebuf_free(&stream->packets);
 
+	if (stream->writer_sem) {
+		stop_writer(stream);
+		writer_clear(stream);
+		pthread_mutex_destroy(&stream->writer_mutex);
+		os_sem_destroy(stream->writer_sem);
+	}
+
 	os_process_pipe_destroy(stream->pipe);
+	inproc_destroy(stream->inproc);
 	dstr_free(&stream->path);
 	dstr_free(&stream->printable_path);
 	dstr_free(&stream->stream_key);
@@ -78,6 +125,8 @@ static void ffmpeg_mux_destroy(void *data)
 	bfree(stream);
 }
 
+static void get_writer_stats(void *data, calldata_t *cd);
+
 static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
@@ -86,8 +135,34 @@ static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 	if (obs_output_get_flags(output) & OBS_OUTPUT_SERVICE)
 		stream->is_network = true;
 
+	if (pthread_mutex_init(&stream->writer_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&stream->writer_sem, 0) != 0) {
+		pthread_mutex_destroy(&stream->writer_mutex);
+		goto fail;
+	}
+
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph,
+			 "void get_writer_stats(out int queued_bytes, "
+			 "out int queued_packets, out int peak_bytes, "
+			 "out int dropped_packets, out int stalls, "
+			 "out int stall_time_ms, out int max_stall_ms)",
+			 get_writer_stats, stream);
+
 	UNUSED_PARAMETER(settings);
 	return stream;
+
+fail:
+	bfree(stream);
+	return NULL;
+}
+
+static void ffmpeg_mux_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "write_buffer_mb",
+				 DEFAULT_WRITE_BUFFER_MB);
+	obs_data_set_default_bool(settings, "in_process", false);
 }
 
 #ifdef _WIN32
@@ -113,8 +188,9 @@ bool active(struct ffmpeg_muxer *stream)
 
 /* TODO: allow codecs other than h264 whenever we start using them */
 
-static void add_video_encoder_params(struct ffmpeg_muxer *stream,
-				     struct dstr *cmd, obs_encoder_t *vencoder)
+static void get_video_encoder_params(struct ffmpeg_muxer *stream,
+				     obs_encoder_t *vencoder,
+				     struct main_params *params)
 {
 	obs_data_t *settings = obs_encoder_get_settings(vencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
@@ -149,28 +225,55 @@ static void add_video_encoder_params(struct ffmpeg_muxer *stream,
 						? AVCOL_RANGE_JPEG
 						: AVCOL_RANGE_MPEG;
 
-	dstr_catf(cmd, "%s %d %d %d %d %d %d %d %d %d ",
-		  obs_encoder_get_codec(vencoder), bitrate,
-		  obs_output_get_width(stream->output),
-		  obs_output_get_height(stream->output), (int)pri, (int)trc,
-		  (int)spc, (int)range, (int)info->fps_num, (int)info->fps_den);
+	params->vcodec = (char *)obs_encoder_get_codec(vencoder);
+	params->vbitrate = bitrate;
+	params->width = (int)obs_output_get_width(stream->output);
+	params->height = (int)obs_output_get_height(stream->output);
+	params->color_primaries = (int)pri;
+	params->color_trc = (int)trc;
+	params->colorspace = (int)spc;
+	params->color_range = (int)range;
+	params->fps_num = (int)info->fps_num;
+	params->fps_den = (int)info->fps_den;
 }
 
-static void add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
+static void add_video_encoder_params(struct ffmpeg_muxer *stream,
+				     struct dstr *cmd, obs_encoder_t *vencoder)
+{
+	struct main_params params = {0};
+
+	get_video_encoder_params(stream, vencoder, &params);
+
+	dstr_catf(cmd, "%s %d %d %d %d %d %d %d %d %d ", params.vcodec,
+		  params.vbitrate, params.width, params.height,
+		  params.color_primaries, params.color_trc, params.colorspace,
+		  params.color_range, params.fps_num, params.fps_den);
+}
+
+static void get_audio_encoder_params(obs_encoder_t *aencoder,
+				     struct audio_params *audio)
 {
 	obs_data_t *settings = obs_encoder_get_settings(aencoder);
-	int bitrate = (int)obs_data_get_int(settings, "bitrate");
-	audio_t *audio = obs_get_audio();
-	struct dstr name = {0};
+
+	audio->abitrate = (int)obs_data_get_int(settings, "bitrate");
+	audio->sample_rate = (int)obs_encoder_get_sample_rate(aencoder);
+	audio->channels = (int)audio_output_get_channels(obs_get_audio());
 
 	obs_data_release(settings);
+}
+
+static void add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
+{
+	struct audio_params audio = {0};
+	struct dstr name = {0};
+
+	get_audio_encoder_params(aencoder, &audio);
 
 	dstr_copy(&name, obs_encoder_get_name(aencoder));
 	dstr_replace(&name, "\"", "\"\"");
 
-	dstr_catf(cmd, "\"%s\" %d %d %d ", name.array, bitrate,
-		  (int)obs_encoder_get_sample_rate(aencoder),
-		  (int)audio_output_get_channels(audio));
+	dstr_catf(cmd, "\"%s\" %d %d %d ", name.array, audio.abitrate,
+		  audio.sample_rate, audio.channels);
 
 	dstr_free(&name);
 }
@@ -211,19 +314,22 @@ static void add_stream_key(struct dstr *cmd, struct ffmpeg_muxer *stream)
 			  : stream->stream_key.array);
 }
 
-static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
+static void get_muxer_settings(struct ffmpeg_muxer *stream, struct dstr *mux)
 {
-	struct dstr mux = {0};
-
 	if (dstr_is_empty(&stream->muxer_settings)) {
 		obs_data_t *settings = obs_output_get_settings(stream->output);
-		dstr_copy(&mux,
-			  obs_data_get_string(settings, "muxer_settings"));
+		dstr_copy(mux, obs_data_get_string(settings, "muxer_settings"));
 		obs_data_release(settings);
 	} else {
-		dstr_copy(&mux, stream->muxer_settings.array);
+		dstr_copy(mux, stream->muxer_settings.array);
 	}
+}
 
+static void add_muxer_params(struct dstr *cmd, struct ffmpeg_muxer *stream)
+{
+	struct dstr mux = {0};
+
+	get_muxer_settings(stream, &mux);
 	log_muxer_params(stream, mux.array);
 
 	dstr_replace(&mux, "\"", "\\\"");
@@ -283,6 +389,195 @@ void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 	dstr_free(&cmd);
 }
 
+/* ------------------------------------------------------------------------ */
+/* in-process muxing, uses the same muxing code as ffmpeg-mux without the
+ * helper process, the pipe and the extra copy of every packet */
+
+struct mux_inproc {
+	struct ffmpeg_muxer *stream;
+	struct ffmpeg_mux ffm;
+	int ret;
+
+	/* the strings ffm.params and ffm.audio point to */
+	struct dstr file;
+	struct dstr muxer_settings;
+	struct dstr audio_names[MAX_AUDIO_MIXES];
+};
+
+static void inproc_log(void *param, int level, const char *msg)
+{
+	struct ffmpeg_muxer *stream = param;
+	do_log(level, "%s", msg);
+}
+
+static struct mux_inproc *inproc_create(struct ffmpeg_muxer *stream,
+					const char *path)
+{
+	struct mux_inproc *inproc = bzalloc(sizeof(*inproc));
+	struct ffmpeg_mux *ffm = &inproc->ffm;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	int tracks = 0;
+
+	inproc->stream = stream;
+	ffm->log = inproc_log;
+	ffm->log_param = stream;
+
+	dstr_copy(&inproc->file, path);
+	ffm->params.file = inproc->file.array;
+
+	dstr_copy(&ffm->params.printable_file, path);
+	if (!dstr_is_empty(&stream->stream_key))
+		dstr_replace(&ffm->params.printable_file,
+			     stream->stream_key.array, "{stream_key}");
+
+	if (vencoder) {
+		ffm->params.has_video = 1;
+		get_video_encoder_params(stream, vencoder, &ffm->params);
+	}
+
+	while (tracks < MAX_AUDIO_MIXES &&
+	       obs_output_get_audio_encoder(stream->output, tracks))
+		tracks++;
+
+	if (tracks) {
+		/* freed by ffmpeg_mux_free */
+		ffm->audio = calloc(tracks, sizeof(*ffm->audio));
+		ffm->audio_header = calloc(tracks, sizeof(*ffm->audio_header));
+		ffm->params.acodec = "aac";
+		ffm->params.tracks = tracks;
+	}
+
+	for (int i = 0; i < tracks; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(stream->output, i);
+
+		dstr_copy(&inproc->audio_names[i],
+			  obs_encoder_get_name(aencoder));
+		ffm->audio[i].name = inproc->audio_names[i].array;
+		get_audio_encoder_params(aencoder, &ffm->audio[i]);
+	}
+
+	get_muxer_settings(stream, &inproc->muxer_settings);
+	ffm->params.muxer_settings = inproc->muxer_settings.array
+					     ? inproc->muxer_settings.array
+					     : "";
+	return inproc;
+}
+
+/* finishes the file, returns FFM_SUCCESS or the error that stopped it */
+static int inproc_destroy(struct mux_inproc *inproc)
+{
+	int ret;
+
+	if (!inproc)
+		return FFM_SUCCESS;
+
+	ret = inproc->ret;
+	ffmpeg_mux_free(&inproc->ffm);
+
+	dstr_free(&inproc->file);
+	dstr_free(&inproc->muxer_settings);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		dstr_free(&inproc->audio_names[i]);
+	bfree(inproc);
+	return ret;
+}
+
+static void inproc_set_header(struct mux_inproc *inproc,
+			      obs_encoder_t *encoder,
+			      enum ffm_packet_type type, uint32_t index)
+{
+	struct ffm_packet_info info = {.type = type, .index = index};
+	uint8_t *data = NULL;
+	size_t size = 0;
+
+	obs_encoder_get_extra_data(encoder, &data, &size);
+	if (!data)
+		size = 0;
+
+	info.size = (uint32_t)size;
+	ffmpeg_mux_header(&inproc->ffm, data, &info);
+}
+
+/* the extra data is only known once the encoders are running, so the
+ * output is opened with the first packet, like ffmpeg-mux does */
+static bool send_headers_inproc(struct ffmpeg_muxer *stream,
+				struct mux_inproc *inproc)
+{
+	struct ffmpeg_mux *ffm = &inproc->ffm;
+
+	if (ffm->params.has_video)
+		inproc_set_header(inproc,
+				  obs_output_get_video_encoder(stream->output),
+				  FFM_PACKET_VIDEO, 0);
+
+	for (int i = 0; i < ffm->params.tracks; i++)
+		inproc_set_header(inproc,
+				  obs_output_get_audio_encoder(stream->output,
+							       i),
+				  FFM_PACKET_AUDIO, (uint32_t)i);
+
+	inproc->ret = ffmpeg_mux_init_context(ffm);
+	if (inproc->ret != FFM_SUCCESS)
+		return false;
+
+	ffm->initialized = true;
+	return true;
+}
+
+static void release_packet_buffer(void *opaque, uint8_t *data)
+{
+	struct encoder_packet *packet = opaque;
+
+	obs_encoder_packet_release(packet);
+	bfree(packet);
+	UNUSED_PARAMETER(data);
+}
+
+static inline void get_packet_info(struct ffm_packet_info *info,
+				   struct encoder_packet *packet)
+{
+	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+
+	info->pts = packet->pts;
+	info->dts = packet->dts;
+	info->size = (uint32_t)packet->size;
+	info->index = (int)packet->track_idx;
+	info->type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO;
+	info->keyframe = packet->keyframe;
+}
+
+/* refcounted packets are handed to libavformat without copying them, it
+ * releases them once they've been interleaved and written */
+static bool write_packet_inproc(struct ffmpeg_muxer *stream,
+				struct mux_inproc *inproc,
+				struct encoder_packet *packet, bool refcounted)
+{
+	struct ffm_packet_info info;
+	AVBufferRef *buf = NULL;
+
+	get_packet_info(&info, packet);
+
+	if (refcounted) {
+		struct encoder_packet *ref = bmalloc(sizeof(*ref));
+		obs_encoder_packet_ref(ref, packet);
+
+		buf = av_buffer_create(ref->data, (int)ref->size,
+				       release_packet_buffer, ref,
+				       AV_BUFFER_FLAG_READONLY);
+		if (!buf)
+			release_packet_buffer(ref, NULL);
+	}
+
+	if (!ffmpeg_mux_packet(&inproc->ffm, packet->data, buf, &info)) {
+		inproc->ret = FFM_ERROR;
+		return false;
+	}
+
+	stream->total_bytes += packet->size;
+	return true;
+}
+
 static void set_file_not_readable_error(struct ffmpeg_muxer *stream,
 					obs_data_t *settings, const char *path)
 {
@@ -304,6 +599,37 @@ static void set_file_not_readable_error(struct ffmpeg_muxer *stream,
 	obs_data_release(settings);
 }
 
+static void *writer_thread(void *data);
+
+static bool start_writer(struct ffmpeg_muxer *stream, obs_data_t *settings)
+{
+	int64_t buffer_mb = obs_data_get_int(settings, "write_buffer_mb");
+
+	/* the previous writer has already finished by the time the output
+	 * can be started again */
+	stop_writer(stream);
+	writer_clear(stream);
+
+	stream->writer_max_bytes =
+		(size_t)(buffer_mb > 0 ? buffer_mb : DEFAULT_WRITE_BUFFER_MB) *
+		1024 * 1024;
+	stream->writer_drop_video = false;
+	stream->writer_finishing = false;
+	stream->writer_overflow = false;
+	stream->writer_abort = false;
+	stream->writer_peak_bytes = 0;
+	stream->writer_dropped = 0;
+	stream->writer_stalls = 0;
+	stream->writer_stall_ns = 0;
+	stream->writer_max_stall_ns = 0;
+	stream->sent_headers = false;
+
+	stream->writer_thread_joinable =
+		pthread_create(&stream->writer_thread, NULL, writer_thread,
+			       stream) == 0;
+	return stream->writer_thread_joinable;
+}
+
 static bool ffmpeg_mux_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -342,16 +668,33 @@ static bool ffmpeg_mux_start(void *data)
 		os_unlink(path);
 	}
 
-	start_pipe(stream, path);
-	obs_data_release(settings);
+	if (obs_data_get_bool(settings, "in_process")) {
+		dstr_copy(&stream->path, path);
+		stream->inproc = inproc_create(stream, path);
+	} else {
+		start_pipe(stream, path);
+	}
 
-	if (!stream->pipe) {
+	if (!stream->pipe && !stream->inproc) {
+		obs_data_release(settings);
 		obs_output_set_last_error(
 			stream->output, obs_module_text("HelperProcessFailed"));
 		warn("Failed to create process pipe");
 		return false;
 	}
 
+	if (!start_writer(stream, settings)) {
+		obs_data_release(settings);
+		os_process_pipe_destroy(stream->pipe);
+		stream->pipe = NULL;
+		inproc_destroy(stream->inproc);
+		stream->inproc = NULL;
+		warn("Failed to create writer thread");
+		return false;
+	}
+
+	obs_data_release(settings);
+
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
@@ -376,8 +719,13 @@ int deactivate(struct ffmpeg_muxer *stream, int code)
 	}
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		if (stream->inproc) {
+			ret = inproc_destroy(stream->inproc);
+			stream->inproc = NULL;
+		} else {
+			ret = os_process_pipe_destroy(stream->pipe);
+			stream->pipe = NULL;
+		}
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -430,13 +778,20 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 
 	size_t len;
 
-	len = os_process_pipe_read_err(stream->pipe, (uint8_t *)error,
-				       sizeof(error) - 1);
+	if (stream->inproc) {
+		/* the error has already been logged */
+		if (*stream->inproc->ffm.error)
+			obs_output_set_last_error(stream->output,
+						  stream->inproc->ffm.error);
+	} else {
+		len = os_process_pipe_read_err(stream->pipe, (uint8_t *)error,
+					       sizeof(error) - 1);
 
-	if (len > 0) {
-		error[len] = 0;
-		warn("ffmpeg-mux: %s", error);
-		obs_output_set_last_error(stream->output, error);
+		if (len > 0) {
+			error[len] = 0;
+			warn("ffmpeg-mux: %s", error);
+			obs_output_set_last_error(stream->output, error);
+		}
 	}
 
 	ret = deactivate(stream, 0);
@@ -457,31 +812,25 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing, false);
 }
 
-bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+static bool write_packet_pipe(struct ffmpeg_muxer *stream,
+			      os_process_pipe_t *pipe,
+			      struct encoder_packet *packet)
 {
-	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+	struct ffm_packet_info info;
 	size_t ret;
 
-	struct ffm_packet_info info = {.pts = packet->pts,
-				       .dts = packet->dts,
-				       .size = (uint32_t)packet->size,
-				       .index = (int)packet->track_idx,
-				       .type = is_video ? FFM_PACKET_VIDEO
-							: FFM_PACKET_AUDIO,
-				       .keyframe = packet->keyframe};
+	get_packet_info(&info, packet);
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
+	ret = os_process_pipe_write(pipe, (const uint8_t *)&info,
 				    sizeof(info));
 	if (ret != sizeof(info)) {
 		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
+	ret = os_process_pipe_write(pipe, packet->data, packet->size);
 	if (ret != packet->size) {
 		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
 		return false;
 	}
 
@@ -489,17 +838,35 @@ bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 	return true;
 }
 
+bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+{
+	bool success = stream->inproc ? write_packet_inproc(stream,
+							    stream->inproc,
+							    packet, true)
+				      : write_packet_pipe(stream, stream->pipe,
+							  packet);
+
+	if (!success) {
+		signal_failure(stream);
+		return false;
+	}
+
+	return true;
+}
+
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
-			       obs_encoder_t *aencoder, size_t idx)
+			       os_process_pipe_t *pipe, obs_encoder_t *aencoder,
+			       size_t idx)
 {
 	struct encoder_packet packet = {
 		.type = OBS_ENCODER_AUDIO, .timebase_den = 1, .track_idx = idx};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_packet_pipe(stream, pipe, &packet);
 }
 
-static bool send_video_headers(struct ffmpeg_muxer *stream)
+static bool send_video_headers(struct ffmpeg_muxer *stream,
+			       os_process_pipe_t *pipe)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
 
@@ -507,21 +874,22 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 					.timebase_den = 1};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_packet_pipe(stream, pipe, &packet);
 }
 
-bool send_headers(struct ffmpeg_muxer *stream)
+static bool send_headers_pipe(struct ffmpeg_muxer *stream,
+			      os_process_pipe_t *pipe)
 {
 	obs_encoder_t *aencoder;
 	size_t idx = 0;
 
-	if (!send_video_headers(stream))
+	if (!send_video_headers(stream, pipe))
 		return false;
 
 	do {
 		aencoder = obs_output_get_audio_encoder(stream->output, idx);
 		if (aencoder) {
-			if (!send_audio_headers(stream, aencoder, idx)) {
+			if (!send_audio_headers(stream, pipe, aencoder, idx)) {
 				return false;
 			}
 			idx++;
@@ -531,6 +899,205 @@ bool send_headers(struct ffmpeg_muxer *stream)
 	return true;
 }
 
+bool send_headers(struct ffmpeg_muxer *stream)
+{
+	bool success = stream->inproc
+			       ? send_headers_inproc(stream, stream->inproc)
+			       : send_headers_pipe(stream, stream->pipe);
+
+	if (!success) {
+		signal_failure(stream);
+		return false;
+	}
+
+	return true;
+}
+
+static void record_write_time(struct ffmpeg_muxer *stream, uint64_t elapsed)
+{
+	if (elapsed < WRITE_STALL_NS)
+		return;
+
+	stream->writer_stalls++;
+	stream->writer_stall_ns += elapsed;
+	if (elapsed > stream->writer_max_stall_ns)
+		stream->writer_max_stall_ns = elapsed;
+}
+
+static void *writer_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	bool overflow = false;
+
+	os_set_thread_name("ffmpeg-mux: writer");
+
+	while (os_sem_wait(stream->writer_sem) == 0) {
+		struct encoder_packet packet;
+		bool has_packet = false;
+		bool finish = false;
+		uint64_t start;
+		bool success;
+
+		pthread_mutex_lock(&stream->writer_mutex);
+
+		if (stream->writer_abort) {
+			pthread_mutex_unlock(&stream->writer_mutex);
+			return NULL;
+		}
+
+		overflow = stream->writer_overflow;
+		if (!overflow && stream->writer_packets.size) {
+			circlebuf_pop_front(&stream->writer_packets, &packet,
+					    sizeof(packet));
+			has_packet = true;
+		} else if (stream->writer_finishing) {
+			finish = true;
+		}
+
+		pthread_mutex_unlock(&stream->writer_mutex);
+
+		if (overflow) {
+			warn("Write buffer full, the output is writing "
+			     "slower than the encoders produce data");
+			break;
+		}
+		if (finish) {
+			/* everything up to the stop point has been written */
+			deactivate(stream, 0);
+			return NULL;
+		}
+		if (!has_packet)
+			continue;
+
+		if (!stream->sent_headers) {
+			if (!send_headers(stream)) {
+				obs_encoder_packet_release(&packet);
+				break;
+			}
+
+			stream->sent_headers = true;
+		}
+
+		start = os_gettime_ns();
+		success = write_packet(stream, &packet);
+
+		pthread_mutex_lock(&stream->writer_mutex);
+		stream->writer_bytes -= packet.size;
+		record_write_time(stream, os_gettime_ns() - start);
+		pthread_mutex_unlock(&stream->writer_mutex);
+
+		obs_encoder_packet_release(&packet);
+
+		if (!success)
+			break;
+	}
+
+	pthread_mutex_lock(&stream->writer_mutex);
+	overflow = stream->writer_overflow;
+	writer_clear(stream);
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	/* write failures have already stopped the output */
+	if (overflow)
+		deactivate(stream, OBS_OUTPUT_ERROR);
+	return NULL;
+}
+
+/* once the queue is full, video is dropped up to the next keyframe so the
+ * file stays decodable.  audio and keyframes are always queued, up to twice
+ * the queue size, after which the output is stopped with an error */
+static bool writer_drop_packet(struct ffmpeg_muxer *stream,
+			       struct encoder_packet *packet)
+{
+	if (packet->type != OBS_ENCODER_VIDEO)
+		return false;
+
+	if (packet->keyframe) {
+		stream->writer_drop_video = false;
+		return false;
+	}
+
+	if (!stream->writer_drop_video &&
+	    stream->writer_bytes + packet->size <= stream->writer_max_bytes)
+		return false;
+
+	stream->writer_drop_video = true;
+	return true;
+}
+
+static void writer_push(struct ffmpeg_muxer *stream,
+			struct encoder_packet *packet)
+{
+	struct encoder_packet new_packet;
+	bool post = false;
+
+	pthread_mutex_lock(&stream->writer_mutex);
+
+	if (stream->writer_finishing || stream->writer_overflow)
+		goto unlock;
+
+	if (writer_drop_packet(stream, packet)) {
+		stream->writer_dropped++;
+		goto unlock;
+	}
+
+	if (stream->writer_bytes + packet->size >
+	    stream->writer_max_bytes * 2) {
+		stream->writer_overflow = true;
+		post = true;
+		goto unlock;
+	}
+
+	obs_encoder_packet_ref(&new_packet, packet);
+	circlebuf_push_back(&stream->writer_packets, &new_packet,
+			    sizeof(new_packet));
+
+	stream->writer_bytes += packet->size;
+	if (stream->writer_bytes > stream->writer_peak_bytes)
+		stream->writer_peak_bytes = stream->writer_bytes;
+	post = true;
+
+unlock:
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	if (post)
+		os_sem_post(stream->writer_sem);
+}
+
+static void writer_finish(struct ffmpeg_muxer *stream)
+{
+	bool post;
+
+	pthread_mutex_lock(&stream->writer_mutex);
+	post = !stream->writer_finishing;
+	stream->writer_finishing = true;
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	if (post)
+		os_sem_post(stream->writer_sem);
+}
+
+static void get_writer_stats(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	pthread_mutex_lock(&stream->writer_mutex);
+	calldata_set_int(cd, "queued_bytes", (long long)stream->writer_bytes);
+	calldata_set_int(cd, "queued_packets",
+			 (long long)(stream->writer_packets.size /
+				     sizeof(struct encoder_packet)));
+	calldata_set_int(cd, "peak_bytes",
+			 (long long)stream->writer_peak_bytes);
+	calldata_set_int(cd, "dropped_packets",
+			 (long long)stream->writer_dropped);
+	calldata_set_int(cd, "stalls", (long long)stream->writer_stalls);
+	calldata_set_int(cd, "stall_time_ms",
+			 (long long)(stream->writer_stall_ns / 1000000));
+	calldata_set_int(cd, "max_stall_ms",
+			 (long long)(stream->writer_max_stall_ns / 1000000));
+	pthread_mutex_unlock(&stream->writer_mutex);
+}
+
 static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -540,25 +1107,20 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 
 	/* encoder failure */
 	if (!packet) {
+		stop_writer(stream);
+		writer_clear(stream);
 		deactivate(stream, OBS_OUTPUT_ENCODE_ERROR);
 		return;
 	}
 
-	if (!stream->sent_headers) {
-		if (!send_headers(stream))
-			return;
-
-		stream->sent_headers = true;
-	}
-
 	if (stopping(stream)) {
 		if (packet->sys_dts_usec >= stream->stop_ts) {
-			deactivate(stream, 0);
+			writer_finish(stream);
 			return;
 		}
 	}
 
-	write_packet(stream, packet);
+	writer_push(stream, packet);
 }
 
 static bool ffmpeg_mux_is_ready_to_update(void *data)
@@ -595,6 +1157,7 @@ struct obs_output_info ffmpeg_muxer = {
 	.stop = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
 	.get_total_bytes = ffmpeg_mux_total_bytes,
+	.get_defaults = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties,
 	.is_ready_to_update = ffmpeg_mux_is_ready_to_update,
 };
@@ -626,6 +1189,7 @@ struct obs_output_info ffmpeg_mpegts_muxer = {
 	.stop = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
 	.get_total_bytes = ffmpeg_mux_total_bytes,
+	.get_defaults = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties,
 	.get_connect_time_ms = ffmpeg_mpegts_mux_connect_time,
 	.is_ready_to_update = ffmpeg_mux_is_ready_to_update,
@@ -672,7 +1236,7 @@ static void save_replay_proc(void *data, calldata_t *cd)
 static void get_last_replay(void *data, calldata_t *cd)
 {
 	struct ffmpeg_muxer *stream = data;
-	if (!os_atomic_load_bool(&stream->muxing))
+	if (!os_atomic_load_long(&stream->muxing))
 		calldata_set_string(cd, "path", stream->path.array);
 }
 
@@ -682,6 +1246,11 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	if (pthread_mutex_init(&stream->replay_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
 	stream->hotkey =
 		obs_hotkey_register_output(output, "ReplayBuffer.Save",
 					   obs_module_text("ReplayBuffer.Save"),
@@ -698,12 +1267,31 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	return stream;
 }
 
-static void replay_buffer_destroy(void *data)
+static void replay_buffer_init_ring(struct ffmpeg_muxer *stream,
+				    const char *dir)
 {
-	struct ffmpeg_muxer *stream = data;
-	if (stream->hotkey)
-		obs_hotkey_unregister(stream->hotkey);
-	ffmpeg_mux_destroy(data);
+	/* leave room for new packets while a save is still reading the
+	 * oldest ones */
+	uint64_t capacity = (uint64_t)stream->max_size * 2;
+
+	if (!stream->max_size) {
+		warn("Disk buffer requires a maximum size, "
+		     "keeping the replay buffer in memory");
+		return;
+	}
+	if (capacity > SIZE_MAX) {
+		warn("Disk buffer size is too large for this system, "
+		     "keeping the replay buffer in memory");
+		return;
+	}
+
+	stream->ring = replay_ring_create(dir, (size_t)capacity);
+	if (stream->ring)
+		info("Using disk buffer of %llu MB in '%s'",
+		     (unsigned long long)(capacity / (1024 * 1024)), dir);
+	else
+		warn("Failed to create disk buffer, "
+		     "keeping the replay buffer in memory");
 }
 
 static bool replay_buffer_start(void *data)
@@ -718,6 +1306,10 @@ static bool replay_buffer_start(void *data)
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+
+	if (obs_data_get_bool(s, "disk_buffer"))
+		replay_buffer_init_ring(stream,
+					obs_data_get_string(s, "directory"));
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -728,152 +1320,392 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
+static inline size_t replay_buffer_count(struct ffmpeg_muxer *stream)
+{
+	if (replay_ring_active(stream->ring))
+		return replay_ring_count(stream->ring);
+	return stream->packets.size / sizeof(struct encoder_packet);
+}
+
+/* gets a buffered packet.  when the disk buffer is used, the packet has no
+ * data and its position in the ring is returned in pos instead */
+static void replay_buffer_peek(struct ffmpeg_muxer *stream, size_t idx,
+			       struct encoder_packet *pkt, uint64_t *pos)
+{
+	const size_t size = sizeof(struct encoder_packet);
+
+	if (replay_ring_active(stream->ring)) {
+		struct replay_ring_packet *rp =
+			replay_ring_get(stream->ring, idx);
+
+		memset(pkt, 0, sizeof(*pkt));
+		pkt->dts = rp->dts;
+		pkt->pts = rp->pts;
+		pkt->dts_usec = rp->dts_usec;
+		pkt->size = rp->size;
+		pkt->track_idx = rp->track_idx;
+		pkt->type = (enum obs_encoder_type)rp->type;
+		pkt->keyframe = rp->keyframe;
+		if (pos)
+			*pos = rp->pos;
+	} else {
+		*pkt = *(struct encoder_packet *)circlebuf_data(
+			&stream->packets, idx * size);
+		if (pos)
+			*pos = 0;
+	}
+}
+
+static inline bool replay_buffer_keyframe(struct ffmpeg_muxer *stream,
+					  size_t idx)
 {
 	struct encoder_packet pkt;
-	bool keyframe;
+	replay_buffer_peek(stream, idx, &pkt, NULL);
+	return pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+}
 
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
+/* ------------------------------------------------------------------------ */
+/* saving */
 
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+#define SAVE_BATCH_SIZE 64
 
-	if (keyframe)
-		stream->keyframes--;
+struct held_packet {
+	struct encoder_packet pkt;
+	uint64_t pos;
+};
 
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
-	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
-	}
+struct replay_save {
+	struct ffmpeg_muxer *stream;
+	pthread_t thread;
+	os_process_pipe_t *pipe;
+	/* set instead of cmd/pipe when saving in-process */
+	struct mux_inproc *inproc;
+	struct dstr cmd;
+	struct dstr path;
+	/* the disk buffer the packets are read from, if any */
+	struct replay_ring *ring;
+	volatile bool stop;
+	volatile bool done;
+
+	/* sequence numbers of the buffered packets still to be written */
+	uint64_t next;
+	uint64_t end;
+
+	/* packets handed over when the buffer is cleared or purged during a
+	 * save, disk buffer packets keep their position in the ring */
+	struct circlebuf held;
+
+	int64_t video_offset;
+	int64_t video_dts_offset;
+	int64_t audio_offsets[MAX_AUDIO_MIXES];
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES];
+};
 
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
+static void replay_save_destroy(struct replay_save *save)
+{
+	pthread_join(save->thread, NULL);
+	circlebuf_free(&save->held);
+	dstr_free(&save->cmd);
+	dstr_free(&save->path);
+	bfree(save);
 }
 
-static inline void purge(struct ffmpeg_muxer *stream)
+/* joins and frees saves that are done, or all of them */
+static void replay_buffer_reap_saves(struct ffmpeg_muxer *stream, bool all)
 {
-	if (purge_front(stream)) {
-		struct encoder_packet pkt;
+	for (size_t i = stream->saves.num; i > 0; i--) {
+		struct replay_save *save = stream->saves.array[i - 1];
 
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					     sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
+		if (all || os_atomic_load_bool(&save->done)) {
+			replay_save_destroy(save);
+			da_erase(stream->saves, i - 1);
+		}
+	}
+}
+
+static void replay_save_cancel(struct replay_save *save);
 
-			purge_front(stream);
+/* tells unfinished saves to stop, for when the output is destroyed */
+static void replay_buffer_stop_saves(struct ffmpeg_muxer *stream)
+{
+	for (size_t i = 0; i < stream->saves.num; i++) {
+		struct replay_save *save = stream->saves.array[i];
+
+		if (!os_atomic_load_bool(&save->done)) {
+			os_atomic_set_bool(&save->stop, true);
+			replay_save_cancel(save);
 		}
 	}
 }
 
-static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
-				       struct encoder_packet *pkt)
+/* whether a save still needs the buffered packet with the given sequence
+ * number.  called with replay_mutex locked */
+static bool replay_buffer_pinned(struct ffmpeg_muxer *stream, uint64_t seq)
 {
-	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
-			return;
+	/* the disk buffer can't grow, saves detect overwritten data instead */
+	if (replay_ring_active(stream->ring))
+		return false;
 
-		while ((stream->cur_size + (int64_t)pkt->size) >
-		       stream->max_size)
-			purge(stream);
+	for (size_t i = 0; i < stream->saves.num; i++) {
+		struct replay_save *save = stream->saves.array[i];
+		if (save->next < save->end && save->next <= seq)
+			return true;
 	}
 
-	if (!stream->packets.size || stream->keyframes <= 2)
-		return;
+	return false;
+}
 
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
+/* hands the next packet over to the save, so it no longer needs the buffer
+ * to keep it.  called with replay_mutex locked */
+static void replay_save_hold(struct replay_save *save)
+{
+	struct ffmpeg_muxer *stream = save->stream;
+	size_t idx = (size_t)(save->next - stream->first_seq);
+	struct held_packet held;
+
+	replay_buffer_peek(stream, idx, &held.pkt, &held.pos);
+	if (!save->ring)
+		obs_encoder_packet_ref(&held.pkt, &held.pkt);
+
+	circlebuf_push_back(&save->held, &held, sizeof(held));
+	save->next++;
 }
 
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-			  int64_t video_offset, int64_t *audio_offsets,
-			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
+/* gives every unfinished save the packets it still needs, so the buffer can
+ * be cleared.  called with replay_mutex locked */
+static void replay_buffer_detach_saves(struct ffmpeg_muxer *stream)
 {
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
-	size_t idx;
+	for (size_t i = 0; i < stream->saves.num; i++) {
+		struct replay_save *save = stream->saves.array[i];
 
-	obs_encoder_packet_ref(&pkt, packet);
+		while (save->next < save->end)
+			replay_save_hold(save);
+	}
+}
 
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_dts_offset;
-		pkt.pts -= video_dts_offset;
-	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+/* disk buffer packets are purged even while a save needs them.  the data
+ * stays in the ring until it's written over, which the save detects, so
+ * only the packet's index entry is handed over.  called with replay_mutex
+ * locked */
+static void replay_buffer_hold_front(struct ffmpeg_muxer *stream)
+{
+	for (size_t i = 0; i < stream->saves.num; i++) {
+		struct replay_save *save = stream->saves.array[i];
+
+		if (save->next < save->end && save->next == stream->first_seq)
+			replay_save_hold(save);
 	}
+}
 
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
-			break;
+/* takes the next batch of packets to write.  packets kept in memory are
+ * referenced, packets in the disk buffer get their position in pos */
+static size_t replay_save_fetch(struct replay_save *save,
+				struct encoder_packet *packets, uint64_t *pos)
+{
+	struct ffmpeg_muxer *stream = save->stream;
+	size_t num = 0;
+
+	pthread_mutex_lock(&stream->replay_mutex);
+
+	while (num < SAVE_BATCH_SIZE && save->held.size) {
+		struct held_packet held;
+
+		circlebuf_pop_front(&save->held, &held, sizeof(held));
+		packets[num] = held.pkt;
+		pos[num++] = held.pos;
+	}
+
+	while (num < SAVE_BATCH_SIZE && save->next < save->end) {
+		size_t idx = (size_t)(save->next - stream->first_seq);
+
+		replay_buffer_peek(stream, idx, &packets[num], &pos[num]);
+		if (!save->ring)
+			obs_encoder_packet_ref(&packets[num], &packets[num]);
+
+		save->next++;
+		num++;
+	}
+
+	pthread_mutex_unlock(&stream->replay_mutex);
+	return num;
+}
+
+/* stops fetching packets and drops the ones that were handed over */
+static void replay_save_cancel(struct replay_save *save)
+{
+	struct ffmpeg_muxer *stream = save->stream;
+
+	pthread_mutex_lock(&stream->replay_mutex);
+	save->next = save->end;
+	while (save->held.size) {
+		struct held_packet held;
+		circlebuf_pop_front(&save->held, &held, sizeof(held));
+		if (!save->ring)
+			obs_encoder_packet_release(&held.pkt);
+	}
+	pthread_mutex_unlock(&stream->replay_mutex);
+}
+
+static void replay_save_failed(struct replay_save *save)
+{
+	struct ffmpeg_muxer *stream = save->stream;
+	char error[1024];
+	size_t len;
+
+	if (save->inproc) {
+		if (*save->inproc->ffm.error)
+			obs_output_set_last_error(stream->output,
+						  save->inproc->ffm.error);
+	} else {
+		len = os_process_pipe_read_err(save->pipe, (uint8_t *)error,
+					       sizeof(error) - 1);
+		if (len > 0) {
+			error[len] = 0;
+			warn("ffmpeg-mux: %s", error);
+			obs_output_set_last_error(stream->output, error);
+		}
 	}
 
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
+	warn("Failed to write replay buffer to '%s'", save->path.array);
+	do_output_signal(stream->output, "writing_error");
+	replay_save_cancel(save);
+}
+
+static inline void replay_save_offset(struct replay_save *save,
+				      struct encoder_packet *pkt)
+{
+	if (pkt->type == OBS_ENCODER_VIDEO) {
+		pkt->dts_usec -= save->video_offset;
+		pkt->dts -= save->video_dts_offset;
+		pkt->pts -= save->video_dts_offset;
+	} else {
+		pkt->dts_usec -= save->audio_offsets[pkt->track_idx];
+		pkt->dts -= save->audio_dts_offsets[pkt->track_idx];
+		pkt->pts -= save->audio_dts_offsets[pkt->track_idx];
+	}
 }
 
 static void *replay_buffer_mux_thread(void *data)
 {
+	struct replay_save *save = data;
+	struct ffmpeg_muxer *stream = save->stream;
+	struct encoder_packet packets[SAVE_BATCH_SIZE];
+	uint64_t positions[SAVE_BATCH_SIZE];
+	DARRAY(uint8_t) ring_data = {0};
+	struct replay_ring *ring;
 	bool hasFailed = false;
-	struct ffmpeg_muxer *stream = data;
+	bool error = false;
+	bool lost = false;
+	size_t num;
 	int ret = 0;
 
 	do_output_signal(stream->output, "writing");
-	bool error = false;
 
-	start_pipe(stream, stream->path.array);
+	if (!save->inproc)
+		save->pipe = os_process_pipe_create(save->cmd.array, "w");
 
-	if (!stream->pipe) {
+	if (!save->pipe && !save->inproc) {
 		warn("Failed to create process pipe");
 		do_output_signal(stream->output, "writing_error");
+		replay_save_cancel(save);
 		hasFailed = true;
 		error = true;
-		goto error;
-	}
-
-	if (!send_headers(stream)) {
+	} else if (save->inproc ? !send_headers_inproc(stream, save->inproc)
+				: !send_headers_pipe(stream, save->pipe)) {
 		warn("Could not write headers for file '%s'",
-				stream->path.array);
+		     save->path.array);
 		do_output_signal(stream->output, "writing_error");
+		replay_save_cancel(save);
 		hasFailed = true;
 		error = true;
-		goto error;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
+	/* the buffer is written in the order the packets arrived in, which is
+	 * already interleaved by dts; ffmpeg-mux takes care of the rest */
+	while ((num = replay_save_fetch(save, packets, positions))) {
+		for (size_t i = 0; i < num; i++) {
+			struct encoder_packet *pkt = &packets[i];
+
+			if (save->ring && !hasFailed) {
+				struct replay_ring_packet rp = {
+					.pos = positions[i],
+					.size = (uint32_t)pkt->size};
+
+				da_resize(ring_data, pkt->size);
+				if (!replay_ring_read(save->ring, &rp,
+						      ring_data.array))
+					lost = true;
+				pkt->data = ring_data.array;
+			}
 
-		if (!hasFailed) {
-			hasFailed = !write_packet(stream, pkt);
+			if (!hasFailed && !lost) {
+				struct encoder_packet out = *pkt;
+				replay_save_offset(save, &out);
+
+				/* disk buffer data is read into a reused
+				 * buffer and can't be referenced */
+				bool success =
+					save->inproc
+						? write_packet_inproc(
+							  stream, save->inproc,
+							  &out, !save->ring)
+						: write_packet_pipe(stream,
+								    save->pipe,
+								    &out);
+				if (!success) {
+					replay_save_failed(save);
+					hasFailed = true;
+				}
+			}
+
+			if (!save->ring)
+				obs_encoder_packet_release(pkt);
 		}
 
-		obs_encoder_packet_release(pkt);
+		if (lost && !hasFailed) {
+			warn("Replay buffer data was overwritten before it "
+			     "could be saved");
+			do_output_signal(stream->output, "writing_error");
+			replay_save_cancel(save);
+			hasFailed = true;
+		}
 	}
 
-	if (!hasFailed) {
-		info("Wrote replay buffer to '%s'", stream->path.array);
+	if (os_atomic_load_bool(&save->stop) && !hasFailed) {
+		warn("Replay buffer was destroyed before '%s' could be saved",
+		     save->path.array);
+		do_output_signal(stream->output, "writing_error");
+		hasFailed = true;
 	}
-	
-error:
-	ret = os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
-	da_free(stream->mux_packets);
-	os_atomic_set_bool(&stream->muxing, false);
-	if (ret < 0) {
-		signal_failure(stream);
+
+	if (save->pipe) {
+		ret = os_process_pipe_destroy(save->pipe);
+		save->pipe = NULL;
+	} else if (save->inproc) {
+		ret = inproc_destroy(save->inproc);
+		save->inproc = NULL;
 	}
-	else if (!hasFailed) {
+
+	da_free(ring_data);
+
+	/* the last save of a stopped replay buffer unmaps its disk buffer */
+	pthread_mutex_lock(&stream->replay_mutex);
+	ring = save->ring;
+	save->ring = NULL;
+	pthread_mutex_unlock(&stream->replay_mutex);
+	replay_ring_release(ring);
+
+	if (ret < 0 && !hasFailed) {
+		warn("ffmpeg-mux exited with error %d while writing '%s'", ret,
+		     save->path.array);
+		do_output_signal(stream->output, "writing_error");
+	} else if (!hasFailed) {
+		info("Wrote replay buffer to '%s'", save->path.array);
 		do_output_signal(stream->output, "wrote");
 	}
 
+	os_atomic_dec_long(&stream->muxing);
+
 	if (!error) {
 		calldata_t cd = {0};
 		signal_handler_t *sh =
@@ -881,47 +1713,55 @@ error:
 		signal_handler_signal(sh, "saved", &cd);
 	}
 
+	os_atomic_set_bool(&save->done, true);
 	return NULL;
 }
 
 static void replay_buffer_save(struct ffmpeg_muxer *stream)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
+	struct replay_save *save = bzalloc(sizeof(*save));
+	size_t num_packets = replay_buffer_count(stream);
+	size_t num_tracks = 0;
+
+	save->stream = stream;
+	save->ring = stream->ring;
+	replay_ring_addref(save->ring);
+	save->next = stream->first_seq;
+	save->end = stream->first_seq + num_packets;
 
-	da_reserve(stream->mux_packets, num_packets);
+	while (obs_output_get_audio_encoder(stream->output, num_tracks))
+		num_tracks++;
 
 	/* ---------------------------- */
-	/* reorder packets */
+	/* find where each track starts, so they all start at zero */
 
 	bool found_video = false;
 	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+	size_t audio_found = 0;
 
 	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
+		struct encoder_packet pkt;
+		replay_buffer_peek(stream, i, &pkt, NULL);
 
-		if (pkt->type == OBS_ENCODER_VIDEO) {
+		if (pkt.type == OBS_ENCODER_VIDEO) {
 			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
+				save->video_offset = pkt.dts_usec;
+				save->video_dts_offset = pkt.dts;
 				found_video = true;
 			}
 		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
+			if (!found_audio[pkt.track_idx]) {
+				found_audio[pkt.track_idx] = true;
+				save->audio_offsets[pkt.track_idx] =
+					pkt.dts_usec;
+				save->audio_dts_offsets[pkt.track_idx] =
+					pkt.dts;
+				audio_found++;
 			}
 		}
 
-		insert_packet(&stream->mux_packets.da, pkt, video_offset,
-			      audio_offsets, video_dts_offset,
-			      audio_dts_offsets);
+		if (found_video && audio_found >= num_tracks)
+			break;
 	}
 
 	/* ---------------------------- */
@@ -932,24 +1772,121 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 	const char *fmt = obs_data_get_string(settings, "format");
 	const char *ext = obs_data_get_string(settings, "extension");
 	bool space = obs_data_get_bool(settings, "allow_spaces");
+	bool in_process = obs_data_get_bool(settings, "in_process");
 
 	char *filename = os_generate_formatted_filename(ext, space, fmt);
 
-	dstr_copy(&stream->path, dir);
-	dstr_replace(&stream->path, "\\", "/");
-	if (dstr_end(&stream->path) != '/')
-		dstr_cat_ch(&stream->path, '/');
-	dstr_cat(&stream->path, filename);
+	dstr_copy(&save->path, dir);
+	dstr_replace(&save->path, "\\", "/");
+	if (dstr_end(&save->path) != '/')
+		dstr_cat_ch(&save->path, '/');
+	dstr_cat(&save->path, filename);
 
 	bfree(filename);
 	obs_data_release(settings);
 
+	if (in_process) {
+		dstr_copy(&stream->path, save->path.array);
+		save->inproc = inproc_create(stream, save->path.array);
+	} else {
+		build_command_line(stream, &save->cmd, save->path.array);
+	}
+
 	/* ---------------------------- */
 
-	os_atomic_set_bool(&stream->muxing, true);
-	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
-						     replay_buffer_mux_thread,
-						     stream) == 0;
+	os_atomic_inc_long(&stream->muxing);
+
+	if (pthread_create(&save->thread, NULL, replay_buffer_mux_thread,
+			   save) != 0) {
+		warn("Failed to create replay buffer save thread");
+		os_atomic_dec_long(&stream->muxing);
+		circlebuf_free(&save->held);
+		inproc_destroy(save->inproc);
+		dstr_free(&save->cmd);
+		dstr_free(&save->path);
+		bfree(save);
+		return;
+	}
+
+	da_push_back(stream->saves, &save);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool purge_front(struct ffmpeg_muxer *stream)
+{
+	struct encoder_packet pkt;
+	bool keyframe;
+
+	replay_buffer_peek(stream, 0, &pkt, NULL);
+
+	if (replay_ring_active(stream->ring)) {
+		replay_buffer_hold_front(stream);
+		replay_ring_pop(stream->ring);
+	} else {
+		circlebuf_pop_front(&stream->packets, NULL, sizeof(pkt));
+		obs_encoder_packet_release(&pkt);
+	}
+
+	stream->first_seq++;
+
+	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+
+	if (keyframe)
+		stream->keyframes--;
+
+	if (!replay_buffer_count(stream)) {
+		stream->cur_size = 0;
+		stream->cur_time = 0;
+	} else {
+		struct encoder_packet first;
+		replay_buffer_peek(stream, 0, &first, NULL);
+		stream->cur_time = first.dts_usec;
+		stream->cur_size -= (int64_t)pkt.size;
+	}
+
+	return keyframe;
+}
+
+/* purges the first packet, or the whole group of pictures if it's a
+ * keyframe.  nothing is purged while a save still needs it */
+static bool purge(struct ffmpeg_muxer *stream)
+{
+	size_t count = replay_buffer_count(stream);
+	size_t num = 1;
+
+	if (replay_buffer_keyframe(stream, 0)) {
+		while (num < count && !replay_buffer_keyframe(stream, num))
+			num++;
+	}
+
+	if (replay_buffer_pinned(stream, stream->first_seq + num - 1))
+		return false;
+
+	while (num--)
+		purge_front(stream);
+	return true;
+}
+
+static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
+				       struct encoder_packet *pkt)
+{
+	if (stream->max_size) {
+		if (!replay_buffer_count(stream) || stream->keyframes <= 2)
+			return;
+
+		while ((stream->cur_size + (int64_t)pkt->size) >
+		       stream->max_size)
+			if (!purge(stream))
+				return;
+	}
+
+	if (!replay_buffer_count(stream) || stream->keyframes <= 2)
+		return;
+
+	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
+		if (!purge(stream))
+			return;
 }
 
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
@@ -963,7 +1900,16 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 	os_atomic_set_bool(&stream->active, false);
 	os_atomic_set_bool(&stream->sent_headers, false);
 	os_atomic_set_bool(&stream->stopping, false);
+
+	replay_buffer_reap_saves(stream, false);
+
+	/* this runs on the output's data thread, so it can't wait for saves.
+	 * they finish with the packets handed over to them, disk buffer saves
+	 * keep the ring mapped until they're done */
+	pthread_mutex_lock(&stream->replay_mutex);
+	replay_buffer_detach_saves(stream);
 	replay_buffer_clear(stream);
+	pthread_mutex_unlock(&stream->replay_mutex);
 }
 
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
@@ -987,39 +1933,73 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
+	pthread_mutex_lock(&stream->replay_mutex);
+
+	if (replay_ring_active(stream->ring)) {
+		replay_buffer_purge(stream, packet);
+
+		/* the file may still be fragmented or partly in use by a
+		 * save, so make room if needed */
+		while (!replay_ring_push(stream->ring, packet)) {
+			if (!replay_buffer_count(stream)) {
+				pthread_mutex_unlock(&stream->replay_mutex);
+				warn("Packet of %llu bytes does not fit in the "
+				     "disk buffer",
+				     (unsigned long long)packet->size);
+				return;
+			}
+			purge(stream);
+		}
+
+		if (replay_buffer_count(stream) == 1)
+			stream->cur_time = packet->dts_usec;
+		stream->cur_size += packet->size;
+	} else {
+		obs_encoder_packet_ref(&pkt, packet);
+		replay_buffer_purge(stream, &pkt);
 
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
+		if (!stream->packets.size)
+			stream->cur_time = pkt.dts_usec;
+		stream->cur_size += pkt.size;
 
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
+		circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
+	}
+
+	pthread_mutex_unlock(&stream->replay_mutex);
 
 	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
 		stream->keyframes++;
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
-		if (os_atomic_load_bool(&stream->muxing))
-			return;
-
-		if (stream->mux_thread_joinable) {
-			pthread_join(stream->mux_thread, NULL);
-			stream->mux_thread_joinable = false;
-		}
+		replay_buffer_reap_saves(stream, false);
 
 		stream->save_ts = 0;
 		replay_buffer_save(stream);
 	}
 }
 
+static void replay_buffer_destroy(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	if (stream->hotkey)
+		obs_hotkey_unregister(stream->hotkey);
+
+	replay_buffer_stop_saves(stream);
+	replay_buffer_reap_saves(stream, true);
+	da_free(stream->saves);
+	pthread_mutex_destroy(&stream->replay_mutex);
+	ffmpeg_mux_destroy(data);
+}
+
 static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
+	obs_data_set_default_bool(s, "disk_buffer", false);
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
+	obs_data_set_default_bool(s, "in_process", false);
 }
 
 struct obs_output_info replay_buffer = {
@@ -10,9 +10,16 @@
 #include <util/platform.h>
 #include <util/threading.h>
 
+#include "obs-ffmpeg-replay-ring.h"
+
+struct replay_save;
+struct mux_inproc;
+
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
+	/* used instead of pipe when muxing in-process */
+	struct mux_inproc *inproc;
 	int64_t stop_ts;
 	uint64_t total_bytes;
 	bool sent_headers;
@@ -32,8 +39,17 @@ struct ffmpeg_muxer {
 	int64_t save_ts;
 	int keyframes;
 	obs_hotkey_id hotkey;
-	volatile bool muxing;
-	DARRAY(struct encoder_packet) mux_packets;
+	volatile long muxing;
+
+	/* disk-backed replay buffer; when set, packets are stored in the ring
+	 * instead of the packets circlebuf */
+	struct replay_ring *ring;
+
+	/* saves in progress read the buffer from their own threads, so the
+	 * output thread locks replay_mutex whenever it changes the buffer */
+	pthread_mutex_t replay_mutex;
+	uint64_t first_seq;
+	DARRAY(struct replay_save *) saves;
 
 	/* these are accessed both by replay buffer and by HLS */
 	pthread_t mux_thread;
@@ -51,6 +67,28 @@ struct ffmpeg_muxer {
 	int64_t last_dts_usec;
 
 	bool is_network;
+
+	/* ffmpeg_muxer/ffmpeg_mpegts_muxer only: packets are queued by the
+	 * encoder thread and written to the pipe by the writer thread, so a
+	 * stalled disk never blocks the encoders */
+	pthread_t writer_thread;
+	bool writer_thread_joinable;
+	pthread_mutex_t writer_mutex;
+	os_sem_t *writer_sem;
+	struct circlebuf writer_packets;
+	size_t writer_bytes;
+	size_t writer_max_bytes;
+	bool writer_drop_video;
+	bool writer_finishing;
+	bool writer_overflow;
+	bool writer_abort;
+
+	/* writer statistics, protected by writer_mutex */
+	size_t writer_peak_bytes;
+	uint64_t writer_dropped;
+	uint64_t writer_stalls;
+	uint64_t writer_stall_ns;
+	uint64_t writer_max_stall_ns;
 };
 
 bool stopping(struct ffmpeg_muxer *stream);
@@ -0,0 +1,263 @@
+#include "obs-ffmpeg-replay-ring.h"
+
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef _WIN32
+static bool map_file(struct replay_ring *ring, const char *dir,
+		     size_t capacity)
+{
+	struct dstr path = {0};
+	wchar_t *wpath = NULL;
+	uint64_t size = capacity;
+
+	dstr_printf(&path, "%s/obs-replay-%llx.tmp", dir,
+		    (unsigned long long)os_gettime_ns());
+	os_utf8_to_wcs_ptr(path.array, path.len, &wpath);
+	dstr_free(&path);
+
+	if (!wpath)
+		return false;
+
+	/* the file is deleted by the system as soon as it's closed */
+	ring->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+				 CREATE_NEW,
+				 FILE_ATTRIBUTE_TEMPORARY |
+					 FILE_ATTRIBUTE_HIDDEN |
+					 FILE_FLAG_DELETE_ON_CLOSE,
+				 NULL);
+	bfree(wpath);
+
+	if (ring->file == INVALID_HANDLE_VALUE) {
+		ring->file = NULL;
+		return false;
+	}
+
+	/* the file isn't sparse, so setting its size allocates the space and
+	 * fails if the disk is full, rather than a write to the mapping */
+	LARGE_INTEGER end = {.QuadPart = (LONGLONG)size};
+	if (!SetFilePointerEx(ring->file, end, NULL, FILE_BEGIN) ||
+	    !SetEndOfFile(ring->file)) {
+		blog(LOG_WARNING,
+		     "replay_ring_create: Not enough free space in '%s'", dir);
+		return false;
+	}
+
+	ring->mapping = CreateFileMappingW(ring->file, NULL, PAGE_READWRITE,
+					   (DWORD)(size >> 32), (DWORD)size,
+					   NULL);
+	if (!ring->mapping)
+		return false;
+
+	ring->data = MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+				   capacity);
+	return ring->data != NULL;
+}
+
+static void unmap_file(struct replay_ring *ring)
+{
+	if (ring->data)
+		UnmapViewOfFile(ring->data);
+	if (ring->mapping)
+		CloseHandle(ring->mapping);
+	if (ring->file)
+		CloseHandle(ring->file);
+
+	ring->mapping = NULL;
+	ring->file = NULL;
+}
+
+#else
+/* a sparse file would only get its blocks when the mapping is written to,
+ * which raises SIGBUS once the disk is full */
+static bool reserve_file(int fd, size_t size)
+{
+#ifdef __APPLE__
+	fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+
+	if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+		return false;
+	return ftruncate(fd, (off_t)size) == 0;
+#else
+	return posix_fallocate(fd, 0, (off_t)size) == 0;
+#endif
+}
+
+static bool map_file(struct replay_ring *ring, const char *dir,
+		     size_t capacity)
+{
+	struct dstr path = {0};
+	void *data;
+
+	dstr_printf(&path, "%s/.obs-replay-XXXXXX", dir);
+	ring->fd = mkstemp(path.array);
+
+	/* only the mapping is needed, so the file can go right away */
+	if (ring->fd != -1)
+		unlink(path.array);
+	dstr_free(&path);
+
+	if (ring->fd == -1)
+		return false;
+	if (!reserve_file(ring->fd, capacity)) {
+		blog(LOG_WARNING,
+		     "replay_ring_create: Not enough free space in '%s'", dir);
+		return false;
+	}
+
+	data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    ring->fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+
+	ring->data = data;
+	return true;
+}
+
+static void unmap_file(struct replay_ring *ring)
+{
+	if (ring->data)
+		munmap(ring->data, ring->capacity);
+	if (ring->fd != -1)
+		close(ring->fd);
+
+	ring->fd = -1;
+}
+#endif
+
+struct replay_ring *replay_ring_create(const char *dir, size_t capacity)
+{
+	struct replay_ring *ring;
+
+	if (!capacity)
+		return NULL;
+
+	ring = bzalloc(sizeof(*ring));
+	ring->refs = 1;
+	ring->capacity = capacity;
+#ifndef _WIN32
+	ring->fd = -1;
+#endif
+
+	if (pthread_mutex_init(&ring->write_mutex, NULL) != 0) {
+		bfree(ring);
+		return NULL;
+	}
+
+	if (!map_file(ring, dir, capacity)) {
+		blog(LOG_WARNING,
+		     "replay_ring_create: Failed to map %llu bytes "
+		     "in '%s'",
+		     (unsigned long long)capacity, dir);
+		unmap_file(ring);
+		pthread_mutex_destroy(&ring->write_mutex);
+		bfree(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+void replay_ring_addref(struct replay_ring *ring)
+{
+	if (ring)
+		os_atomic_inc_long(&ring->refs);
+}
+
+void replay_ring_release(struct replay_ring *ring)
+{
+	if (!ring || os_atomic_dec_long(&ring->refs) != 0)
+		return;
+
+	unmap_file(ring);
+	pthread_mutex_destroy(&ring->write_mutex);
+	circlebuf_free(&ring->packets);
+	bfree(ring);
+}
+
+bool replay_ring_push(struct replay_ring *ring,
+		      const struct encoder_packet *packet)
+{
+	struct replay_ring_packet entry;
+	uint64_t pos = ring->tail;
+	size_t offset = (size_t)(pos % ring->capacity);
+
+	if (packet->size > ring->capacity)
+		return false;
+
+	/* packets are never split, so skip to the start of the file if this
+	 * one doesn't fit at the end */
+	if (offset + packet->size > ring->capacity) {
+		pos += ring->capacity - offset;
+		offset = 0;
+	}
+
+	if (pos + packet->size - ring->head > ring->capacity)
+		return false;
+
+	/* must be visible to readers before anything is written over popped
+	 * data */
+	pthread_mutex_lock(&ring->write_mutex);
+	ring->written = pos + packet->size;
+	pthread_mutex_unlock(&ring->write_mutex);
+
+	memcpy(ring->data + offset, packet->data, packet->size);
+	ring->tail = pos + packet->size;
+
+	entry.pos = pos;
+	entry.dts = packet->dts;
+	entry.pts = packet->pts;
+	entry.dts_usec = packet->dts_usec;
+	entry.size = (uint32_t)packet->size;
+	entry.track_idx = (uint8_t)packet->track_idx;
+	entry.type = (uint8_t)packet->type;
+	entry.keyframe = packet->keyframe;
+	circlebuf_push_back(&ring->packets, &entry, sizeof(entry));
+	return true;
+}
+
+void replay_ring_pop(struct replay_ring *ring)
+{
+	circlebuf_pop_front(&ring->packets, NULL,
+			    sizeof(struct replay_ring_packet));
+
+	ring->head = ring->packets.size ? replay_ring_get(ring, 0)->pos
+					: ring->tail;
+}
+
+/* popping a packet leaves its data untouched until the space is reused, so
+ * it's only lost once the writer is a whole lap past it */
+static inline bool overwritten(struct replay_ring *ring, uint64_t pos)
+{
+	bool overwritten;
+
+	pthread_mutex_lock(&ring->write_mutex);
+	overwritten = ring->written > pos + ring->capacity;
+	pthread_mutex_unlock(&ring->write_mutex);
+
+	return overwritten;
+}
+
+bool replay_ring_read(struct replay_ring *ring,
+		      const struct replay_ring_packet *packet, uint8_t *data)
+{
+	if (overwritten(ring, packet->pos))
+		return false;
+
+	memcpy(data, ring->data + (size_t)(packet->pos % ring->capacity),
+	       packet->size);
+
+	/* if the writer reached the packet while copying, the data may have
+	 * been partially overwritten */
+	return !overwritten(ring, packet->pos);
+}
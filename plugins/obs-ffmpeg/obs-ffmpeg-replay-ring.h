@@ -0,0 +1,92 @@
+#pragma once
+
+#include <obs.h>
+#include <util/circlebuf.h>
+#include <util/threading.h>
+
+/*
+ * Disk-backed storage for the replay buffer.
+ *
+ * Packet data is appended to a memory-mapped file that is used as a ring,
+ * and only a small index entry per packet is kept in memory.  Each packet is
+ * stored contiguously; if it doesn't fit before the end of the file it's
+ * placed at the start instead.
+ *
+ * Positions are free-running byte counters.  The output thread pushes and
+ * pops packets.  Popping only makes the space reusable, so a mux thread can
+ * keep reading a popped packet until newer packets are actually written
+ * over it, and replay_ring_read tells it when that happened.
+ *
+ * The file's blocks are reserved up front, so running out of disk space
+ * fails replay_ring_create instead of faulting on a write to the mapping.
+ *
+ * Rings are reference counted: saves that are still reading keep the file
+ * mapped after the replay buffer stops.
+ */
+
+struct replay_ring_packet {
+	uint64_t pos;
+	int64_t dts;
+	int64_t pts;
+	int64_t dts_usec;
+	uint32_t size;
+	uint8_t track_idx;
+	uint8_t type;
+	bool keyframe;
+};
+
+struct replay_ring {
+	volatile long refs;
+	uint8_t *data;
+	size_t capacity;
+
+	uint64_t head;
+	uint64_t tail;
+
+	/* end of the data the output thread has started writing, read by the
+	 * mux thread to detect overwritten data */
+	pthread_mutex_t write_mutex;
+	uint64_t written;
+
+	struct circlebuf packets;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#else
+	int fd;
+#endif
+};
+
+extern struct replay_ring *replay_ring_create(const char *dir,
+					      size_t capacity);
+extern void replay_ring_addref(struct replay_ring *ring);
+extern void replay_ring_release(struct replay_ring *ring);
+
+/* returns false if there isn't enough free space for the packet */
+extern bool replay_ring_push(struct replay_ring *ring,
+			     const struct encoder_packet *packet);
+extern void replay_ring_pop(struct replay_ring *ring);
+
+/* copies the packet data out of the ring, the packet may already have been
+ * popped; returns false if the data has been overwritten by newer packets */
+extern bool replay_ring_read(struct replay_ring *ring,
+			     const struct replay_ring_packet *packet,
+			     uint8_t *data);
+
+static inline bool replay_ring_active(const struct replay_ring *ring)
+{
+	return ring != NULL;
+}
+
+static inline size_t replay_ring_count(const struct replay_ring *ring)
+{
+	return ring->packets.size / sizeof(struct replay_ring_packet);
+}
+
+static inline struct replay_ring_packet *
+replay_ring_get(struct replay_ring *ring, size_t idx)
+{
+	return circlebuf_data(&ring->packets,
+			      idx * sizeof(struct replay_ring_packet));
+}
@@ -169,15 +169,14 @@ void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+/* writes the tag header along with the extra codec bytes that go in front of
+ * the packet data */
+static void flv_video_header(struct serializer *s, int32_t dts_offset,
+			     struct encoder_packet *packet, bool is_header)
 {
 	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -198,20 +197,13 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	s_w8(s, packet->keyframe ? 0x17 : 0x27);
 	s_w8(s, is_header ? 0 : 1);
 	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
-
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static void flv_audio_header(struct serializer *s, int32_t dts_offset,
+			     struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -231,6 +223,28 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 	/* these are the two extra bytes mentioned above */
 	s_w8(s, 0xaf);
 	s_w8(s, is_header ? 0 : 1);
+}
+
+static void flv_video(struct serializer *s, int32_t dts_offset,
+		      struct encoder_packet *packet, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_video_header(s, dts_offset, packet, is_header);
+	s_write(s, packet->data, packet->size);
+
+	/* write tag size (starting byte doesn't count) */
+	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
+}
+
+static void flv_audio(struct serializer *s, int32_t dts_offset,
+		      struct encoder_packet *packet, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_audio_header(s, dts_offset, packet, is_header);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
@@ -254,6 +268,62 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 	*size = data.bytes.num;
 }
 
+struct fixed_output_data {
+	uint8_t *bytes;
+	size_t size;
+	size_t pos;
+};
+
+static size_t fixed_output_write(void *param, const void *data, size_t size)
+{
+	struct fixed_output_data *out = param;
+
+	if (size > out->size - out->pos)
+		size = out->size - out->pos;
+
+	memcpy(out->bytes + out->pos, data, size);
+	out->pos += size;
+	return size;
+}
+
+static int64_t fixed_output_get_pos(void *param)
+{
+	struct fixed_output_data *out = param;
+	return (int64_t)out->pos;
+}
+
+bool flv_packet_mux_tag(struct encoder_packet *packet, int32_t dts_offset,
+			struct flv_tag *tag, bool is_header)
+{
+	struct fixed_output_data out = {tag->header, sizeof(tag->header), 0};
+	struct serializer s = {0};
+	uint32_t tag_size;
+
+	if (!packet->data || !packet->size)
+		return false;
+
+	s.data = &out;
+	s.write = fixed_output_write;
+	s.get_pos = fixed_output_get_pos;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		flv_video_header(&s, dts_offset, packet, is_header);
+	else
+		flv_audio_header(&s, dts_offset, packet, is_header);
+
+	tag->header_size = out.pos;
+	tag->payload = packet->data;
+	tag->payload_size = packet->size;
+
+	/* tag size, same as flv_video/flv_audio write it */
+	tag_size = (uint32_t)(tag->header_size + tag->payload_size - 1);
+	tag->trailer[0] = (uint8_t)(tag_size >> 24);
+	tag->trailer[1] = (uint8_t)(tag_size >> 16);
+	tag->trailer[2] = (uint8_t)(tag_size >> 8);
+	tag->trailer[3] = (uint8_t)tag_size;
+	return true;
+}
+
 /* ------------------------------------------------------------------------- */
 /* stuff for additional media streams                                        */
 
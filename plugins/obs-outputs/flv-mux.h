@@ -26,6 +26,19 @@ static int32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 	return (int32_t)(val * MILLISECOND_DEN / packet->timebase_den);
 }
 
+#define FLV_TAG_HEADER_SIZE 11
+
+/* an FLV tag split up so the packet data doesn't have to be copied: the tag
+ * header plus the codec bytes in front of the data, the packet data itself
+ * (still owned by the packet), and the trailing tag size */
+struct flv_tag {
+	uint8_t header[FLV_TAG_HEADER_SIZE + 5];
+	size_t header_size;
+	const uint8_t *payload;
+	size_t payload_size;
+	uint8_t trailer[4];
+};
+
 extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
@@ -34,6 +47,9 @@ extern void flv_additional_meta_data(obs_output_t *context, uint8_t **output,
 				     size_t *size);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 			   uint8_t **output, size_t *size, bool is_header);
+extern bool flv_packet_mux_tag(struct encoder_packet *packet,
+			       int32_t dts_offset, struct flv_tag *tag,
+			       bool is_header);
 extern void flv_additional_packet_mux(struct encoder_packet *packet,
 				      int32_t dts_offset, uint8_t **output,
 				      size_t *size, bool is_header,
@@ -1619,6 +1619,128 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+#define RTMP_MAX_IOV 64
+
+#if defined(_WIN32)
+typedef WSABUF RTMPIOVec;
+#define RTMP_IOV_SET(v, p, l) ((v)->buf = (char *)(p), (v)->len = (ULONG)(l))
+#else
+typedef struct iovec RTMPIOVec;
+#define RTMP_IOV_SET(v, p, l) ((v)->iov_base = (void *)(p), (v)->iov_len = (size_t)(l))
+#endif
+
+static int
+SendVSocket(RTMPSockBuf *sb, RTMPIOVec *iov, int count)
+{
+#if defined(_WIN32)
+    DWORD sent = 0;
+    if (WSASend(sb->sb_socket, iov, (DWORD)count, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return (int)sendmsg(sb->sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+}
+
+/* Writes several buffers as one contiguous stream.  On a plain socket they are
+ * handed to the kernel in a single gather write, otherwise each one goes
+ * through WriteN. */
+static int
+WriteV(RTMP *r, const RTMPBufVec *vec, int count)
+{
+    RTMPIOVec iov[RTMP_MAX_IOV];
+    int first = 0;
+    int skip = 0;
+    int i;
+
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+    {
+        /* keep it to one HTTP request */
+        char *buf, *ptr;
+        int len = 0, wrote;
+
+        for (i = 0; i < count; i++)
+            len += vec[i].len;
+        buf = ptr = malloc(len);
+        if (!buf)
+            return FALSE;
+        for (i = 0; i < count; i++)
+        {
+            memcpy(ptr, vec[i].data, vec[i].len);
+            ptr += vec[i].len;
+        }
+        wrote = WriteN(r, buf, len);
+        free(buf);
+        return wrote;
+    }
+
+    if ((r->m_bCustomSend && r->m_customSendFunc) || r->m_sb.sb_ssl
+#ifdef CRYPTO
+            || r->Link.rc4keyOut
+#endif
+       )
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (vec[i].len && !WriteN(r, vec[i].data, vec[i].len))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    while (first < count)
+    {
+        int n = 0, nBytes;
+
+        for (i = first; i < count && n < RTMP_MAX_IOV; i++)
+        {
+            int off = i == first ? skip : 0;
+            if (vec[i].len - off)
+            {
+                RTMP_IOV_SET(&iov[n], vec[i].data + off, vec[i].len - off);
+                n++;
+            }
+        }
+
+        if (!n)
+            break;
+
+        nBytes = SendVSocket(&r->m_sb, iov, n);
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip past whatever was sent, partial writes included */
+        while (first < count && nBytes >= vec[first].len - skip)
+        {
+            nBytes -= vec[first].len - skip;
+            first++;
+            skip = 0;
+        }
+        skip += nBytes;
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -4066,18 +4188,20 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* Builds the chunk header of packet.  The header is placed right in front of
+ * m_body when the packet has a body, otherwise it's built in hbuf, which must
+ * be at least RTMP_MAX_HEADER_SIZE bytes.  On return, c holds the first byte
+ * of the basic header, which continuation chunks are derived from. */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *hbuf, char **pheader,
+                   int *phSize, int *pcSize, char *pc)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *header, *hptr, *hend, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4130,7 +4254,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     else
     {
         header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
+        hend = hbuf + RTMP_MAX_HEADER_SIZE;
     }
 
     if (packet->m_nChannel > 319)
@@ -4188,6 +4312,26 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *pheader = header;
+    *phSize = hSize;
+    *pcSize = cSize;
+    *pc = c;
+    return TRUE;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (!EncodePacketHeader(r, packet, hbuf, &header, &hSize, &cSize, &c))
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -5372,3 +5516,105 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+int
+RTMP_WriteTag(RTMP *r, const char *tagHeader, const RTMPBufVec *body,
+              int count, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    RTMPBufVec stackVec[RTMP_MAX_IOV], *vec = stackVec;
+    char hbuf[RTMP_MAX_HEADER_SIZE], cbuf[3], *header, c;
+    int hSize, cSize, nChunkSize, left, chunks, vecMax, n = 0, i, ret;
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = tagHeader[0];
+    packet.m_nBodySize = AMF_DecodeInt24(tagHeader + 1);
+    packet.m_nTimeStamp = AMF_DecodeInt24(tagHeader + 4);
+    packet.m_nTimeStamp |= (uint32_t)(uint8_t)tagHeader[7] << 24;
+
+    if (((packet.m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || packet.m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !packet.m_nTimeStamp) || packet.m_packetType == RTMP_PACKET_TYPE_INFO)
+        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    else
+        packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+
+    left = 0;
+    for (i = 0; i < count; i++)
+        left += body[i].len;
+    if ((uint32_t)left != packet.m_nBodySize)
+    {
+        RTMP_Log(RTMP_LOGERROR, "%s, tag size mismatch: %u != %d", __FUNCTION__,
+                 packet.m_nBodySize, left);
+        return -1;
+    }
+
+    if (!EncodePacketHeader(r, &packet, hbuf, &header, &hSize, &cSize, &c))
+        return -1;
+
+    /* every chunk after the first one starts with a small header, and body
+     * pieces are split up wherever a chunk boundary falls inside of them */
+    nChunkSize = r->m_outChunkSize;
+    chunks = (packet.m_nBodySize + nChunkSize - 1) / nChunkSize;
+    vecMax = 1 + count + chunks * 2;
+    if (vecMax > RTMP_MAX_IOV)
+    {
+        vec = malloc(sizeof(*vec) * vecMax);
+        if (!vec)
+            return -1;
+    }
+
+    cbuf[0] = 0xc0 | c;
+    if (cSize)
+    {
+        int tmp = packet.m_nChannel - 64;
+        cbuf[1] = tmp & 0xff;
+        if (cSize == 2)
+            cbuf[2] = tmp >> 8;
+    }
+
+    vec[n].data = header;
+    vec[n++].len = hSize;
+
+    left = nChunkSize;
+    for (i = 0; i < count; i++)
+    {
+        const char *data = body[i].data;
+        int len = body[i].len;
+
+        while (len > 0)
+        {
+            int num;
+
+            if (!left)
+            {
+                vec[n].data = cbuf;
+                vec[n++].len = 1 + cSize;
+                left = nChunkSize;
+            }
+
+            num = len < left ? len : left;
+            vec[n].data = data;
+            vec[n++].len = num;
+            data += num;
+            len -= num;
+            left -= num;
+        }
+    }
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%u", __FUNCTION__, (int)r->m_sb.sb_socket,
+             packet.m_nBodySize);
+
+    ret = WriteV(r, vec, n);
+    if (vec != stackVec)
+        free(vec);
+    if (!ret)
+        return -1;
+
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+
+    return 11 + packet.m_nBodySize + 4;
+}
@@ -273,6 +273,13 @@ extern "C"
         void *sb_ssl;
     } RTMPSockBuf;
 
+    /* a piece of a buffer that is written out as part of a larger message */
+    typedef struct RTMPBufVec
+    {
+        const char *data;
+        int len;
+    } RTMPBufVec;
+
     void RTMPPacket_Reset(RTMPPacket *p);
     void RTMPPacket_Dump(RTMPPacket *p);
     int RTMPPacket_Alloc(RTMPPacket *p, uint32_t nSize);
@@ -540,6 +547,12 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* Sends one FLV tag without copying its body.  tagHeader is the 11 byte
+     * FLV tag header, and the tag body is made up of the count pieces in body,
+     * which are written straight to the socket. */
+    int RTMP_WriteTag(RTMP *r, const char *tagHeader, const RTMPBufVec *body,
+                      int count, int streamIdx);
+
 #ifdef USE_HASHSWF
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
@@ -75,20 +75,17 @@ static inline size_t num_buffered_packets(struct rtmp_stream *stream);
 
 static inline void free_packets(struct rtmp_stream *stream)
 {
+	struct encoder_packet packet;
 	size_t num_packets;
 
-	pthread_mutex_lock(&stream->packets_mutex);
-
 	num_packets = num_buffered_packets(stream);
 	if (num_packets)
 		info("Freeing %d remaining packets", (int)num_packets);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	/* consumer side of the packet ring, only ever called while the send
+	 * thread is not popping packets */
+	while (spsc_ring_pop_front(&stream->packets, &packet))
 		obs_encoder_packet_release(&packet);
-	}
-	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
 static inline bool stopping(struct rtmp_stream *stream)
@@ -142,8 +139,7 @@ static void rtmp_stream_destroy(void *data)
 	dstr_free(&stream->bind_ip);
 	os_event_destroy(stream->stop_event);
 	os_sem_destroy(stream->send_sem);
-	pthread_mutex_destroy(&stream->packets_mutex);
-	circlebuf_free(&stream->packets);
+	spsc_ring_free(&stream->packets);
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
@@ -165,14 +161,14 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
-	pthread_mutex_init_value(&stream->packets_mutex);
 
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
 
-	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
-		goto fail;
+	spsc_ring_init(&stream->packets, sizeof(struct encoder_packet),
+		       MAX_BUFFERED_PACKETS);
+
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
@@ -258,17 +254,7 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 static inline bool get_next_packet(struct rtmp_stream *stream,
 				   struct encoder_packet *packet)
 {
-	bool new_packet = false;
-
-	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				    sizeof(struct encoder_packet));
-		new_packet = true;
-	}
-	pthread_mutex_unlock(&stream->packets_mutex);
-
-	return new_packet;
+	return spsc_ring_pop_front(&stream->packets, packet);
 }
 
 static bool discard_recv_data(struct rtmp_stream *stream, size_t size)
@@ -424,6 +410,7 @@ static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
 {
+	struct flv_tag tag;
 	uint8_t *data;
 	size_t size;
 	int recv_size = 0;
@@ -449,17 +436,40 @@ static int send_packet(struct rtmp_stream *stream,
 		flv_additional_packet_mux(
 			packet, is_header ? 0 : stream->start_dts_offset, &data,
 			&size, is_header, idx);
-	} else {
-		flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-			       &data, &size, is_header);
-	}
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
+#endif
+
+		ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
+		bfree(data);
+	} else if (flv_packet_mux_tag(packet,
+				      is_header ? 0 : stream->start_dts_offset,
+				      &tag, is_header)) {
+		/* the packet data is sent straight from the encoder packet
+		 * instead of being copied into a muxed buffer first */
+		RTMPBufVec body[2] = {
+			{(const char *)tag.header + FLV_TAG_HEADER_SIZE,
+			 (int)(tag.header_size - FLV_TAG_HEADER_SIZE)},
+			{(const char *)tag.payload, (int)tag.payload_size},
+		};
+
+		size = tag.header_size + tag.payload_size + sizeof(tag.trailer);
+
+#ifdef TEST_FRAMEDROPS
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+		ret = RTMP_WriteTag(&stream->rtmp, (const char *)tag.header,
+				    body, 2, 0);
+	} else {
+		/* nothing to send, like writing an empty buffer */
+		size = 0;
+		ret = 0;
+	}
+
+	if (ret >= 0 && !is_header)
+		obs_latency_trace_packet(OBS_LATENCY_SEND, packet);
 
 	if (is_header)
 		bfree(packet->data);
@@ -1184,14 +1194,22 @@ static bool rtmp_stream_start(void *data)
 static inline bool add_packet(struct rtmp_stream *stream,
 			      struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			    sizeof(struct encoder_packet));
+	if (!spsc_ring_push_back(&stream->packets, packet)) {
+		/* the send thread is hopelessly behind; drop video until the
+		 * next keyframe so the stream can recover cleanly */
+		if (packet->type == OBS_ENCODER_VIDEO) {
+			stream->min_priority = OBS_NAL_PRIORITY_HIGHEST;
+			stream->dropped_frames++;
+		}
+		return false;
+	}
+
 	return true;
 }
 
 static inline size_t num_buffered_packets(struct rtmp_stream *stream)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	return spsc_ring_size(&stream->packets);
 }
 
 static void drop_frames(struct rtmp_stream *stream, const char *name,
@@ -1199,7 +1217,7 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 {
 	UNUSED_PARAMETER(pframes);
 
-	struct circlebuf new_buf = {0};
+	unsigned long end = spsc_ring_end(&stream->packets);
 	int num_frames_dropped = 0;
 
 #ifdef _DEBUG
@@ -1208,26 +1226,25 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 	UNUSED_PARAMETER(name);
 #endif
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
-
-	while (stream->packets.size) {
+	/* packets are revoked in place rather than rebuilding the queue, so
+	 * the send thread can keep popping while frames are being dropped */
+	for (unsigned long pos = spsc_ring_begin(&stream->packets); pos != end;
+	     pos++) {
+		struct encoder_packet *cur =
+			spsc_ring_peek(&stream->packets, pos);
 		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
 
 		/* do not drop audio data or video keyframes */
-		if (packet.type == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority >= highest_priority) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+		if (!cur || cur->type == OBS_ENCODER_AUDIO ||
+		    cur->drop_priority >= highest_priority)
+			continue;
 
-		} else {
+		if (spsc_ring_revoke(&stream->packets, pos, &packet)) {
 			num_frames_dropped++;
 			obs_encoder_packet_release(&packet);
 		}
 	}
 
-	circlebuf_free(&stream->packets);
-	stream->packets = new_buf;
-
 	if (stream->min_priority < highest_priority)
 		stream->min_priority = highest_priority;
 	if (!num_frames_dropped)
@@ -1243,12 +1260,13 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 static bool find_first_video_packet(struct rtmp_stream *stream,
 				    struct encoder_packet *first)
 {
-	size_t count = stream->packets.size / sizeof(*first);
+	unsigned long end = spsc_ring_end(&stream->packets);
 
-	for (size_t i = 0; i < count; i++) {
+	for (unsigned long pos = spsc_ring_begin(&stream->packets); pos != end;
+	     pos++) {
 		struct encoder_packet *cur =
-			circlebuf_data(&stream->packets, i * sizeof(*first));
-		if (cur->type == OBS_ENCODER_VIDEO && !cur->keyframe) {
+			spsc_ring_peek(&stream->packets, pos);
+		if (cur && cur->type == OBS_ENCODER_VIDEO && !cur->keyframe) {
 			*first = *cur;
 			return true;
 		}
@@ -1487,16 +1505,14 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		obs_encoder_packet_ref(&new_packet, packet);
 	}
 
-	pthread_mutex_lock(&stream->packets_mutex);
-
+	/* the output's interleave lock serializes this callback, so this is
+	 * the single producer of the packet ring */
 	if (!disconnected(stream)) {
 		added_packet = (packet->type == OBS_ENCODER_VIDEO)
 				       ? add_video_packet(stream, &new_packet)
 				       : add_packet(stream, &new_packet);
 	}
 
-	pthread_mutex_unlock(&stream->packets_mutex);
-
 	if (added_packet)
 		os_sem_post(stream->send_sem);
 	else
@@ -2,6 +2,7 @@
 #include <obs-avc.h>
 #include <util/platform.h>
 #include <util/circlebuf.h>
+#include <util/spsc-ring.h>
 #include <util/dstr.h>
 #include <util/threading.h>
 #include <inttypes.h>
@@ -33,6 +34,9 @@
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
 #define OPT_METADATA_MULTITRACK "metadata_multitrack"
 
+/* upper bound of packets waiting to be sent, well past any drop threshold */
+#define MAX_BUFFERED_PACKETS 8192
+
 //#define TEST_FRAMEDROPS
 //#define TEST_FRAMEDROPS_WITH_BITRATE_SHORTCUTS
 
@@ -56,8 +60,7 @@ struct dbr_frame {
 struct rtmp_stream {
 	obs_output_t *output;
 
-	pthread_mutex_t packets_mutex;
-	struct circlebuf packets;
+	struct spsc_ring packets;
 	bool sent_headers;
 
 	bool got_first_video;
@@ -0,0 +1,92 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include <media-io/audio-math.h>
+
+#define TEST_FRAMES 1024
+
+static void fill_random(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] = ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+}
+
+static void mix_scalar(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void audio_mix_bit_exact_test(void **state)
+{
+	float src[TEST_FRAMES];
+	float expected[TEST_FRAMES];
+	float actual[TEST_FRAMES];
+
+	srand(1234);
+
+	/* cover every tail length and every misaligned start point */
+	for (size_t start = 0; start < 17; start++) {
+		size_t count = TEST_FRAMES - start;
+
+		fill_random(src, TEST_FRAMES);
+		fill_random(expected, TEST_FRAMES);
+		memcpy(actual, expected, sizeof(actual));
+
+		/* accumulate a few sources, like mix_audio does */
+		for (int pass = 0; pass < 4; pass++) {
+			mix_scalar(expected + start, src, count);
+			mix_float_samples(actual + start, src, count);
+		}
+
+		assert_memory_equal(expected, actual, sizeof(actual));
+	}
+}
+
+static void audio_scale_bit_exact_test(void **state)
+{
+	float src[TEST_FRAMES];
+	float vol[TEST_FRAMES];
+	float expected[TEST_FRAMES];
+	float actual[TEST_FRAMES];
+
+	srand(4321);
+
+	for (size_t start = 0; start < 17; start++) {
+		size_t count = TEST_FRAMES - start;
+		float gain = (float)rand() / (float)RAND_MAX;
+
+		fill_random(src, TEST_FRAMES);
+		fill_random(vol, TEST_FRAMES);
+
+		/* constant volume, copying */
+		memset(expected, 0, sizeof(expected));
+		memset(actual, 0, sizeof(actual));
+		for (size_t i = 0; i < count; i++)
+			expected[start + i] = src[i] * gain;
+		scale_float_samples(actual + start, src, gain, count);
+		assert_memory_equal(expected, actual, sizeof(actual));
+
+		/* volume ramp, in place */
+		memcpy(expected, src, sizeof(expected));
+		memcpy(actual, src, sizeof(actual));
+		for (size_t i = 0; i < count; i++)
+			expected[start + i] *= vol[i];
+		scale_float_samples_ramp(actual + start, actual + start, vol,
+					 count);
+		assert_memory_equal(expected, actual, sizeof(actual));
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(audio_mix_bit_exact_test),
+		cmocka_unit_test(audio_scale_bit_exact_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
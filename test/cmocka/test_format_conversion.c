@@ -0,0 +1,189 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <util/bmem.h>
+#include <media-io/format-conversion.h>
+
+/* widths cover whole vector iterations as well as every remainder */
+static const uint32_t test_widths[] = {2, 14, 16, 18, 30, 32, 34, 64, 118};
+
+#define TEST_HEIGHT 6
+
+/* per-pixel versions the vectorized functions have to match exactly */
+static uint32_t ref_420(uint8_t lum, uint8_t u, uint8_t v)
+{
+	return ((uint32_t)lum << 16) | ((uint32_t)u << 8) | v;
+}
+
+static uint32_t ref_nv12(uint8_t lum, uint8_t u, uint8_t v)
+{
+	return lum | ((uint32_t)u << 8) | ((uint32_t)v << 16);
+}
+
+static uint32_t ref_422(uint32_t dw, bool second, bool leading_lum)
+{
+	if (!second)
+		return dw;
+	if (leading_lum)
+		return (dw & 0xFFFFFF00) | (uint8_t)(dw >> 16);
+	return (dw & 0xFFFF00FF) | ((dw >> 16) & 0xFF00);
+}
+
+static void fill_pattern(uint8_t *data, size_t size, uint32_t seed)
+{
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = (uint8_t)(seed >> 16);
+	}
+}
+
+static void decompress_420_test(void **state)
+{
+	for (size_t i = 0; i < sizeof(test_widths) / sizeof(uint32_t); i++) {
+		uint32_t width = test_widths[i];
+		uint32_t in_linesize[3] = {width, width / 2, width / 2};
+		uint32_t out_linesize = width * 4;
+		uint8_t *planes = bmalloc(width * TEST_HEIGHT * 2);
+		uint32_t *output = bzalloc(out_linesize * TEST_HEIGHT);
+		const uint8_t *input[3];
+
+		fill_pattern(planes, width * TEST_HEIGHT * 2, width);
+		input[0] = planes;
+		input[1] = planes + width * TEST_HEIGHT;
+		input[2] = input[1] + width * TEST_HEIGHT / 2;
+
+		decompress_420(input, in_linesize, 0, TEST_HEIGHT,
+			       (uint8_t *)output, out_linesize);
+
+		for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				uint32_t c = (y / 2) * in_linesize[1] + x / 2;
+				uint32_t expected =
+					ref_420(input[0][y * width + x],
+						input[1][c], input[2][c]);
+				assert_int_equal(output[y * width + x],
+						 expected);
+			}
+		}
+
+		bfree(planes);
+		bfree(output);
+	}
+}
+
+static void decompress_nv12_test(void **state)
+{
+	for (size_t i = 0; i < sizeof(test_widths) / sizeof(uint32_t); i++) {
+		uint32_t width = test_widths[i];
+		uint32_t in_linesize[2] = {width, width};
+		uint32_t out_linesize = width * 4;
+		uint8_t *planes = bmalloc(width * TEST_HEIGHT * 2);
+		uint32_t *output = bzalloc(out_linesize * TEST_HEIGHT);
+		const uint8_t *input[2];
+
+		fill_pattern(planes, width * TEST_HEIGHT * 2, width + 1);
+		input[0] = planes;
+		input[1] = planes + width * TEST_HEIGHT;
+
+		decompress_nv12(input, in_linesize, 0, TEST_HEIGHT,
+				(uint8_t *)output, out_linesize);
+
+		for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t *uv = input[1] + (y / 2) * width +
+						    (x & ~1);
+				uint32_t expected = ref_nv12(
+					input[0][y * width + x], uv[0], uv[1]);
+				assert_int_equal(output[y * width + x],
+						 expected);
+			}
+		}
+
+		bfree(planes);
+		bfree(output);
+	}
+}
+
+static void check_422(bool leading_lum)
+{
+	for (size_t i = 0; i < sizeof(test_widths) / sizeof(uint32_t); i++) {
+		uint32_t width = test_widths[i];
+		uint32_t in_linesize = width * 2;
+		uint32_t out_linesize = width * 4;
+		uint32_t pairs = width / 2;
+		uint32_t *input = bmalloc(in_linesize * TEST_HEIGHT);
+		uint32_t *output = bzalloc(out_linesize * TEST_HEIGHT);
+
+		fill_pattern((uint8_t *)input, in_linesize * TEST_HEIGHT,
+			     width + 2);
+
+		decompress_422((const uint8_t *)input, in_linesize, 0,
+			       TEST_HEIGHT, (uint8_t *)output, out_linesize,
+			       leading_lum);
+
+		for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+			const uint32_t *in_line = input + y * pairs;
+			const uint32_t *out_line = output + y * pairs * 2;
+
+			for (uint32_t x = 0; x < pairs * 2; x++) {
+				uint32_t expected = ref_422(
+					in_line[x / 2], x & 1, leading_lum);
+				assert_int_equal(out_line[x], expected);
+			}
+		}
+
+		bfree(input);
+		bfree(output);
+	}
+}
+
+static void decompress_422_test(void **state)
+{
+	check_422(true);
+	check_422(false);
+}
+
+/* rows outside of start_y/end_y must be left alone */
+static void decompress_420_rows_test(void **state)
+{
+	uint32_t width = 34;
+	uint32_t in_linesize[3] = {width, width / 2, width / 2};
+	uint32_t out_linesize = width * 4;
+	uint8_t *planes = bmalloc(width * TEST_HEIGHT * 2);
+	uint8_t *output = bzalloc(out_linesize * TEST_HEIGHT);
+	const uint8_t *input[3];
+
+	fill_pattern(planes, width * TEST_HEIGHT * 2, 7);
+	input[0] = planes;
+	input[1] = planes + width * TEST_HEIGHT;
+	input[2] = input[1] + width * TEST_HEIGHT / 2;
+
+	decompress_420(input, in_linesize, 2, 4, output, out_linesize);
+
+	for (uint32_t y = 0; y < TEST_HEIGHT; y++) {
+		if (y == 2 || y == 3)
+			continue;
+
+		for (uint32_t x = 0; x < out_linesize; x++)
+			assert_int_equal(output[y * out_linesize + x], 0);
+	}
+
+	bfree(planes);
+	bfree(output);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(decompress_420_test),
+		cmocka_unit_test(decompress_nv12_test),
+		cmocka_unit_test(decompress_422_test),
+		cmocka_unit_test(decompress_420_rows_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
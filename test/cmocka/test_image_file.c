@@ -0,0 +1,167 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <graphics/image-file.h>
+#include <util/platform.h>
+
+#define GIF_PATH "test_image_file.gif"
+#define FINITE_GIF_PATH "test_image_file_finite.gif"
+#define NUM_FRAMES 3
+
+/* offset of the loop count in the netscape extension, and how many times the
+ * finite copy of the gif plays */
+#define LOOP_COUNT_OFFSET 41
+#define FINITE_LOOPS 2
+
+/* 10ms per frame, just past it so every tick moves one frame */
+#define FRAME_NS 10000001ULL
+
+#define GIF_FRAME(index)                                                  \
+	0x21, 0xF9, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x2C, 0x00, 0x00, \
+		0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x02, 0x02,     \
+		0x44 + (index) * 8, 0x01, 0x00
+
+/* 1x1 gif looping forever over red, green and blue */
+static const uint8_t gif_file[] = {
+	'G',  'I',  'F',  '8',  '9',  'a',  0x01, 0x00, 0x01, 0x00,
+	0x81, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00,
+	0x00, 0xFF, 0x00, 0x00, 0x00, 0x21, 0xFF, 0x0B, 'N',  'E',
+	'T',  'S',  'C',  'A',  'P',  'E',  '2',  '.',  '0',  0x03,
+	0x01, 0x00, 0x00, 0x00, GIF_FRAME(0), GIF_FRAME(1), GIF_FRAME(2),
+	0x3B,
+};
+
+static bool write_file(const char *path, const uint8_t *data, size_t size)
+{
+	FILE *f = os_fopen(path, "wb");
+	if (!f)
+		return false;
+
+	fwrite(data, 1, size, f);
+	fclose(f);
+	return true;
+}
+
+static int write_gif(void **state)
+{
+	uint8_t finite[sizeof(gif_file)];
+
+	memcpy(finite, gif_file, sizeof(gif_file));
+	finite[LOOP_COUNT_OFFSET] = FINITE_LOOPS;
+
+	if (!write_file(GIF_PATH, gif_file, sizeof(gif_file)))
+		return -1;
+	if (!write_file(FINITE_GIF_PATH, finite, sizeof(finite)))
+		return -1;
+	return 0;
+}
+
+static int remove_gif(void **state)
+{
+	os_unlink(GIF_PATH);
+	os_unlink(FINITE_GIF_PATH);
+	return 0;
+}
+
+/* waits for the decoder thread instead of racing it */
+static bool tick_frame(gs_image_file4_t *if4)
+{
+	bool updated = gs_image_file4_tick(if4, FRAME_NS);
+
+	for (int i = 0; !updated && i < 200; i++) {
+		os_sleep_ms(5);
+		updated = gs_image_file4_tick(if4, 0);
+	}
+
+	return updated;
+}
+
+static void cached_test(void **state)
+{
+	gs_image_file4_t if4 = {0};
+
+	gs_image_file4_init(&if4, GIF_PATH, GS_IMAGE_ALPHA_STRAIGHT,
+			    UINT64_MAX);
+	assert_true(if4.image3.image2.image.loaded);
+	assert_true(if4.image3.image2.image.is_animated_gif);
+	assert_null(if4.gif_stream);
+
+	assert_true(gs_image_file4_tick(&if4, FRAME_NS));
+	assert_int_equal(if4.image3.image2.image.cur_frame, 1);
+
+	gs_image_file4_free(&if4);
+}
+
+/* a budget too small for the whole animation streams it, playback still
+ * visits every frame in order and loops */
+static void streamed_test(void **state)
+{
+	gs_image_file4_t if4 = {0};
+	gs_image_file_t *image = &if4.image3.image2.image;
+
+	gs_image_file4_init(&if4, GIF_PATH, GS_IMAGE_ALPHA_PREMULTIPLY, 0);
+	assert_true(image->loaded);
+	assert_true(image->is_animated_gif);
+	assert_non_null(if4.gif_stream);
+	assert_null(image->animation_frame_data);
+	assert_true(if4.image3.image2.mem_usage > 0);
+
+	for (int i = 1; i <= NUM_FRAMES * 3 + 1; i++) {
+		assert_true(tick_frame(&if4));
+		assert_int_equal(image->cur_frame, i % NUM_FRAMES);
+	}
+
+	/* restarting playback like the image source does when hidden */
+	gs_image_file4_reset(&if4);
+	gs_image_file4_update_texture(&if4);
+	assert_int_equal(image->cur_frame, 0);
+
+	assert_true(tick_frame(&if4));
+	assert_int_equal(image->cur_frame, 1);
+
+	gs_image_file4_free(&if4);
+	assert_null(if4.gif_stream);
+	assert_int_equal(if4.image3.image2.mem_usage, 0);
+}
+
+/* resetting on the first frame of a later loop has to restart the stream
+ * too, or playback runs past the end of a gif that doesn't loop forever */
+static void finite_reset_test(void **state)
+{
+	gs_image_file4_t if4 = {0};
+	gs_image_file_t *image = &if4.image3.image2.image;
+
+	gs_image_file4_init(&if4, FINITE_GIF_PATH, GS_IMAGE_ALPHA_PREMULTIPLY,
+			    0);
+	assert_true(image->loaded);
+	assert_non_null(if4.gif_stream);
+
+	for (int i = 1; i <= NUM_FRAMES; i++)
+		assert_true(tick_frame(&if4));
+	assert_int_equal(image->cur_frame, 0);
+	assert_int_equal(image->cur_loop, 1);
+
+	gs_image_file4_reset(&if4);
+	gs_image_file4_update_texture(&if4);
+
+	/* every frame of every loop is still shown */
+	for (int i = 1; i < NUM_FRAMES * FINITE_LOOPS; i++) {
+		assert_true(tick_frame(&if4));
+		assert_int_equal(image->cur_frame, i % NUM_FRAMES);
+	}
+
+	gs_image_file4_free(&if4);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(cached_test),
+		cmocka_unit_test(streamed_test),
+		cmocka_unit_test(finite_reset_test),
+	};
+
+	return cmocka_run_group_tests(tests, write_gif, remove_gif);
+}
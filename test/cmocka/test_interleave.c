@@ -0,0 +1,149 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include <obs-interleave.h>
+
+#define AUDIO_TRACKS 6
+#define TEST_PACKETS 20000
+
+/* reference: the original linear insertion used by obs-output */
+static void linear_insert(struct darray *queue, struct encoder_packet *out)
+{
+	struct encoder_packet *array = queue->array;
+	size_t idx;
+
+	for (idx = 0; idx < queue->num; idx++) {
+		struct encoder_packet *cur_packet = array + idx;
+
+		if (out->dts_usec == cur_packet->dts_usec &&
+		    out->type == OBS_ENCODER_VIDEO) {
+			break;
+		} else if (out->dts_usec < cur_packet->dts_usec) {
+			break;
+		}
+	}
+
+	darray_insert(sizeof(*out), queue, idx, out);
+}
+
+/* generates a recorded-like packet sequence: 60fps video with b-frame style
+ * dts jitter and several aac tracks that all share the same timestamps */
+static void make_packets(struct encoder_packet *packets, size_t count,
+			 unsigned seed)
+{
+	int64_t video_ts = 0;
+	int64_t audio_ts[AUDIO_TRACKS] = {0};
+
+	srand(seed);
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet *p = &packets[i];
+		int pick = rand() % (AUDIO_TRACKS + 2);
+
+		memset(p, 0, sizeof(*p));
+		p->size = i;
+
+		if (pick < 2) {
+			p->type = OBS_ENCODER_VIDEO;
+			p->dts_usec = video_ts - (rand() % 3) * 16666;
+			video_ts += 16666;
+		} else {
+			size_t track = (size_t)(pick - 2);
+			p->type = OBS_ENCODER_AUDIO;
+			p->track_idx = track;
+			p->dts_usec = audio_ts[track];
+			audio_ts[track] += 21333;
+
+			/* force exact collisions with video timestamps */
+			if (rand() % 8 == 0)
+				p->dts_usec = video_ts;
+		}
+	}
+}
+
+static void interleave_replay_test(void **state)
+{
+	struct encoder_packet *packets =
+		malloc(sizeof(struct encoder_packet) * TEST_PACKETS);
+
+	for (unsigned seed = 1; seed <= 4; seed++) {
+		DARRAY(struct encoder_packet) linear;
+		DARRAY(struct interleaved_packet) heap;
+		uint64_t order = 0;
+		size_t startup = 64 * seed;
+
+		da_init(linear);
+		da_init(heap);
+
+		make_packets(packets, TEST_PACKETS, seed);
+
+		/* startup phase: fully sorted insertion */
+		for (size_t i = 0; i < startup; i++) {
+			linear_insert(&linear.da, &packets[i]);
+			interleave_insert_sorted(&heap.da, &order, &packets[i]);
+		}
+
+		assert_int_equal(linear.num, heap.num);
+		for (size_t i = 0; i < linear.num; i++)
+			assert_int_equal(linear.array[i].size,
+					 heap.array[i].packet.size);
+
+		/* apply an offset and resort, like when an output starts */
+		for (size_t i = 0; i < linear.num; i++) {
+			linear.array[i].dts_usec -= 5000 * (int64_t)(i % 3);
+			heap.array[i].packet.dts_usec -= 5000 * (int64_t)(i % 3);
+		}
+
+		DARRAY(struct encoder_packet) old;
+		old.da = linear.da;
+		da_init(linear);
+		for (size_t i = 0; i < old.num; i++)
+			linear_insert(&linear.da, &old.array[i]);
+		da_free(old);
+
+		interleave_sort(&heap.da, &order);
+
+		/* steady state: insert one, send from the front now and then */
+		for (size_t i = startup; i < TEST_PACKETS; i++) {
+			linear_insert(&linear.da, &packets[i]);
+			interleave_push(&heap.da, &order, &packets[i]);
+
+			if (rand() % 4 == 0)
+				continue;
+
+			struct encoder_packet a = linear.array[0];
+			struct encoder_packet b;
+
+			da_erase(linear, 0);
+			interleave_pop(&heap.da, &b);
+			assert_int_equal(a.size, b.size);
+		}
+
+		while (linear.num) {
+			struct encoder_packet b;
+
+			interleave_pop(&heap.da, &b);
+			assert_int_equal(linear.array[0].size, b.size);
+			da_erase(linear, 0);
+		}
+
+		assert_int_equal(heap.num, 0);
+
+		da_free(linear);
+		da_free(heap);
+	}
+
+	free(packets);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(interleave_replay_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,157 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <obs-data.h>
+#include <util/dstr.h>
+
+/* enough items to go past the index threshold and grow the index */
+#define NUM_ITEMS 1000
+
+static void make_name(struct dstr *name, int i)
+{
+	/* spread the names so they don't arrive in sorted order */
+	dstr_printf(name, "item_%d", (i * 7919) % NUM_ITEMS);
+}
+
+static void check_sorted(obs_data_t *data, size_t expected)
+{
+	obs_data_item_t *item = obs_data_first(data);
+	struct dstr prev = {0};
+	size_t count = 0;
+
+	for (; item; obs_data_item_next(&item)) {
+		const char *name = obs_data_item_get_name(item);
+
+		if (prev.len)
+			assert_true(strcmp(prev.array, name) < 0);
+		dstr_copy(&prev, name);
+		count++;
+	}
+
+	assert_int_equal(count, expected);
+	dstr_free(&prev);
+}
+
+static void lookup_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	struct dstr name = {0};
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		obs_data_set_int(data, name.array, i);
+	}
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		assert_int_equal(obs_data_get_int(data, name.array), i);
+		assert_true(obs_data_has_user_value(data, name.array));
+	}
+
+	assert_false(obs_data_has_user_value(data, "missing"));
+	check_sorted(data, NUM_ITEMS);
+
+	dstr_free(&name);
+	obs_data_release(data);
+}
+
+static void erase_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	struct dstr name = {0};
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		obs_data_set_int(data, name.array, i);
+	}
+
+	for (int i = 0; i < NUM_ITEMS; i += 2) {
+		make_name(&name, i);
+		obs_data_erase(data, name.array);
+	}
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		assert_int_equal(obs_data_has_user_value(data, name.array),
+				 (i & 1) != 0);
+	}
+
+	check_sorted(data, NUM_ITEMS / 2);
+
+	dstr_free(&name);
+	obs_data_release(data);
+}
+
+/* growing an item reallocates it, which must keep the list and the index
+ * pointing at the new allocation */
+static void realloc_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	struct dstr name = {0};
+	struct dstr val = {0};
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		obs_data_set_string(data, name.array, "");
+	}
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		dstr_printf(&val, "a much longer string value for item %d", i);
+		obs_data_set_string(data, name.array, val.array);
+		obs_data_set_default_string(data, name.array, val.array);
+	}
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		make_name(&name, i);
+		dstr_printf(&val, "a much longer string value for item %d", i);
+		assert_string_equal(obs_data_get_string(data, name.array),
+				    val.array);
+		assert_string_equal(
+			obs_data_get_default_string(data, name.array),
+			val.array);
+	}
+
+	check_sorted(data, NUM_ITEMS);
+
+	dstr_free(&name);
+	dstr_free(&val);
+	obs_data_release(data);
+}
+
+static void json_order_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	obs_data_t *loaded;
+	char *json;
+
+	obs_data_set_int(data, "c", 3);
+	obs_data_set_int(data, "a", 1);
+	obs_data_set_int(data, "b", 2);
+
+	json = bstrdup(obs_data_get_json(data));
+	assert_string_equal(json, "{\"a\":1,\"b\":2,\"c\":3}");
+
+	loaded = obs_data_create_from_json(json);
+	assert_string_equal(obs_data_get_json(loaded), json);
+
+	bfree(json);
+	obs_data_release(loaded);
+	obs_data_release(data);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(lookup_test),
+		cmocka_unit_test(erase_test),
+		cmocka_unit_test(realloc_test),
+		cmocka_unit_test(json_order_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
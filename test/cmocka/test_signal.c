@@ -0,0 +1,447 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <callback/signal.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define NUM_SIGNALS 50
+
+#define STRESS_THREADS 8
+#define STRESS_ITERATIONS 2000
+
+/* each callback takes far longer than signalling is allowed to */
+#define SLOW_CALLBACK_MS 10
+
+struct slow_subscriber {
+	volatile long calls;
+	volatile long last_val;
+};
+
+static void slow_callback(void *data, calldata_t *cd)
+{
+	struct slow_subscriber *sub = data;
+
+	os_sleep_ms(SLOW_CALLBACK_MS);
+	os_atomic_set_long(&sub->last_val, (long)calldata_int(cd, "val"));
+	os_atomic_inc_long(&sub->calls);
+}
+
+static void wait_for_calls(struct slow_subscriber *sub, long calls)
+{
+	for (int i = 0; i < 2000; i++) {
+		if (os_atomic_load_long(&sub->calls) >= calls)
+			return;
+		os_sleep_ms(5);
+	}
+}
+
+static uint64_t send_signals(signal_handler_t *handler)
+{
+	uint64_t max_time = 0;
+	uint8_t stack[128];
+	calldata_t cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+
+	for (int i = 0; i < NUM_SIGNALS; i++) {
+		uint64_t start = os_gettime_ns();
+		uint64_t time;
+
+		calldata_set_int(&cd, "val", i);
+		signal_handler_signal(handler, "levels", &cd);
+
+		time = os_gettime_ns() - start;
+		if (time > max_time)
+			max_time = time;
+	}
+
+	return max_time;
+}
+
+/* the signalling thread must not wait on a slow deferred subscriber, and
+ * every signal still has to arrive in order */
+static void deferred_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct slow_subscriber sub = {0};
+	uint64_t max_time;
+
+	signal_handler_add(handler, "void levels(int val)");
+	signal_handler_connect_deferred(handler, "levels", slow_callback, &sub,
+					false);
+
+	max_time = send_signals(handler);
+	assert_true(max_time < SLOW_CALLBACK_MS * 1000000ULL / 2);
+
+	wait_for_calls(&sub, NUM_SIGNALS);
+	assert_int_equal(os_atomic_load_long(&sub.calls), NUM_SIGNALS);
+	assert_int_equal(os_atomic_load_long(&sub.last_val), NUM_SIGNALS - 1);
+
+	signal_handler_disconnect(handler, "levels", slow_callback, &sub);
+	signal_handler_destroy(handler);
+	signal_handler_dispatch_shutdown();
+}
+
+/* coalesced subscribers skip signals while they're busy, but always end up
+ * with the newest one */
+static void coalesce_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct slow_subscriber sub = {0};
+
+	signal_handler_add(handler, "void levels(int val)");
+	signal_handler_connect_deferred(handler, "levels", slow_callback, &sub,
+					true);
+
+	send_signals(handler);
+
+	wait_for_calls(&sub, 1);
+	for (int i = 0; i < 100; i++) {
+		if (os_atomic_load_long(&sub.last_val) == NUM_SIGNALS - 1)
+			break;
+		os_sleep_ms(SLOW_CALLBACK_MS);
+	}
+
+	assert_true(os_atomic_load_long(&sub.calls) < NUM_SIGNALS);
+	assert_int_equal(os_atomic_load_long(&sub.last_val), NUM_SIGNALS - 1);
+
+	signal_handler_disconnect(handler, "levels", slow_callback, &sub);
+	signal_handler_destroy(handler);
+	signal_handler_dispatch_shutdown();
+}
+
+/* nothing may be delivered after disconnecting */
+static void disconnect_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct slow_subscriber sub = {0};
+	long calls;
+
+	signal_handler_add(handler, "void levels(int val)");
+	signal_handler_connect_deferred(handler, "levels", slow_callback, &sub,
+					false);
+
+	send_signals(handler);
+	signal_handler_disconnect(handler, "levels", slow_callback, &sub);
+
+	calls = os_atomic_load_long(&sub.calls);
+	os_sleep_ms(SLOW_CALLBACK_MS * 5);
+	assert_int_equal(os_atomic_load_long(&sub.calls), calls);
+	assert_true(calls < NUM_SIGNALS);
+
+	signal_handler_destroy(handler);
+	signal_handler_dispatch_shutdown();
+}
+
+struct disconnect_data {
+	signal_handler_t *handler;
+	struct slow_subscriber sub;
+	long first_calls;
+	long last_calls;
+};
+
+static void disconnect_first_callback(void *data, calldata_t *cd)
+{
+	struct disconnect_data *dd = data;
+
+	signal_handler_disconnect(dd->handler, "levels", slow_callback,
+				  &dd->sub);
+	dd->first_calls++;
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void disconnect_last_callback(void *data, calldata_t *cd)
+{
+	struct disconnect_data *dd = data;
+	dd->last_calls++;
+
+	UNUSED_PARAMETER(cd);
+}
+
+/* disconnecting a deferred callback while the signal is being sent must not
+ * skip the callbacks that come after the one disconnecting it */
+static void disconnect_while_signalling_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct disconnect_data dd = {handler};
+	uint8_t stack[128];
+	calldata_t cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_int(&cd, "val", 0);
+
+	signal_handler_add(handler, "void levels(int val)");
+	signal_handler_connect_deferred(handler, "levels", slow_callback,
+					&dd.sub, false);
+	signal_handler_connect(handler, "levels", disconnect_first_callback,
+			       &dd);
+	signal_handler_connect(handler, "levels", disconnect_last_callback,
+			       &dd);
+
+	signal_handler_signal(handler, "levels", &cd);
+	signal_handler_signal(handler, "levels", &cd);
+
+	assert_int_equal(dd.first_calls, 2);
+	assert_int_equal(dd.last_calls, 2);
+
+	signal_handler_destroy(handler);
+	signal_handler_dispatch_shutdown();
+}
+
+struct nested_subscriber {
+	signal_handler_t *handler;
+	os_event_t *calling;
+	volatile bool alive;
+	volatile long late_calls;
+};
+
+static void nested_slow_callback(void *data, calldata_t *cd)
+{
+	struct nested_subscriber *sub = data;
+
+	os_event_signal(sub->calling);
+	os_sleep_ms(SLOW_CALLBACK_MS);
+	if (!os_atomic_load_bool(&sub->alive))
+		os_atomic_inc_long(&sub->late_calls);
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void nested_disconnect_callback(void *data, calldata_t *cd)
+{
+	struct nested_subscriber *sub = data;
+
+	signal_handler_disconnect(sub->handler, "a", nested_slow_callback,
+				  sub);
+	os_atomic_set_bool(&sub->alive, false);
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void *nested_signal_thread(void *data)
+{
+	struct nested_subscriber *sub = data;
+	uint8_t stack[128];
+	calldata_t cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_int(&cd, "val", 0);
+	signal_handler_signal(sub->handler, "a", &cd);
+	return NULL;
+}
+
+/* disconnecting from inside a callback of another signal still waits for a
+ * thread that's calling the disconnected callback */
+static void nested_disconnect_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct nested_subscriber sub = {handler};
+	pthread_t thread;
+	uint8_t stack[128];
+	calldata_t cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_int(&cd, "val", 0);
+	os_event_init(&sub.calling, OS_EVENT_TYPE_MANUAL);
+	sub.alive = true;
+
+	signal_handler_add(handler, "void a(int val)");
+	signal_handler_add(handler, "void b(int val)");
+	signal_handler_connect(handler, "a", nested_slow_callback, &sub);
+	signal_handler_connect(handler, "b", nested_disconnect_callback, &sub);
+
+	pthread_create(&thread, NULL, nested_signal_thread, &sub);
+	os_event_wait(sub.calling);
+	signal_handler_signal(handler, "b", &cd);
+	pthread_join(thread, NULL);
+
+	assert_int_equal(os_atomic_load_long(&sub.late_calls), 0);
+
+	os_event_destroy(sub.calling);
+	signal_handler_destroy(handler);
+}
+
+struct concurrent_subscriber {
+	signal_handler_t *handler;
+	os_event_t *both_inside;
+	volatile long inside;
+	volatile bool overlapped;
+};
+
+static void concurrent_callback(void *data, calldata_t *cd)
+{
+	struct concurrent_subscriber *sub = data;
+
+	if (os_atomic_inc_long(&sub->inside) == 2) {
+		os_atomic_set_bool(&sub->overlapped, true);
+		os_event_signal(sub->both_inside);
+	} else {
+		os_event_timedwait(sub->both_inside, 1000);
+	}
+
+	os_atomic_dec_long(&sub->inside);
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void *concurrent_signal_thread(void *data)
+{
+	struct concurrent_subscriber *sub = data;
+	uint8_t stack[128];
+	calldata_t cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_int(&cd, "val", 0);
+	signal_handler_signal(sub->handler, "levels", &cd);
+	return NULL;
+}
+
+/* the same signal sent from two threads calls its callbacks at the same
+ * time instead of one thread waiting for the other */
+static void concurrent_signal_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct concurrent_subscriber sub = {handler};
+	pthread_t threads[2];
+
+	os_event_init(&sub.both_inside, OS_EVENT_TYPE_MANUAL);
+
+	signal_handler_add(handler, "void levels(int val)");
+	signal_handler_connect(handler, "levels", concurrent_callback, &sub);
+
+	for (size_t i = 0; i < 2; i++)
+		pthread_create(&threads[i], NULL, concurrent_signal_thread,
+			       &sub);
+	for (size_t i = 0; i < 2; i++)
+		pthread_join(threads[i], NULL);
+
+	assert_true(os_atomic_load_bool(&sub.overlapped));
+
+	os_event_destroy(sub.both_inside);
+	signal_handler_destroy(handler);
+}
+
+static const char *stress_signals[] = {"a", "b", "c", "d"};
+
+#define NUM_STRESS_SIGNALS \
+	(sizeof(stress_signals) / sizeof(stress_signals[0]))
+
+struct stress_subscriber {
+	volatile bool connected;
+	volatile long calls;
+};
+
+static volatile long late_calls = 0;
+
+static void stress_callback(void *data, calldata_t *cd)
+{
+	struct stress_subscriber *sub = data;
+
+	if (!os_atomic_load_bool(&sub->connected))
+		os_atomic_inc_long(&late_calls);
+	os_atomic_inc_long(&sub->calls);
+
+	UNUSED_PARAMETER(cd);
+}
+
+static void stress_global_callback(void *data, const char *signal,
+				   calldata_t *cd)
+{
+	stress_callback(data, cd);
+	UNUSED_PARAMETER(signal);
+}
+
+static void remove_self_callback(void *data, calldata_t *cd)
+{
+	signal_handler_remove_current();
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(cd);
+}
+
+static void *stress_thread(void *data)
+{
+	signal_handler_t *handler = data;
+	struct stress_subscriber sub = {0};
+	struct stress_subscriber global_sub = {0};
+	uint8_t stack[128];
+	calldata_t cd;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+
+	for (int i = 0; i < STRESS_ITERATIONS; i++) {
+		const char *signal = stress_signals[i % NUM_STRESS_SIGNALS];
+
+		os_atomic_set_bool(&sub.connected, true);
+		signal_handler_connect(handler, signal, stress_callback, &sub);
+
+		if ((i & 7) == 0) {
+			os_atomic_set_bool(&global_sub.connected, true);
+			signal_handler_connect_global(
+				handler, stress_global_callback, &global_sub);
+		}
+
+		signal_handler_connect(handler, signal, remove_self_callback,
+				       &sub);
+
+		calldata_set_int(&cd, "val", i);
+		signal_handler_signal(handler, signal, &cd);
+
+		signal_handler_disconnect(handler, signal, stress_callback,
+					  &sub);
+		os_atomic_set_bool(&sub.connected, false);
+
+		if ((i & 7) == 0) {
+			signal_handler_disconnect_global(
+				handler, stress_global_callback, &global_sub);
+			os_atomic_set_bool(&global_sub.connected, false);
+		}
+	}
+
+	/* its own signal always reaches it */
+	assert_true(os_atomic_load_long(&sub.calls) >= STRESS_ITERATIONS);
+	return NULL;
+}
+
+/* callbacks are connected, disconnected and signalled from many threads at
+ * once, a callback must never be called once it's been disconnected */
+static void stress_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	pthread_t threads[STRESS_THREADS];
+
+	for (size_t i = 0; i < NUM_STRESS_SIGNALS; i++) {
+		struct dstr decl = {0};
+		dstr_printf(&decl, "void %s(int val)", stress_signals[i]);
+		assert_true(signal_handler_add(handler, decl.array));
+		dstr_free(&decl);
+	}
+
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_create(&threads[i], NULL, stress_thread, handler);
+	for (size_t i = 0; i < STRESS_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	assert_int_equal(os_atomic_load_long(&late_calls), 0);
+
+	signal_handler_destroy(handler);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(deferred_test),
+		cmocka_unit_test(coalesce_test),
+		cmocka_unit_test(disconnect_test),
+		cmocka_unit_test(disconnect_while_signalling_test),
+		cmocka_unit_test(nested_disconnect_test),
+		cmocka_unit_test(concurrent_signal_test),
+		cmocka_unit_test(stress_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
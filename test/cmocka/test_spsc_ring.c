@@ -0,0 +1,99 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/spsc-ring.h>
+#include <util/threading.h>
+
+#define TEST_ITEMS 100000
+
+static void spsc_ring_basic_test(void **state)
+{
+	struct spsc_ring ring;
+	int val;
+
+	spsc_ring_init(&ring, sizeof(int), 3);
+	assert_int_equal(ring.capacity, 4);
+
+	for (int i = 0; i < 4; i++)
+		assert_true(spsc_ring_push_back(&ring, &i));
+
+	val = 4;
+	assert_false(spsc_ring_push_back(&ring, &val));
+	assert_int_equal(spsc_ring_size(&ring), 4);
+
+	/* revoke the second element, the consumer must skip it */
+	assert_true(spsc_ring_revoke(&ring, spsc_ring_begin(&ring) + 1, &val));
+	assert_int_equal(val, 1);
+	assert_null(spsc_ring_peek(&ring, spsc_ring_begin(&ring) + 1));
+
+	assert_true(spsc_ring_pop_front(&ring, &val));
+	assert_int_equal(val, 0);
+	assert_true(spsc_ring_pop_front(&ring, &val));
+	assert_int_equal(val, 2);
+
+	/* a taken element can no longer be revoked */
+	assert_false(spsc_ring_revoke(&ring, spsc_ring_begin(&ring) - 1, NULL));
+
+	assert_true(spsc_ring_pop_front(&ring, &val));
+	assert_int_equal(val, 3);
+	assert_false(spsc_ring_pop_front(&ring, &val));
+	assert_int_equal(spsc_ring_size(&ring), 0);
+
+	spsc_ring_free(&ring);
+}
+
+static void *consumer_thread(void *data)
+{
+	struct spsc_ring *ring = data;
+	long long sum = 0;
+	int expected = 0;
+	int val;
+
+	while (expected < TEST_ITEMS) {
+		if (!spsc_ring_pop_front(ring, &val))
+			continue;
+
+		/* order must be preserved */
+		if (val != expected)
+			return NULL;
+
+		sum += val;
+		expected++;
+	}
+
+	return (void *)(intptr_t)(sum == (long long)TEST_ITEMS *
+						 (TEST_ITEMS - 1) / 2);
+}
+
+static void spsc_ring_threaded_test(void **state)
+{
+	struct spsc_ring ring;
+	pthread_t thread;
+	void *result;
+
+	spsc_ring_init(&ring, sizeof(int), 64);
+	assert_int_equal(pthread_create(&thread, NULL, consumer_thread, &ring),
+			 0);
+
+	for (int i = 0; i < TEST_ITEMS; i++) {
+		while (!spsc_ring_push_back(&ring, &i))
+			;
+	}
+
+	pthread_join(thread, &result);
+	assert_true(result != NULL);
+
+	spsc_ring_free(&ring);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(spsc_ring_basic_test),
+		cmocka_unit_test(spsc_ring_threaded_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}